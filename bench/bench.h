@@ -0,0 +1,43 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <crow/json.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// uda_bench: микробенчмарки декодирования строк и сериализации (micro)
+// и нагрузочный прогон маршрутов /api/* живого сервера (load).
+// Оба режима печатают один JSON-документ - результаты разных сборок сравниваются diff'ом/jq
+
+struct MicroOptions {
+  size_t rows = 100000;                          // строк в синтетической выборке
+  std::chrono::milliseconds min_time{500};       // минимальное время одного замера
+  size_t repetitions = 5;                        // замеров на бенчмарк, в отчет - медиана и минимум
+  std::string filter;                            // подстрока имени бенчмарка
+};
+
+struct LoadOptions {
+  std::string host = "127.0.0.1";
+  std::string port = "8080";
+  std::vector<size_t> concurrency = {1, 16};     // прогон на каждое число keep-alive соединений
+  std::chrono::seconds warmup{3};                // прогрев маршрута, в отчет не попадает
+  std::chrono::seconds duration{15};             // замер на каждый маршрут
+  std::vector<std::string> routes;               // пусто - все сценарии
+};
+
+// дописывают результаты в report (метку сборки и время прогона заполняет main)
+void runMicro(const MicroOptions& options, crow::json::wvalue& report);
+void runLoad(const LoadOptions& options, crow::json::wvalue& report);
+
+// перцентиль по отсортированной выборке (nearest-rank)
+template <typename T>
+T percentile(const std::vector<T>& sorted, double p) {
+  if (sorted.empty()) return T{};
+  size_t rank = static_cast<size_t>(p * static_cast<double>(sorted.size()));
+  return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+#endif // BENCH_H
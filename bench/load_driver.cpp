@@ -0,0 +1,364 @@
+#include "bench.h"
+#include <columnar_writer.h>
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cctype>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+namespace asio = boost::asio;
+
+namespace {
+
+// Минимальный блокирующий HTTP/1.1 клиент с keep-alive: на поток нагрузки одно соединение,
+// как у дашборда. Тело читается целиком (Content-Length, chunked или до закрытия)
+class HttpClient {
+private:
+    std::string host;
+    asio::io_context io;
+    asio::ip::tcp::socket socket{io};
+    asio::ip::tcp::resolver::results_type endpoints;
+    std::string buffer;
+    bool open = false;
+
+    void close() {
+        boost::system::error_code ec;
+        socket.close(ec);
+        buffer.clear();
+        open = false;
+    }
+
+    // гарантирует, что в buffer есть хотя бы size байт
+    void fill(size_t size) {
+        if (buffer.size() < size) {
+            asio::read(socket, asio::dynamic_buffer(buffer), asio::transfer_at_least(size - buffer.size()));
+        }
+    }
+
+    size_t readLine(std::string& line) {
+        size_t end = asio::read_until(socket, asio::dynamic_buffer(buffer), "\r\n");
+        line.assign(buffer, 0, end - 2);
+        buffer.erase(0, end);
+        return end;
+    }
+
+public:
+    struct Response {
+        int status = 0;
+        size_t bytes = 0;
+        std::string body;
+    };
+
+    HttpClient(std::string host_name, const std::string& port) : host(std::move(host_name)) {
+        asio::ip::tcp::resolver resolver(io);
+        endpoints = resolver.resolve(host, port);
+    }
+
+    // keep_body = false - тело только считается (нагрузка), true - нужно для разбора (поиск ID)
+    Response get(const std::string& target, const std::string& accept = {}, bool keep_body = false) {
+        try {
+            if (!open) {
+                asio::connect(socket, endpoints);
+                socket.set_option(asio::ip::tcp::no_delay(true));
+                open = true;
+            }
+
+            std::string request = "GET " + target + " HTTP/1.1\r\nHost: " + host + "\r\n";
+            if (!accept.empty()) request += "Accept: " + accept + "\r\n";
+            request += "\r\n";
+            asio::write(socket, asio::buffer(request));
+
+            size_t header_end = asio::read_until(socket, asio::dynamic_buffer(buffer), "\r\n\r\n");
+            std::string headers = buffer.substr(0, header_end);
+            buffer.erase(0, header_end);
+
+            Response response;
+            if (headers.size() < 12 || headers.compare(0, 5, "HTTP/") != 0) {
+                throw std::runtime_error("Malformed HTTP response");
+            }
+            response.status = std::stoi(headers.substr(9, 3));
+
+            std::optional<size_t> content_length;
+            bool chunked = false;
+            bool keep_alive = true;
+
+            size_t pos = headers.find("\r\n") + 2;
+            while (pos < headers.size()) {
+                size_t end = headers.find("\r\n", pos);
+                std::string line = headers.substr(pos, end - pos);
+                pos = end + 2;
+
+                size_t colon = line.find(':');
+                if (colon == std::string::npos) continue;
+                std::string name = line.substr(0, colon);
+                size_t value_start = line.find_first_not_of(' ', colon + 1);
+                std::string value = value_start == std::string::npos ? "" : line.substr(value_start);
+                for (char& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+                if (name == "content-length") content_length = std::stoull(value);
+                if (name == "transfer-encoding" && value.find("chunked") != std::string::npos) chunked = true;
+                if (name == "connection" && value.find("close") != std::string::npos) keep_alive = false;
+            }
+
+            auto take = [&](size_t size) {
+                fill(size);
+                if (keep_body) response.body.append(buffer, 0, size);
+                response.bytes += size;
+                buffer.erase(0, size);
+            };
+
+            if (chunked) {
+                std::string line;
+                while (true) {
+                    readLine(line);
+                    size_t size = std::stoull(line, nullptr, 16);
+                    if (size == 0) {
+                        // трейлеры до пустой строки
+                        while (readLine(line) > 2) {}
+                        break;
+                    }
+                    take(size);
+                    fill(2);
+                    buffer.erase(0, 2);
+                }
+            } else if (content_length) {
+                take(*content_length);
+            } else {
+                boost::system::error_code ec;
+                asio::read(socket, asio::dynamic_buffer(buffer), ec);
+                take(buffer.size());
+                keep_alive = false;
+            }
+
+            if (!keep_alive) close();
+            return response;
+        } catch (...) {
+            close();
+            throw;
+        }
+    }
+};
+
+struct Scenario {
+    std::string name;
+    std::string accept;
+    std::function<std::string(std::mt19937_64&)> target;
+};
+
+// ID из сида базы: маршруты опрашиваются по настоящим ключам, а не по выдуманным
+struct Fixture {
+    std::vector<int64_t> devices;
+    std::vector<int64_t> sessions;
+};
+
+std::vector<int64_t> collectIds(HttpClient& client, const std::string& target, const char* column) {
+    HttpClient::Response response = client.get(target, {}, true);
+    if (response.status != 200) {
+        throw std::runtime_error("GET " + target + " returned " + std::to_string(response.status));
+    }
+
+    std::vector<int64_t> ids;
+    crow::json::rvalue rows = crow::json::load(response.body);
+    if (!rows) {
+        throw std::runtime_error("GET " + target + " returned invalid JSON");
+    }
+    for (const crow::json::rvalue& row : rows) {
+        if (row.has(column)) ids.push_back(row[column].i());
+    }
+    return ids;
+}
+
+Fixture discover(const LoadOptions& options) {
+    HttpClient client(options.host, options.port);
+
+    Fixture fixture;
+    fixture.devices = collectIds(client, "/api/boards", "DEVICE_ID");
+    if (fixture.devices.empty()) {
+        throw std::runtime_error("No devices in /api/boards - is the database seeded (bench/seed.sql)?");
+    }
+
+    for (size_t i = 0; i < fixture.devices.size() && i < 16; i++) {
+        std::vector<int64_t> ids = collectIds(client, "/api/sessions/" + std::to_string(fixture.devices[i]) + "?limit=50",
+                                              "SESSION_ID");
+        fixture.sessions.insert(fixture.sessions.end(), ids.begin(), ids.end());
+    }
+    if (fixture.sessions.empty()) {
+        throw std::runtime_error("No sessions found for the seeded devices");
+    }
+    return fixture;
+}
+
+std::vector<Scenario> scenarios(const Fixture& fixture) {
+    auto pick = [](const std::vector<int64_t>& ids) {
+        return [&ids](std::mt19937_64& random) {
+            return std::to_string(ids[random() % ids.size()]);
+        };
+    };
+    auto device = pick(fixture.devices);
+    auto session = pick(fixture.sessions);
+
+    return {
+        {"boards", {}, [](std::mt19937_64&) { return std::string("/api/boards"); }},
+        {"board", {}, [=](std::mt19937_64& r) { return "/api/boards/" + device(r); }},
+        {"param", {}, [=](std::mt19937_64& r) { return "/api/param/" + device(r); }},
+        {"sessions", {}, [=](std::mt19937_64& r) { return "/api/sessions/" + device(r) + "?limit=100"; }},
+        {"session", {}, [=](std::mt19937_64& r) { return "/api/session/" + session(r); }},
+        {"points_page", {}, [=](std::mt19937_64& r) { return "/api/points/" + session(r) + "?limit=1000"; }},
+        {"points_full", {}, [=](std::mt19937_64& r) { return "/api/points/" + session(r); }},
+        {"points_columnar", COLUMNAR_CONTENT_TYPE, [=](std::mt19937_64& r) { return "/api/points/" + session(r); }},
+        {"points_lttb", {}, [=](std::mt19937_64& r) {
+            return "/api/points/" + session(r) + "?downsample=1000&method=lttb&y=PRESSURE";
+        }},
+    };
+}
+
+// счетчики сервера из /metrics; nullopt - метрики нет (uda собран без счетчика выделений)
+struct ServerCounters {
+    std::optional<double> allocations;
+    std::optional<double> peak_rss;
+};
+
+ServerCounters scrape(HttpClient& client) {
+    ServerCounters counters;
+    HttpClient::Response response = client.get("/metrics", {}, true);
+    if (response.status != 200) return counters;
+
+    auto value = [&](const std::string& name) -> std::optional<double> {
+        size_t pos = response.body.find("\n" + name + " ");
+        if (pos == std::string::npos) return std::nullopt;
+        return std::stod(response.body.substr(pos + name.size() + 2));
+    };
+    counters.allocations = value("uda_allocations_total");
+    counters.peak_rss = value("uda_process_peak_rss_bytes");
+    return counters;
+}
+
+struct WorkerResult {
+    std::vector<uint64_t> latencies;  // наносекунды
+    std::map<int, uint64_t> statuses;
+    uint64_t transport_errors = 0;
+    uint64_t bytes = 0;
+};
+
+crow::json::wvalue runScenario(const Scenario& scenario, size_t concurrency, const LoadOptions& options,
+                               HttpClient& control) {
+    std::atomic<bool> measuring{false};
+    std::atomic<bool> stopping{false};
+    std::vector<WorkerResult> results(concurrency);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < concurrency; i++) {
+        workers.emplace_back([&, i]() {
+            WorkerResult& result = results[i];
+            std::mt19937_64 random(i + 1);
+            std::optional<HttpClient> client;
+
+            while (!stopping) {
+                std::string target = scenario.target(random);
+                // в замер попадают запросы, целиком уложившиеся в окно
+                bool counted = measuring;
+                auto start = Clock::now();
+                try {
+                    if (!client) client.emplace(options.host, options.port);
+                    HttpClient::Response response = client->get(target, scenario.accept);
+                    auto elapsed = Clock::now() - start;
+
+                    if (counted && measuring) {
+                        result.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+                        result.statuses[response.status]++;
+                        result.bytes += response.bytes;
+                    }
+                } catch (const std::exception&) {
+                    if (counted && measuring) result.transport_errors++;
+                    client.reset();
+                }
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(options.warmup);
+    ServerCounters before = scrape(control);
+    measuring = true;
+    auto start = Clock::now();
+
+    std::this_thread::sleep_for(options.duration);
+
+    measuring = false;
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    ServerCounters after = scrape(control);
+    stopping = true;
+    for (std::thread& worker : workers) worker.join();
+
+    WorkerResult total;
+    for (WorkerResult& result : results) {
+        total.latencies.insert(total.latencies.end(), result.latencies.begin(), result.latencies.end());
+        for (const auto& [status, count] : result.statuses) total.statuses[status] += count;
+        total.transport_errors += result.transport_errors;
+        total.bytes += result.bytes;
+    }
+    std::sort(total.latencies.begin(), total.latencies.end());
+
+    const uint64_t requests = total.latencies.size();
+    auto ms = [](uint64_t nanos) { return static_cast<double>(nanos) / 1e6; };
+
+    crow::json::wvalue report;
+    report["route"] = scenario.name;
+    report["concurrency"] = static_cast<uint64_t>(concurrency);
+    report["duration_sec"] = elapsed;
+    report["requests"] = requests;
+    report["throughput_rps"] = static_cast<double>(requests) / elapsed;
+    report["bytes_per_request"] = requests ? static_cast<double>(total.bytes) / requests : 0.0;
+    report["transport_errors"] = total.transport_errors;
+
+    report["latency_ms"]["p50"] = ms(percentile(total.latencies, 0.5));
+    report["latency_ms"]["p90"] = ms(percentile(total.latencies, 0.9));
+    report["latency_ms"]["p99"] = ms(percentile(total.latencies, 0.99));
+    report["latency_ms"]["p999"] = ms(percentile(total.latencies, 0.999));
+    report["latency_ms"]["max"] = requests ? ms(total.latencies.back()) : 0.0;
+
+    for (const auto& [status, count] : total.statuses) {
+        report["status"][std::to_string(status)] = count;
+    }
+
+    // выделения сервера за окно замера делятся на все запросы окна, включая незавершенные -
+    // на длинном окне погрешность мала
+    if (before.allocations && after.allocations && requests) {
+        report["allocations_per_request"] = (*after.allocations - *before.allocations) / requests;
+    } else {
+        report["allocations_per_request"] = nullptr;
+    }
+    if (after.peak_rss) {
+        report["server_peak_rss_bytes"] = *after.peak_rss;
+    }
+    return report;
+}
+
+} // namespace
+
+void runLoad(const LoadOptions& options, crow::json::wvalue& report) {
+    Fixture fixture = discover(options);
+    HttpClient control(options.host, options.port);
+
+    std::vector<crow::json::wvalue> results;
+    for (const Scenario& scenario : scenarios(fixture)) {
+        if (!options.routes.empty()
+            && std::find(options.routes.begin(), options.routes.end(), scenario.name) == options.routes.end())
+            continue;
+
+        for (size_t concurrency : options.concurrency) {
+            std::cerr << "load: " << scenario.name << " x" << concurrency << std::endl;
+            results.push_back(runScenario(scenario, concurrency, options, control));
+        }
+    }
+
+    report["target"] = options.host + ":" + options.port;
+    report["devices"] = static_cast<uint64_t>(fixture.devices.size());
+    report["sessions"] = static_cast<uint64_t>(fixture.sessions.size());
+    report["results"] = std::move(results);
+}
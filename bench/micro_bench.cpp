@@ -0,0 +1,449 @@
+#include "bench.h"
+#include <alloc_stats.h>
+#include <columnar_reader.h>
+#include <columnar_writer.h>
+#include <downsampler.h>
+#include <fb_format.h>
+#include <json_writer.h>
+#include <request_arena.h>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct ColumnSpec {
+    const char* name;
+    unsigned int type;
+    unsigned int length;
+    int scale;
+    bool nullable;  // каждое 8-е значение NULL
+};
+
+// RD2_POINTS из bench/seed.sql - типичная строка выгрузки точек
+const std::vector<ColumnSpec> POINT_COLUMNS = {
+    {"POINT_ID", SQL_INT64, 8, 0, false},
+    {"SESSION_ID", SQL_INT64, 8, 0, false},
+    {"TS", SQL_TIMESTAMP, 8, 0, false},
+    {"DEPTH", SQL_LONG, 4, -2, false},        // NUMERIC(9,2)
+    {"PRESSURE", SQL_DOUBLE, 8, 0, false},
+    {"TEMPERATURE", SQL_SHORT, 2, -1, true},  // NUMERIC(4,1)
+    {"FLOW", SQL_DOUBLE, 8, 0, true},
+    {"STATUS", SQL_SHORT, 2, 0, false},
+    {"NOTE", SQL_VARYING, 2 + 32, 0, true},   // VARCHAR(32)
+};
+
+// по колонке на тип - стоимость декодирования каждого типа отдельно
+const std::vector<ColumnSpec> TYPE_COLUMNS = {
+    {"SMALLINT", SQL_SHORT, 2, 0, false},
+    {"INTEGER", SQL_LONG, 4, 0, false},
+    {"BIGINT", SQL_INT64, 8, 0, false},
+    {"NUMERIC_18_4", SQL_INT64, 8, -4, false},
+    {"NUMERIC_38_6", SQL_INT128, 16, -6, false},
+    {"FLOAT", SQL_FLOAT, 4, 0, false},
+    {"DOUBLE", SQL_DOUBLE, 8, 0, false},
+    {"BOOLEAN", SQL_BOOLEAN, 1, 0, false},
+    {"DATE", SQL_TYPE_DATE, 4, 0, false},
+    {"TIME", SQL_TYPE_TIME, 4, 0, false},
+    {"TIMESTAMP", SQL_TIMESTAMP, 8, 0, false},
+    {"CHAR_16", SQL_TEXT, 16, 0, false},
+    {"VARCHAR_64", SQL_VARYING, 2 + 64, 0, false},
+};
+
+unsigned int alignOf(unsigned int type) {
+    switch (type) {
+        case SQL_TEXT:
+        case SQL_BOOLEAN: return 1;
+        case SQL_VARYING:
+        case SQL_SHORT: return 2;
+        case SQL_INT64:
+        case SQL_DOUBLE:
+        case SQL_INT128: return 8;
+        default: return 4;
+    }
+}
+
+unsigned int alignUp(unsigned int value, unsigned int alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Раскладка как у IMessageMetadata: значение по выравниванию своего типа, за ним short-индикатор NULL
+RowPlan makePlan(const std::vector<ColumnSpec>& specs) {
+    std::vector<FbColumn> columns;
+    unsigned int offset = 0;
+    for (const ColumnSpec& spec : specs) {
+        FbColumn col;
+        col.name = spec.name;
+        col.type = spec.type;
+        col.length = spec.length;
+        col.scale = spec.scale;
+        col.offset = alignUp(offset, alignOf(spec.type));
+        col.null_offset = alignUp(col.offset + spec.length, 2);
+        offset = col.null_offset + 2;
+        columns.push_back(std::move(col));
+    }
+    return RowPlan(std::move(columns), alignUp(offset, 8));
+}
+
+template <typename T>
+void store(unsigned char* at, T value) {
+    std::memcpy(at, &value, sizeof(value));
+}
+
+// Сообщения подряд, как их отдает fetchNext; значения правдоподобные (растущие ключи и время, шум)
+std::vector<unsigned char> makeMessages(const RowPlan& plan, const std::vector<ColumnSpec>& specs, size_t rows) {
+    const unsigned int length = plan.getMessageLength();
+    std::vector<unsigned char> messages(length * rows, 0);
+
+    std::mt19937_64 random(42);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    const int64_t start_days = 20000;  // 2024-10-04
+
+    static const char* NOTES[] = {"", "ok", "pump restart", "pressure spike, check valve", "калибровка"};
+
+    for (size_t row = 0; row < rows; row++) {
+        unsigned char* message = messages.data() + row * length;
+        const int64_t seconds = static_cast<int64_t>(row);
+
+        for (size_t i = 0; i < specs.size(); i++) {
+            const FbColumn& col = plan.getColumns()[i];
+            unsigned char* data = message + col.offset;
+
+            if (specs[i].nullable && row % 8 == 7) {
+                store<short>(message + col.null_offset, -1);
+                continue;
+            }
+
+            switch (col.type) {
+                case SQL_SHORT: store<int16_t>(data, static_cast<int16_t>(200 + noise(random) * 50)); break;
+                case SQL_LONG: store<int32_t>(data, static_cast<int32_t>(row * 7 + 125000)); break;
+                case SQL_INT64: store<int64_t>(data, static_cast<int64_t>(row + 1000000)); break;
+                case SQL_INT128: {
+                    FB_I128 value{};
+                    value.fb_data[0] = row * 1000003 + 123456789;
+                    store(data, value);
+                    break;
+                }
+                case SQL_FLOAT: store<float>(data, static_cast<float>(noise(random) * 10)); break;
+                case SQL_DOUBLE: store<double>(data, 101.325 + noise(random)); break;
+                case SQL_BOOLEAN: store<unsigned char>(data, row % 3 == 0); break;
+                case SQL_TYPE_DATE:
+                    store<ISC_DATE>(data, static_cast<ISC_DATE>(ISC_UNIX_EPOCH_DAYS + start_days + row / 86400));
+                    break;
+                case SQL_TYPE_TIME:
+                    store<ISC_TIME>(data, static_cast<ISC_TIME>(seconds % 86400 * ISC_TIME_SECONDS_PRECISION));
+                    break;
+                case SQL_TIMESTAMP: {
+                    ISC_TIMESTAMP ts{};
+                    ts.timestamp_date = static_cast<ISC_DATE>(ISC_UNIX_EPOCH_DAYS + start_days + seconds / 86400);
+                    ts.timestamp_time = static_cast<ISC_TIME>(seconds % 86400 * ISC_TIME_SECONDS_PRECISION);
+                    store(data, ts);
+                    break;
+                }
+                case SQL_TEXT:
+                    std::memset(data, ' ', col.length);
+                    std::memcpy(data, "DEV-00042", 9);
+                    break;
+                case SQL_VARYING: {
+                    const char* note = NOTES[row % std::size(NOTES)];
+                    size_t len = std::min<size_t>(std::strlen(note), col.length - 2);
+                    store<uint16_t>(data, static_cast<uint16_t>(len));
+                    std::memcpy(data + 2, note, len);
+                    break;
+                }
+            }
+        }
+    }
+    return messages;
+}
+
+struct Dataset {
+    RowPlan plan;
+    std::vector<unsigned char> messages;
+    size_t rows = 0;
+
+    Dataset(const std::vector<ColumnSpec>& specs, size_t row_count)
+        : plan(makePlan(specs)), messages(makeMessages(plan, specs, row_count)), rows(row_count) {}
+
+    const unsigned char* message(size_t row) const { return messages.data() + row * plan.getMessageLength(); }
+};
+
+// Один проход по всем строкам; возвращает байты результата (для MB/s и чтобы проход не выбросил оптимизатор)
+using Pass = std::function<size_t()>;
+
+struct Benchmark {
+    std::string name;
+    size_t rows;
+    Pass pass;
+};
+
+crow::json::wvalue measure(const Benchmark& bench, const MicroOptions& options) {
+    // прогрев: кэши, thread_local блок арены, ленивая инициализация IUtil
+    size_t bytes = bench.pass();
+
+    std::vector<double> ns_per_row;
+    uint64_t allocations = 0;
+    uint64_t passes_total = 0;
+
+    for (size_t rep = 0; rep < options.repetitions; rep++) {
+        uint64_t passes = 0;
+        uint64_t allocs_before = AllocStats::allocations();
+        auto start = Clock::now();
+        auto elapsed = Clock::duration::zero();
+        do {
+            bytes = bench.pass();
+            passes++;
+            elapsed = Clock::now() - start;
+        } while (elapsed < options.min_time);
+
+        allocations += AllocStats::allocations() - allocs_before;
+        passes_total += passes;
+        ns_per_row.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+                             / static_cast<double>(passes * bench.rows));
+    }
+    std::sort(ns_per_row.begin(), ns_per_row.end());
+
+    const double median = percentile(ns_per_row, 0.5);
+
+    crow::json::wvalue result;
+    result["name"] = bench.name;
+    result["rows"] = static_cast<uint64_t>(bench.rows);
+    result["passes"] = passes_total;
+    result["ns_per_row_median"] = median;
+    result["ns_per_row_min"] = ns_per_row.front();
+    result["rows_per_sec"] = median > 0 ? 1e9 / median : 0.0;
+    result["output_bytes"] = static_cast<uint64_t>(bytes);
+    result["mb_per_sec"] = median > 0 ? static_cast<double>(bytes) / bench.rows / median * 1e9 / (1024 * 1024) : 0.0;
+    result["allocs_per_pass"] = static_cast<double>(allocations) / static_cast<double>(passes_total);
+    return result;
+}
+
+// Повторы x (одинаковое время соседних точек): LTTB обязан выбрать экстремум корзины.
+// Ряд (0,0) (5,1|5|3) (10,0) в 3 точки - средняя должна быть y=5 (и y=-5 для отраженного ряда)
+void checkDownsampleTies() {
+    const std::vector<ColumnSpec> specs = {
+        {"X", SQL_DOUBLE, 8, 0, false},
+        {"Y", SQL_DOUBLE, 8, 0, false},
+    };
+    const RowPlan plan = makePlan(specs);
+    const unsigned int length = plan.getMessageLength();
+
+    for (double sign : {1.0, -1.0}) {
+        const double xs[] = {0, 5, 5, 5, 10};
+        const double ys[] = {0, 1, 5, 3, 0};
+
+        std::vector<unsigned char> messages(length * std::size(xs), 0);
+        for (size_t row = 0; row < std::size(xs); row++) {
+            store(messages.data() + row * length + plan.getColumns()[0].offset, xs[row]);
+            store(messages.data() + row * length + plan.getColumns()[1].offset, sign * ys[row]);
+        }
+
+        DownsampleSpec spec;
+        spec.points = 3;
+        spec.x_column = "X";
+        spec.y_column = "Y";
+        spec.total_rows = std::size(xs);
+
+        std::vector<double> picked;
+        Downsampler downsampler(spec, [&](const RowPlan& row_plan, const unsigned char* message) {
+            picked.push_back(RowPlan::number(row_plan.getColumns()[1], message).value_or(NAN));
+        });
+        for (size_t row = 0; row < std::size(xs); row++) {
+            downsampler.add(plan, messages.data() + row * length);
+        }
+        downsampler.finish();
+
+        if (picked.size() != 3 || picked[1] != sign * 5) {
+            throw std::runtime_error("downsample/lttb: extreme point with a repeated x was dropped");
+        }
+    }
+}
+
+// DECFLOAT из текста - тем же IUtil клиента, которым значения потом печатаются
+template <typename T>
+T decFloat(const char* text) {
+    Firebird::IMaster* master = fb_get_master_interface();
+    Firebird::ThrowStatusWrapper status(master->getStatus());
+    T value{};
+    if constexpr (std::is_same_v<T, FB_DEC16>) {
+        master->getUtilInterface()->getDecFloat16(&status)->fromString(&status, text, &value);
+    } else {
+        master->getUtilInterface()->getDecFloat34(&status)->fromString(&status, text, &value);
+    }
+    status.dispose();
+    return value;
+}
+
+// JSON из снимка (ColumnarWriter -> ColumnarReader::appendJson) обязан совпадать с живым
+// ответом JsonWriter байт в байт: иначе у одного URL два тела и два ETag
+void checkColumnarJson(const RowPlan& plan, const unsigned char* messages, size_t rows, const char* what) {
+    JsonWriter json(true);
+    ColumnarWriter columnar;
+    for (size_t row = 0; row < rows; row++) {
+        json.writeRow(plan, messages + row * plan.getMessageLength());
+        columnar.writeRow(plan, messages + row * plan.getMessageLength());
+    }
+    const std::string expected = json.finish();
+    const std::string body = columnar.finish();
+
+    ColumnarReader reader;
+    std::string error;
+    if (!reader.open(reinterpret_cast<const uint8_t*>(body.data()), body.size(), error)) {
+        throw std::runtime_error(std::string("columnar/") + what + ": " + error);
+    }
+
+    std::string actual = "[";
+    for (uint64_t row = 0; row < reader.rowCount(); row++) {
+        if (row > 0) actual.push_back(',');
+        reader.appendJson(actual, row);
+    }
+    actual.push_back(']');
+
+    if (actual != expected) {
+        throw std::runtime_error(std::string("columnar/") + what + ": snapshot JSON differs from JsonWriter");
+    }
+}
+
+// FLOAT (0.1 не должен стать 0.10000000149011612) и DECFLOAT (число, а не строка)
+void checkColumnarJsonTypes() {
+    const std::vector<ColumnSpec> specs = {
+        {"FLOAT", SQL_FLOAT, 4, 0, true},
+        {"DECFLOAT_16", SQL_DEC16, 8, 0, true},
+        {"DECFLOAT_34", SQL_DEC34, 16, 0, true},
+        {"NOTE", SQL_VARYING, 2 + 8, 0, true},
+    };
+    const RowPlan plan = makePlan(specs);
+    const unsigned int length = plan.getMessageLength();
+    const std::vector<FbColumn>& columns = plan.getColumns();
+
+    std::vector<unsigned char> messages(length * 2, 0);
+    unsigned char* row = messages.data();
+    store(row + columns[0].offset, 0.1f);
+    store(row + columns[1].offset, decFloat<FB_DEC16>("1.5"));
+    store(row + columns[2].offset, decFloat<FB_DEC34>("-12345678901234567890.125"));
+    store<uint16_t>(row + columns[3].offset, 3);
+    std::memcpy(row + columns[3].offset + 2, "1.5", 3);
+
+    // вторая строка - NULL во всех колонках
+    for (const FbColumn& col : columns) store<short>(messages.data() + length + col.null_offset, -1);
+
+    checkColumnarJson(plan, messages.data(), 2, "types");
+}
+
+} // namespace
+
+void runMicro(const MicroOptions& options, crow::json::wvalue& report) {
+    const Dataset points(POINT_COLUMNS, options.rows);
+    const Dataset types(TYPE_COLUMNS, options.rows);
+
+    // замеры неверного результата ничего не стоят
+    checkDownsampleTies();
+    checkColumnarJsonTypes();
+
+    checkColumnarJson(points.plan, points.messages.data(), points.rows, "points");
+    checkColumnarJson(types.plan, types.messages.data(), types.rows, "types");
+
+    std::vector<Benchmark> benchmarks;
+
+    // числовые значения для графиков (Downsampler, PointFeed) и строки без JSON
+    benchmarks.push_back({"decode/points", points.rows, [&]() {
+        double sum = 0;
+        size_t text = 0;
+        for (size_t row = 0; row < points.rows; row++) {
+            const unsigned char* message = points.message(row);
+            for (const FbColumn& col : points.plan.getColumns()) {
+                if (col.type == SQL_VARYING || col.type == SQL_TEXT) {
+                    text += RowPlan::text(col, message).size();
+                } else if (std::optional<double> value = RowPlan::number(col, message)) {
+                    sum += *value;
+                }
+            }
+        }
+        return text + (std::isnan(sum) ? 1 : 0);
+    }});
+
+    // основной путь ответов: queryRows -> JsonWriter с ареной запроса
+    benchmarks.push_back({"json/points", points.rows, [&]() {
+        RequestArena arena;
+        JsonWriter writer(true, 4096, &arena);
+        for (size_t row = 0; row < points.rows; row++) {
+            writer.writeRow(points.plan, points.message(row));
+        }
+        return writer.finish().size();
+    }});
+
+    for (size_t i = 0; i < TYPE_COLUMNS.size(); i++) {
+        // план из одной колонки поверх тех же сообщений
+        auto plan = std::make_shared<RowPlan>(std::vector<FbColumn>{types.plan.getColumns()[i]},
+                                              types.plan.getMessageLength());
+        benchmarks.push_back({std::string("json/") + TYPE_COLUMNS[i].name, types.rows, [&types, plan]() {
+            RequestArena arena;
+            JsonWriter writer(true, 4096, &arena);
+            for (size_t row = 0; row < types.rows; row++) {
+                writer.writeRow(*plan, types.message(row));
+            }
+            return writer.finish().size();
+        }});
+    }
+
+    // прежний путь getSQL: crow::json::wvalue на строку
+    benchmarks.push_back({"wvalue/points", points.rows, [&]() {
+        std::vector<crow::json::wvalue> rows;
+        for (size_t row = 0; row < points.rows; row++) {
+            rows.push_back(points.plan.toJson(points.message(row)));
+        }
+        return crow::json::wvalue(std::move(rows)).dump().size();
+    }});
+
+    benchmarks.push_back({"columnar/points", points.rows, [&]() {
+        RequestArena arena;
+        ColumnarWriter writer(&arena);
+        for (size_t row = 0; row < points.rows; row++) {
+            writer.writeRow(points.plan, points.message(row));
+        }
+        return writer.finish().size();
+    }});
+
+    for (DownsampleMethod method : {DownsampleMethod::Lttb, DownsampleMethod::MinMax}) {
+        const char* name = method == DownsampleMethod::Lttb ? "downsample/lttb" : "downsample/minmax";
+        benchmarks.push_back({name, points.rows, [&, method]() {
+            RequestArena arena;
+            JsonWriter writer(true, 4096, &arena);
+
+            DownsampleSpec spec;
+            spec.method = method;
+            spec.points = 1000;
+            spec.x_column = "POINT_ID";
+            spec.y_column = "PRESSURE";
+            spec.total_rows = points.rows;
+
+            Downsampler downsampler(spec, [&](const RowPlan& plan, const unsigned char* message) {
+                writer.writeRow(plan, message);
+            }, &arena);
+            for (size_t row = 0; row < points.rows; row++) {
+                downsampler.add(points.plan, points.message(row));
+            }
+            downsampler.finish();
+            return writer.finish().size();
+        }});
+    }
+
+    std::vector<crow::json::wvalue> results;
+    for (const Benchmark& bench : benchmarks) {
+        if (!options.filter.empty() && bench.name.find(options.filter) == std::string::npos) continue;
+
+        std::cerr << "micro: " << bench.name << std::endl;
+        results.push_back(measure(bench, options));
+    }
+
+    report["allocations_counted"] = AllocStats::counting();
+    report["peak_rss_bytes"] = AllocStats::peakRssBytes();
+    report["results"] = std::move(results);
+}
@@ -0,0 +1,123 @@
+/*
+ * Воспроизводимая база для uda_bench load: таблицы маршрутов и объемы, близкие к боевым.
+ * Значения детерминированы (без RAND) - две сборки сравниваются на одинаковых данных.
+ *
+ *   isql -q -i bench/seed.sql                      (создает /tmp/uda_bench.fdb)
+ *   UDA_DB_PATH=/tmp/uda_bench.fdb UDA_DB_HOST= UDA_DB_USER=SYSDBA ./uda      (embedded)
+ *   ./uda_bench load --concurrency 1,16,64 --label "$(git rev-parse --short HEAD)" --out load.json
+ *
+ * Для локального сервера вместо embedded: UDA_DB_HOST=localhost и путь к базе на сервере.
+ * Объемы по умолчанию: 50 устройств x 40 сессий x 2000 точек = 4 млн строк RD2_POINTS;
+ * меняются константами в EXECUTE BLOCK ниже.
+ */
+
+SET SQL DIALECT 3;
+CREATE DATABASE '/tmp/uda_bench.fdb' USER 'SYSDBA' PAGE_SIZE 16384 DEFAULT CHARACTER SET UTF8;
+
+CREATE TABLE DEVICES (
+    DEVICE_ID   INTEGER NOT NULL PRIMARY KEY,
+    NAME        VARCHAR(64) NOT NULL,
+    SERIAL_NO   CHAR(16),
+    INSTALLED   DATE,
+    ACTIVE      BOOLEAN DEFAULT TRUE
+);
+
+CREATE TABLE PASSP_SCAN (
+    DEVICE_ID   INTEGER NOT NULL PRIMARY KEY,
+    SCANNED_AT  TIMESTAMP,
+    CHANNELS    SMALLINT,
+    SAMPLE_RATE NUMERIC(9,3),
+    FIRMWARE    VARCHAR(32),
+    PARAMS      VARCHAR(1024)
+);
+
+CREATE TABLE RD2_SESSIONS (
+    SESSION_ID  BIGINT NOT NULL PRIMARY KEY,
+    DEVICE_ID   INTEGER NOT NULL,
+    START_TIME  TIMESTAMP NOT NULL,
+    END_TIME    TIMESTAMP,
+    OPERATOR    VARCHAR(32),
+    NOTE        VARCHAR(256)
+);
+
+CREATE INDEX RD2_SESSIONS_DEVICE ON RD2_SESSIONS (DEVICE_ID, SESSION_ID);
+
+CREATE TABLE RD2_POINTS (
+    POINT_ID    BIGINT NOT NULL PRIMARY KEY,
+    SESSION_ID  BIGINT NOT NULL,
+    TS          TIMESTAMP NOT NULL,
+    DEPTH       NUMERIC(9,2),
+    PRESSURE    DOUBLE PRECISION,
+    TEMPERATURE NUMERIC(4,1),
+    FLOW        DOUBLE PRECISION,
+    STATUS      SMALLINT,
+    NOTE        VARCHAR(32)
+);
+
+CREATE INDEX RD2_POINTS_SESSION ON RD2_POINTS (SESSION_ID, POINT_ID);
+
+COMMIT;
+
+SET TERM ^ ;
+
+EXECUTE BLOCK
+AS
+    DECLARE DEVICES_COUNT INTEGER = 50;
+    DECLARE SESSIONS_PER_DEVICE INTEGER = 40;
+    DECLARE POINTS_PER_SESSION INTEGER = 2000;
+
+    DECLARE D INTEGER;
+    DECLARE S INTEGER;
+    DECLARE P INTEGER;
+    DECLARE SESSION_ID BIGINT = 0;
+    DECLARE POINT_ID BIGINT = 0;
+    DECLARE STARTED TIMESTAMP;
+BEGIN
+    D = 1;
+    WHILE (D <= DEVICES_COUNT) DO
+    BEGIN
+        INSERT INTO DEVICES (DEVICE_ID, NAME, SERIAL_NO, INSTALLED, ACTIVE)
+        VALUES (:D, 'Device ' || :D, 'SN-' || LPAD(:D, 8, '0'),
+                DATEADD(-:D DAY TO DATE '2024-01-01'), MOD(:D, 10) <> 0);
+
+        INSERT INTO PASSP_SCAN (DEVICE_ID, SCANNED_AT, CHANNELS, SAMPLE_RATE, FIRMWARE, PARAMS)
+        VALUES (:D, TIMESTAMP '2024-01-01 00:00:00', 8, 1000.5, 'fw-2.' || MOD(:D, 7),
+                '{"gain":' || MOD(:D, 5) || ',"offset":0.125,"filter":"lowpass"}');
+
+        S = 1;
+        WHILE (S <= SESSIONS_PER_DEVICE) DO
+        BEGIN
+            SESSION_ID = SESSION_ID + 1;
+            STARTED = DATEADD(SESSION_ID * 3 HOUR TO TIMESTAMP '2024-01-01 00:00:00');
+
+            /* последняя сессия устройства не закрыта - живые точки и путь без снимка */
+            INSERT INTO RD2_SESSIONS (SESSION_ID, DEVICE_ID, START_TIME, END_TIME, OPERATOR, NOTE)
+            VALUES (:SESSION_ID, :D, :STARTED,
+                    IIF(:S < :SESSIONS_PER_DEVICE, DATEADD(:POINTS_PER_SESSION SECOND TO :STARTED), NULL),
+                    'operator' || MOD(:SESSION_ID, 12), IIF(MOD(:SESSION_ID, 4) = 0, 'routine check', NULL));
+
+            P = 1;
+            WHILE (P <= POINTS_PER_SESSION) DO
+            BEGIN
+                POINT_ID = POINT_ID + 1;
+                INSERT INTO RD2_POINTS (POINT_ID, SESSION_ID, TS, DEPTH, PRESSURE, TEMPERATURE, FLOW, STATUS, NOTE)
+                VALUES (:POINT_ID, :SESSION_ID, DATEADD(:P SECOND TO :STARTED),
+                        :P * 0.25,
+                        101.325 + SIN(:P / 50.0) * 5 + MOD(:POINT_ID * 7919, 101) / 100.0,
+                        IIF(MOD(:P, 8) = 7, NULL, 20 + MOD(:P, 150) / 10.0),
+                        IIF(MOD(:P, 8) = 7, NULL, COS(:P / 80.0) * 3),
+                        MOD(:P, 5),
+                        IIF(MOD(:P, 500) = 0, 'pressure spike', NULL));
+                P = P + 1;
+            END
+
+            S = S + 1;
+        END
+
+        D = D + 1;
+    END
+END^
+
+SET TERM ; ^
+
+COMMIT;
@@ -0,0 +1,114 @@
+#include "bench.h"
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+static const char* USAGE =
+    "usage:\n"
+    "  uda_bench micro [--rows N] [--min-time-ms N] [--repetitions N] [--filter S] [--label L] [--out FILE]\n"
+    "      row decoding and JSON/columnar serialization over synthetic Firebird messages\n"
+    "  uda_bench load [--host H] [--port P] [--concurrency 1,16,64] [--warmup S] [--duration S]\n"
+    "                 [--routes boards,board,param,sessions,session,points_page,points_full,points_columnar,points_lttb]\n"
+    "                 [--label L] [--out FILE]\n"
+    "      load against a running uda on a database seeded with bench/seed.sql;\n"
+    "      allocations per request need uda built with -DUDA_COUNT_ALLOCATIONS=ON\n";
+
+static std::vector<std::string> splitList(const std::string& value) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) end = value.size();
+        if (end > start) items.push_back(value.substr(start, end - start));
+        start = end + 1;
+    }
+    return items;
+}
+
+static std::string utcNow() {
+    std::time_t now = std::time(nullptr);
+    std::tm tm{};
+#ifdef _WIN32
+    gmtime_s(&tm, &now);
+#else
+    gmtime_r(&now, &tm);
+#endif
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return text;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << USAGE;
+        return 2;
+    }
+
+    const std::string suite = argv[1];
+    MicroOptions micro;
+    LoadOptions load;
+    std::string label;
+    std::string out;
+
+    try {
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+            std::string value = argv[++i];
+
+            if (arg == "--label") label = value;
+            else if (arg == "--out") out = value;
+            else if (arg == "--rows") micro.rows = std::stoull(value);
+            else if (arg == "--min-time-ms") micro.min_time = std::chrono::milliseconds(std::stoll(value));
+            else if (arg == "--repetitions") micro.repetitions = std::max<size_t>(std::stoull(value), 1);
+            else if (arg == "--filter") micro.filter = value;
+            else if (arg == "--host") load.host = value;
+            else if (arg == "--port") load.port = value;
+            else if (arg == "--warmup") load.warmup = std::chrono::seconds(std::stoll(value));
+            else if (arg == "--duration") load.duration = std::chrono::seconds(std::stoll(value));
+            else if (arg == "--routes") load.routes = splitList(value);
+            else if (arg == "--concurrency") {
+                load.concurrency.clear();
+                for (const std::string& item : splitList(value)) {
+                    load.concurrency.push_back(std::max<size_t>(std::stoull(item), 1));
+                }
+            } else {
+                throw std::invalid_argument("Unknown option " + arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n" << USAGE;
+        return 2;
+    }
+
+    crow::json::wvalue report;
+    report["suite"] = suite;
+    report["label"] = label;
+    report["started_at"] = utcNow();
+    report["hardware_concurrency"] = static_cast<uint64_t>(std::thread::hardware_concurrency());
+
+    try {
+        if (suite == "micro") {
+            runMicro(micro, report);
+        } else if (suite == "load") {
+            runLoad(load, report);
+        } else {
+            std::cerr << USAGE;
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "uda_bench " << suite << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::string json = report.dump();
+    if (out.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream(out) << json << std::endl;
+    }
+    return 0;
+}
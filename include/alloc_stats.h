@@ -0,0 +1,22 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <cstdint>
+
+// Память процесса для uda_bench: число выделений из кучи и пиковый RSS.
+// Выделения считаются, только если в бинарник слинкован src/alloc_hooks.cpp
+// (uda_bench всегда, uda - с -DUDA_COUNT_ALLOCATIONS=ON); иначе counting() == false.
+class AllocStats {
+public:
+  // вызывается из operator new - без блокировок и без выделений
+  static void record();
+  static void enableCounting();
+
+  static bool counting();
+  static uint64_t allocations();
+
+  // пиковый resident set процесса, 0 - платформа не сообщает
+  static uint64_t peakRssBytes();
+};
+
+#endif // ALLOC_STATS_H
@@ -0,0 +1,99 @@
+#ifndef API_RESPONSE_H
+#define API_RESPONSE_H
+
+#include <columnar_writer.h>
+#include <compression.h>
+#include <db_executor.h>
+#include <downsampler.h>
+#include <fb_router.h>
+#include <json_writer.h>
+#include <metrics.h>
+#include <query_deadline.h>
+#include <response_cache.h>
+#include <result_spool.h>
+#include <single_flight.h>
+#include <snapshot_store.h>
+
+#include <crow.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+// порция, после которой тело ответа уходит из памяти в spool-файл
+constexpr size_t SPOOL_CHUNK = 256 * 1024;
+
+struct QueryOptions {
+  bool array = true;              // false - ответом будет первая строка как объект (маршруты по ID)
+  ResultSpool* spool = nullptr;   // большие выборки - через файл на диске
+  std::string cursor_column;      // ключ последней строки уходит в X-Next-Cursor...
+  size_t page_limit = 0;          // ...если страница заполнена целиком
+  bool columnar = false;          // бинарный колоночный формат вместо JSON
+  std::optional<DownsampleSpec> downsample;  // в ответ идут только выбранные строки
+  ContentEncoding encoding = ContentEncoding::Identity;  // кодировка, которую принимает клиент
+  CompressionConfig compression;                          // уровни и порог сжатия
+  // тело в памяти пойдет в ResponseCache и остается несжатым (кэш сжимает сам);
+  // encoding применяется только к spool-файлу, который не кэшируется
+  bool cacheable = false;
+};
+
+// Готовый результат запроса; неизменяемый, поэтому его можно отдать нескольким ответам
+struct QueryResult {
+  int code = 200;
+  std::string body;
+  std::string content_type;
+  std::string static_file;  // тело лежит в spool-файле
+  std::string next_cursor;
+  ContentEncoding encoding = ContentEncoding::Identity;  // Content-Encoding тела
+};
+
+using SharedResult = std::shared_ptr<const QueryResult>;
+using QueryFlight = SingleFlight<SharedResult>;
+
+// клиент просит бинарный колоночный формат через Accept
+bool acceptsColumnar(const crow::request& req);
+
+// лучшая кодировка из Accept-Encoding, которую умеет эта сборка
+ContentEncoding acceptedEncoding(const crow::request& req);
+
+// Выполняет запрос и пишет строки сразу в JSON-текст (или колоночный формат)
+QueryResult queryRows(PooledConnection& fbc, const std::string& query,
+                      const SqlParams& params, const QueryOptions& opts);
+
+// То же, но одинаковые одновременные запросы выполняются один раз (подключение берется из пула)
+SharedResult querySharedRows(QueryFlight& flight, FirebirdRouter& pool, const std::string& query,
+                             const SqlParams& params, const QueryOptions& opts);
+
+// Ответ из нескольких запросов (COUNT(*) и данные): produce выполняет их на одном подключении.
+// query/params/opts здесь - только ключ схлопывания одинаковых запросов
+SharedResult querySharedRows(QueryFlight& flight, FirebirdRouter& pool, const std::string& query,
+                             const SqlParams& params, const QueryOptions& opts,
+                             const std::function<QueryResult(PooledConnection&)>& produce);
+
+// Ответ из снимка закрытой сессии без обращения к БД: колоночный формат отдается
+// файлом снимка как есть, JSON собирается прямо из отображенных колонок
+QueryResult snapshotRows(const Snapshot& snapshot, const QueryOptions& opts);
+
+// Заполняет ответ на месте: в асинхронном обработчике res принадлежит соединению Crow
+void toResponse(crow::response& res, const QueryResult& result);
+
+// Ответ из кэша, а при промахе - produce() и сохранение в кэш.
+// If-None-Match с актуальным ETag получает 304 без обращения к БД.
+// produce() должен вернуть несжатое тело: кэш сжимает его сам, один раз на кодировку
+// (сжатый результат отдается, но не кэшируется)
+void cachedResponse(crow::response& res, ResponseCache& cache, const crow::request& req,
+                    const std::string& key, std::chrono::milliseconds ttl,
+                    const std::function<SharedResult()>& produce);
+
+// Выполняет handler на DB executor'е и завершает ответ через res.end().
+// Очередь приоритета переполнена - сразу 503 с Retry-After, поток Crow не блокируется.
+// req и res живут до res.end(), поэтому handler может держать на них ссылки.
+// Запрос со всеми этапами попадает в метрики маршрута route.
+// timeouts ограничивают запросы к БД внутри handler; истек срок или клиент ушел - запрос
+// прерывается, handler получает QueryCancelled (маршруты отвечают 504)
+void respondAsync(DbExecutor& executor, MetricsRoute route, DbPriority priority, RouteTimeouts timeouts,
+                  crow::response& res, std::function<void(crow::response&)> handler);
+
+#endif // API_RESPONSE_H
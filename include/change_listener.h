@@ -0,0 +1,114 @@
+#ifndef CHANGE_LISTENER_H
+#define CHANGE_LISTENER_H
+
+#include <fb_connect.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Строка журнала изменений (sql/uda_events.sql): что изменилось и чей это ключ
+struct ChangeEvent {
+  std::string table;                 // таблица-источник (DEVICES, RD2_SESSIONS, ...)
+  int64_t row_id = 0;                // ключ измененной строки
+  std::optional<int64_t> parent_id;  // владелец строки, если маршруты выбирают по нему (DEVICE_ID сессии)
+};
+
+struct ChangeListenerConfig {
+  std::string changes_table = "UDA_CHANGES";
+  std::string change_event = "UDA_CHANGED";  // POST_EVENT триггеров журнала
+  std::string schema_event = "UDA_SCHEMA";   // POST_EVENT DDL-триггера
+  // журнал читается и без событий - страховка от потерянного уведомления
+  std::chrono::seconds poll_interval{30};
+  std::chrono::seconds reconnect_delay{5};
+  // последний прочитанный CHANGE_ID между запусками: изменения за время простоя
+  // дочитываются при старте. Пусто - не сохраняется, журнал до старта пропускается
+  std::filesystem::path position_file;
+};
+
+// Слушает события Firebird (POST_EVENT) на отдельном attachment'е и точечно сообщает
+// об изменениях. Событие только будит слушателя: какие строки изменились, берется из
+// журнала UDA_CHANGES (CHANGE_ID > последнего прочитанного), который пишут те же триггеры.
+// Поэтому после переподключения пропущенные изменения не теряются.
+class ChangeListener {
+private:
+  // callback Firebird: вызывается потоком клиента, только копирует счетчики и будит слушателя
+  class Callback : public Firebird::IEventCallbackImpl<Callback, Firebird::ThrowStatusWrapper> {
+  private:
+    ChangeListener& listener;
+
+  public:
+    explicit Callback(ChangeListener& listener) : listener(listener) {}
+
+    // время жизни - как у слушателя, счетчик ссылок не нужен
+    void addRef() override {}
+    int release() override { return 1; }
+    void eventCallbackFunction(unsigned int length, const ISC_UCHAR* events) override;
+  };
+
+  ChangeListenerConfig config;
+  FirebirdConnection conn;
+  std::function<void(const ChangeEvent&)> onChange;
+  std::function<void()> onReset;
+
+  Callback callback;
+
+  std::mutex listenerMutex;
+  std::condition_variable wakeUp;
+  std::vector<unsigned char> delivered;  // EPB с новыми счетчиками от последнего callback'а
+  bool fired = false;
+  bool stopping = false;
+
+  std::atomic<bool> subscribed{false};
+  std::atomic<bool> caughtUp{false};
+
+  // CHANGE_ID выдается при вставке, а видна строка после commit, поэтому поздно
+  // зафиксированная транзакция может показать меньший ID, чем уже прочитанный.
+  // Журнал перечитывается с запасом CHANGE_LOOKBACK, повторы отсеиваются по recentChanges
+  static constexpr int64_t CHANGE_LOOKBACK = 1024;
+  std::optional<int64_t> lastChange;  // наибольший прочитанный CHANGE_ID
+  std::set<int64_t> recentChanges;
+
+  std::thread thread;
+
+  void run();
+  void listen();
+  // новые строки журнала; notify = false - только запомнить прочитанное
+  void readChanges(bool notify = true);
+  // первое чтение журнала после запуска: с сохраненной позиции или с его конца
+  void startChanges();
+
+  std::optional<int64_t> loadPosition() const;
+  void savePosition() const;
+
+  std::vector<unsigned char> eventBlock() const;
+  static std::vector<uint32_t> eventCounts(const std::vector<unsigned char>& epb);
+
+public:
+  // on_change - на каждую строку журнала, on_reset - после DDL или когда часть журнала
+  // потеряна (кэши и снимки надо сбросить целиком).
+  // Обработчики вызываются из потока слушателя
+  ChangeListener(FBConnectionStruct conf, ChangeListenerConfig listener_conf,
+                 std::function<void(const ChangeEvent&)> on_change,
+                 std::function<void()> on_reset);
+  ~ChangeListener();
+
+  ChangeListener(const ChangeListener&) = delete;
+  ChangeListener& operator=(const ChangeListener&) = delete;
+
+  // события приходят - кэши можно держать без короткого TTL
+  bool active() const { return subscribed; }
+  // журнал после запуска прочитан: изменения за время простоя уже разосланы
+  bool synced() const { return caughtUp; }
+};
+
+#endif // CHANGE_LISTENER_H
@@ -0,0 +1,43 @@
+#ifndef COLUMNAR_READER_H
+#define COLUMNAR_READER_H
+
+#include <columnar_writer.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Разбирает тело колоночного формата (см. columnar_writer.h) прямо в чужом буфере,
+// без копирования: колонки - это указатели внутрь буфера (например, mmap снимка)
+class ColumnarReader {
+public:
+  struct Column {
+    std::string name;
+    ColumnType type = ColumnType::Null;
+    int8_t scale = 0;
+    const uint8_t* validity = nullptr;
+    const uint8_t* data = nullptr;   // значения; для UTF8 - байты строк
+    const uint8_t* offsets = nullptr;  // только UTF8: rows + 1 смещений u32
+    std::string prefix;              // {"NAME": / ,"NAME": для JSON
+  };
+
+private:
+  std::vector<Column> columns;
+  uint64_t rows = 0;
+
+public:
+  // false и текст ошибки - буфер не является корректным телом формата (все границы проверяются)
+  bool open(const uint8_t* data, size_t size, std::string& error);
+
+  uint64_t rowCount() const { return rows; }
+  const std::vector<Column>& getColumns() const { return columns; }
+
+  static bool isValid(const Column& column, uint64_t row) {
+    return (column.validity[row >> 3] >> (row & 7)) & 1;
+  }
+
+  // строка как JSON-объект - в том же виде, что пишет JsonWriter
+  void appendJson(std::string& out, uint64_t row) const;
+};
+
+#endif // COLUMNAR_READER_H
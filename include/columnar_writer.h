@@ -0,0 +1,136 @@
+#ifndef COLUMNAR_WRITER_H
+#define COLUMNAR_WRITER_H
+
+#include <fb_row.h>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Content-Type бинарного колоночного формата
+constexpr const char* COLUMNAR_CONTENT_TYPE = "application/vnd.uda.columnar";
+
+// Колоночный формат ответа (все числа little-endian):
+//
+//   magic    4 байта "UDAC"
+//   version  u16 = 1
+//   columns  u16
+//   rows     u64
+//   далее для каждой колонки:
+//     name_len u16, name (UTF-8)
+//     type     u8 (ColumnType)
+//     scale    i8 - десятичный порядок для DECIMAL64/DECIMAL128 (значение * 10^scale);
+//                   у FLOAT64 и UTF8 - исходный тип (COLUMNAR_SOURCE_*), иначе 0
+//     validity ceil(rows / 8) байт, бит i (младший бит первым) = 1 - значение есть, 0 - NULL
+//     data_len u64, затем data:
+//       INT32/INT64/FLOAT64/TIMESTAMP/DECIMAL64/DATE32/TIME64/DECIMAL128 - rows значений фиксированной ширины
+//       BOOL  - rows байт 0/1
+//       UTF8  - (rows + 1) смещений u32, затем байты строк (DECFLOAT - точной десятичной записью)
+//       NULL  - пусто (тип колонки не поддерживается, все значения NULL)
+//
+// Для NULL значений место в data все равно занято (нули), так что i-е значение
+// фиксированной ширины лежит по смещению i * width.
+enum class ColumnType : uint8_t {
+  Null = 0,
+  Int32 = 1,
+  Int64 = 2,
+  Float64 = 3,
+  Timestamp = 4,    // int64, микросекунды от 1970-01-01 00:00:00
+  Bool = 5,
+  Utf8 = 6,
+  Decimal64 = 7,    // int64 с scale
+  Date32 = 8,       // int32, дни от 1970-01-01
+  Time64 = 9,       // int64, микросекунды от полуночи
+  Decimal128 = 10,  // int128 (16 байт, дополнительный код) с scale
+};
+
+// FLOAT64, scale: значение пришло из FLOAT (4 байта) и в JSON печатается кратчайшей записью
+// float, как у JsonWriter (0.1, а не 0.10000000149011612)
+constexpr int8_t COLUMNAR_SOURCE_FLOAT32 = 1;
+// UTF8, scale: точная десятичная запись DECFLOAT - в JSON числом без кавычек, как у JsonWriter
+constexpr int8_t COLUMNAR_SOURCE_DECFLOAT = 1;
+
+// Складывает значения из буфера сообщения Firebird в типизированные буферы колонок.
+// Колонки идут в теле одна за другой, поэтому до последней строки ничего отдать нельзя.
+// Со setSpill() заполненные буферы колонок сбрасываются во временный файл, а finish(sink)
+// собирает тело порциями из файла - память не растет вместе с числом строк
+class ColumnarWriter {
+private:
+  // кусок буфера колонки во временном файле
+  struct Segment {
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  struct Spilled {
+    std::vector<Segment> segments;
+    uint64_t bytes = 0;
+  };
+
+  struct Column {
+    ColumnType type = ColumnType::Null;
+    int8_t scale = 0;
+    std::pmr::vector<uint8_t> validity;
+    std::pmr::vector<uint8_t> data;
+    std::pmr::vector<uint32_t> offsets;  // только UTF8; от начала всех данных колонки
+
+    Spilled spilledValidity;
+    Spilled spilledData;
+    Spilled spilledOffsets;
+
+    explicit Column(std::pmr::memory_resource* resource)
+        : validity(resource), data(resource), offsets(resource) {}
+  };
+
+  struct FileCloser {
+    void operator()(std::FILE* file) const { std::fclose(file); }
+  };
+
+  std::pmr::memory_resource* resource;
+  const RowPlan* plan = nullptr;
+  std::vector<Column> columns;
+  uint64_t rows = 0;
+
+  size_t spillThreshold = 0;  // 0 - все в памяти
+  std::unique_ptr<std::FILE, FileCloser> spillFile;
+  uint64_t spillSize = 0;
+
+  void preparePlan(const RowPlan& row_plan);
+  size_t buffered() const;
+  void spill();
+  void spillBuffer(Spilled& spilled, const void* data, size_t size);
+
+  using Emit = std::function<void(const char* data, size_t size)>;
+  void writeBody(const Emit& emit);
+  void emitSpilled(const Spilled& spilled, const Emit& emit);
+
+public:
+  // буферы колонок берутся из resource (арена запроса)
+  explicit ColumnarWriter(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+      : resource(resource) {}
+
+  ColumnarWriter(const ColumnarWriter&) = delete;
+  ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+  // буферы колонок больше threshold байт уходят во временный файл (анонимный, удаляется при закрытии)
+  void setSpill(size_t threshold) { spillThreshold = threshold; }
+
+  void writeRow(const RowPlan& row_plan, const unsigned char* message);
+
+  uint64_t rowCount() const { return rows; }
+  // часть колонок уже во временном файле - тело лучше собирать через finish(sink)
+  bool spilled() const { return spillSize > 0; }
+
+  // собирает тело ответа в памяти
+  std::string finish();
+
+  // отдает тело в sink порциями не больше chunk_size (последняя может быть меньше)
+  void finish(const std::function<void(const std::string& chunk)>& sink, size_t chunk_size);
+
+  static ColumnType columnType(const FbColumn& col);
+};
+
+#endif // COLUMNAR_WRITER_H
@@ -0,0 +1,52 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Content-Encoding ответа; zstd и brotli есть, только если сборка с UDA_WITH_ZSTD / UDA_WITH_BROTLI
+enum class ContentEncoding : uint8_t {
+  Identity = 0,
+  Gzip,
+  Zstd,
+  Brotli
+};
+
+constexpr size_t CONTENT_ENCODING_COUNT = 4;
+
+struct CompressionConfig {
+  // меньшие тела уходят как есть: выигрыш меньше заголовков и затрат на кодер
+  size_t min_size = 1024;
+  int gzip_level = 6;    // 1..9
+  int zstd_level = 3;    // 1..19
+  int brotli_level = 5;  // 0..11; выше 9 слишком медленно для ответов на лету
+};
+
+// Лучшая из собранных кодировок, которую принимает клиент (q-значения учитываются).
+// При равном q: zstd, br, gzip - на JSON точек они дают близкий размер, zstd быстрее всех
+ContentEncoding negotiateEncoding(std::string_view accept_encoding);
+
+// значение Content-Encoding; "" для Identity
+const char* encodingName(ContentEncoding encoding);
+
+// Потоковый кодер: тело подается порциями по мере генерации, сжатые данные дописываются в out
+class Compressor {
+public:
+  virtual ~Compressor() = default;
+
+  // out может остаться пустым - кодер копит окно
+  virtual void write(std::string_view chunk, std::string& out) = 0;
+  // завершает поток, после этого write() нельзя
+  virtual void finish(std::string& out) = 0;
+
+  // std::runtime_error, если кодировка не собрана или кодер не создался
+  static std::unique_ptr<Compressor> create(ContentEncoding encoding, const CompressionConfig& config);
+};
+
+// сжатие готового тела целиком
+std::string compressBody(ContentEncoding encoding, std::string_view body, const CompressionConfig& config);
+
+#endif // COMPRESSION_H
@@ -0,0 +1,67 @@
+#ifndef DB_EXECUTOR_H
+#define DB_EXECUTOR_H
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Приоритет задачи: дешевые запросы не должны стоять за выгрузкой сессий
+enum class DbPriority {
+  High = 0,
+  Normal = 1,
+  Low = 2,
+};
+
+constexpr size_t DB_PRIORITIES = 3;
+
+struct DbExecutorConfig {
+  size_t threads = 8;
+  // сколько задач может ждать в очереди каждого приоритета (High, Normal, Low)
+  std::array<size_t, DB_PRIORITIES> queue_limits = {256, 128, 32};
+};
+
+struct DbExecutorStats {
+  std::array<size_t, DB_PRIORITIES> queued = {};
+  size_t active = 0;
+  uint64_t completed = 0;
+  uint64_t rejected = 0;
+};
+
+// Отдельный пул потоков для блокирующих вызовов Firebird API,
+// чтобы они не занимали рабочие потоки Crow
+class DbExecutor {
+private:
+  DbExecutorConfig config;
+
+  mutable std::mutex queueMutex;
+  std::condition_variable wakeUp;
+  std::array<std::deque<std::function<void()>>, DB_PRIORITIES> queues;
+  bool stopping = false;
+
+  size_t active = 0;
+  uint64_t completed = 0;
+  uint64_t rejected = 0;
+
+  std::vector<std::thread> workers;
+
+  void worker();
+
+public:
+  explicit DbExecutor(DbExecutorConfig conf = {});
+  ~DbExecutor();
+
+  DbExecutor(const DbExecutor&) = delete;
+  DbExecutor& operator=(const DbExecutor&) = delete;
+
+  // false - очередь приоритета заполнена, задача не принята (перегрузка)
+  bool submit(DbPriority priority, std::function<void()> task);
+
+  DbExecutorStats stats() const;
+};
+
+#endif // DB_EXECUTOR_H
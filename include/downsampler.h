@@ -0,0 +1,127 @@
+#ifndef DOWNSAMPLER_H
+#define DOWNSAMPLER_H
+
+#include <fb_connect.h>
+#include <fb_row.h>
+
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class DownsampleMethod {
+  Lttb,    // Largest-Triangle-Three-Buckets: форма кривой
+  MinMax,  // min и max каждой корзины: пики не теряются
+};
+
+// ?downsample=N&method=lttb|minmax&x=&y=
+struct DownsampleSpec {
+  DownsampleMethod method = DownsampleMethod::Lttb;
+  size_t points = 0;        // сколько строк нужно на выходе
+  std::string x_column;     // должна расти вместе с ключом выборки (POINT_ID, время)
+  std::string y_column;
+  uint64_t total_rows = 0;  // COUNT(*) выборки: границы корзин известны до первой строки
+};
+
+constexpr size_t MAX_DOWNSAMPLE_POINTS = 10000;
+
+// nullptr в points - прореживание не запрошено. Кидает std::invalid_argument на некорректный ввод
+std::optional<DownsampleSpec> parseDownsample(const char* points, const char* method,
+                                              const char* x_column, const char* y_column);
+
+// min и max блока значений (без NaN) без ветвлений по независимым дорожкам -
+// цикл векторизуется компилятором; индексы - первые вхождения
+void minMaxBlock(const double* values, size_t count, size_t& min_index, size_t& max_index);
+
+// Прореживает поток строк fetch за один проход: выбранные строки целиком
+// (все колонки) уходят в emit в исходном порядке. MinMax держит блок строк и две лучшие
+// строки корзины - память не зависит от длины выборки. LTTB держит выпуклые оболочки
+// двух корзин (точка с максимальной площадью треугольника всегда лежит на оболочке):
+// на шумном ряду в них единицы вершин, но на выпуклом участке (монотонный рост давления)
+// в оболочку попадает вся корзина - до total_rows / points копий сообщений.
+// Строки с NULL/NaN в y пропускаются.
+class Downsampler {
+private:
+  struct Vertex {
+    double x = 0;
+    double y = 0;
+    size_t slot = 0;
+  };
+
+  // выпуклая оболочка корзины (монотонная цепочка Эндрю) + сумма для среднего
+  struct Hull {
+    std::pmr::vector<Vertex> lower;
+    std::pmr::vector<Vertex> upper;
+    double sumX = 0;
+    double sumY = 0;
+    size_t count = 0;
+
+    explicit Hull(std::pmr::memory_resource* resource) : lower(resource), upper(resource) {}
+  };
+
+  static constexpr size_t BLOCK = 256;
+
+  DownsampleSpec spec;
+  RowHandler emit;
+
+  const RowPlan* plan = nullptr;
+  int xIndex = -1;
+  int yIndex = -1;
+  unsigned int messageLength = 0;
+
+  uint64_t ordinal = 0;   // номер строки в выборке
+  size_t buckets = 0;
+  size_t bucket = 0;
+  bool passThrough = false;
+  double lastX = 0;
+
+  // копии сообщений с подсчетом ссылок: вершина может быть в обеих цепочках.
+  // Слот i - messageLength байт по смещению i * messageLength в slotData
+  std::pmr::vector<unsigned char> slotData;
+  std::pmr::vector<int> slotRefs;
+  std::pmr::vector<size_t> freeSlots;
+
+  // LTTB
+  double anchorX = 0;
+  double anchorY = 0;
+  Hull pending;  // ждет среднего следующей корзины
+  Hull current;
+
+  // MinMax
+  std::pmr::vector<double> blockValues;
+  std::pmr::vector<uint64_t> blockOrdinals;
+  std::pmr::vector<unsigned char> blockMessages;
+  std::pmr::vector<unsigned char> minMessage;
+  std::pmr::vector<unsigned char> maxMessage;
+  double minValue = 0;
+  double maxValue = 0;
+  uint64_t minOrdinal = 0;
+  uint64_t maxOrdinal = 0;
+  bool hasBucketValue = false;
+
+  void init(const RowPlan& row_plan);
+
+  size_t acquireSlot(const unsigned char* message);
+  void releaseSlot(size_t slot);
+  const unsigned char* slotMessage(size_t slot) const { return slotData.data() + slot * messageLength; }
+
+  void addLttb(double x, double y, const unsigned char* message);
+  void pushHull(Hull& hull, double x, double y, const unsigned char* message);
+  void selectFrom(Hull& hull, double next_x, double next_y);
+  void clearHull(Hull& hull);
+
+  void addMinMax(double y, const unsigned char* message);
+  void flushBlock();
+  void emitBucket();
+
+public:
+  // буферы берутся из resource (арена запроса)
+  Downsampler(DownsampleSpec spec, RowHandler emit,
+              std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+  void add(const RowPlan& row_plan, const unsigned char* message);
+  void finish();
+};
+
+#endif // DOWNSAMPLER_H
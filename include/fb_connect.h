@@ -2,11 +2,17 @@
 #define FB_CONNECT_H
 
 #include <firebird/Interface.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
 #include <string>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 #include <iostream>
 #include <crow/json.h>
-#include <mutex>
+#include <fb_row.h>
 
 struct FBConnectionStruct {
   std::string db_path;
@@ -16,11 +22,32 @@ struct FBConnectionStruct {
   std::string db_port;
 };
 
+// Как запросы получают транзакцию
+enum class TxMode {
+  PerQuery,        // своя транзакция (SNAPSHOT по умолчанию) на каждый запрос
+  SharedReadOnly,  // одна долгая READ ONLY READ COMMITTED транзакция на attachment
+};
+
+struct FBTxConfig {
+  TxMode mode = TxMode::PerQuery;
+  // долгая транзакция периодически пересоздается
+  std::chrono::seconds max_age{60};
+  unsigned int max_queries = 10000;
+};
+
+// значение для плейсхолдера '?' в запросе
+using SqlParam = std::variant<std::nullptr_t, int32_t, int64_t, double, bool, std::string>;
+using SqlParams = std::vector<SqlParam>;
+
+// вызывается на каждую строку; message действителен только до следующего вызова
+using RowHandler = std::function<void(const RowPlan& plan, const unsigned char* message)>;
+
+// Не потокобезопасен: attachment в каждый момент принадлежит одному потоку
+// (см. PooledConnection), поэтому запросы на разных attachment'ах идут параллельно.
 class FirebirdConnection {
 private:
-  static std::mutex fb_mutex_;
-
   bool isConnected = false;
+  bool isHealthy = true;  // false после сетевой ошибки - пул переподключит
 
   // api
   Firebird::IMaster* master = nullptr;
@@ -34,8 +61,58 @@ private:
 
   FBConnectionStruct config;
 
+  FBTxConfig txConfig;
+  std::chrono::milliseconds statementTimeout{0};
+  Firebird::ITransaction* sharedTx = nullptr;
+  std::chrono::steady_clock::time_point sharedTxStarted;
+  unsigned int sharedTxQueries = 0;
+
+  // prepared statements живут столько же, сколько attachment
+  struct CachedStatement {
+    Firebird::IStatement* stmt = nullptr;
+    Firebird::IMessageMetadata* inMeta = nullptr;
+    Firebird::IMessageMetadata* outMeta = nullptr;
+    RowPlan plan;
+    std::list<std::string>::iterator lru;
+
+    // буферы сообщений живут вместе со statement'ом - запрос не выделяет их заново
+    std::vector<unsigned char> outBuffer;
+    std::vector<unsigned char> inBuffer;
+    // метаданные параметров под типы последнего вызова; те же типы - без пересборки
+    Firebird::IMessageMetadata* boundMeta = nullptr;
+    std::string boundSignature;
+  };
+
+  static constexpr size_t maxCachedStatements = 64;
+
+  std::unordered_map<std::string, CachedStatement> statements;
+  std::list<std::string> statementsLru;  // front - последний использованный
+
   void fbInit();
 
+  Firebird::ITransaction* startSharedTransaction(Firebird::ThrowStatusWrapper& status);
+  void endSharedTransaction(bool commit);
+
+  CachedStatement& prepareCached(Firebird::ThrowStatusWrapper& status,
+                                 Firebird::ITransaction* transaction,
+                                 const std::string& query);
+  void dropStatement(const std::string& query);
+  void clearStatements();
+
+  std::string paramSignature;  // рабочий буфер bindParams
+
+  // заполняет cached.inBuffer; nullptr - у запроса нет параметров
+  Firebird::IMessageMetadata* bindParams(Firebird::ThrowStatusWrapper& status,
+                                         CachedStatement& cached,
+                                         const SqlParams& params);
+  Firebird::IMessageMetadata* buildParamsMeta(Firebird::ThrowStatusWrapper& status,
+                                              Firebird::IMessageMetadata* declared,
+                                              const SqlParams& params);
+  static void releaseStatement(CachedStatement& cached);
+
+  // снимает fb_cancel_raise, который пришел, когда запрос уже закончился
+  void resetCancel();
+
 public:
   explicit FirebirdConnection(FBConnectionStruct  conf);
   ~FirebirdConnection();
@@ -44,8 +121,34 @@ public:
 
   bool connect();
   void disconnect();
+  bool reconnect();
+
+  // lightweight round-trip to check the attachment is still alive
+  bool ping();
+  bool connected() const { return isConnected && isHealthy; }
+
+  static bool isNetworkError(const ISC_STATUS* errors);
+
+  void setTransactionConfig(const FBTxConfig& conf);
+
+  // таймаут по умолчанию для всех statement'ов attachment'а (IAttachment::setStatementTimeout),
+  // 0 - без ограничения. Срок запроса (RequestDeadline) задает свой таймаут поверх него
+  void setStatementTimeout(std::chrono::milliseconds timeout);
+
+  // прерывает выполняющийся на attachment'е запрос (fb_cancel_raise) - fetch бросит исключение.
+  // Единственный метод, который можно вызывать из другого потока
+  void cancel();
 
   std::vector<crow::json::wvalue> getSQL(const std::string& query);
+  std::vector<crow::json::wvalue> getSQL(const std::string& query, const SqlParams& params);
+
+  // Подписка на события POST_EVENT (epb - блок имен и счетчиков). callback вызывается
+  // потоком клиента Firebird один раз; IEvents освобождает вызывающий. Кидает std::runtime_error
+  Firebird::IEvents* queEvents(Firebird::IEventCallback* callback, const std::vector<unsigned char>& epb);
+
+  // выполняет запрос и отдает строки прямо из буфера сообщения, без промежуточных объектов;
+  // возвращает число строк
+  size_t fetch(const std::string& query, const SqlParams& params, const RowHandler& onRow);
 };
 
 #endif // FB_CONNECT_H
\ No newline at end of file
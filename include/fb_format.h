@@ -0,0 +1,45 @@
+#ifndef FB_FORMAT_H
+#define FB_FORMAT_H
+
+#include <firebird/Interface.h>
+#include <cstdint>
+#include <string>
+
+// Текстовое представление значений Firebird без промежуточных строк и без double:
+// всё пишется в хвост out (на горячем пути емкость out уже зарезервирована).
+// Кавычки для JSON-строк - забота вызывающего.
+
+// 1858-11-17 (начало отсчета ISC_DATE) -> 1970-01-01
+constexpr int64_t ISC_UNIX_EPOCH_DAYS = 40587;
+// ISC_TIME - десятитысячные доли секунды
+constexpr int64_t ISC_TIME_SECONDS_PRECISION = 10000;
+
+struct CivilDate {
+  int64_t year;
+  unsigned month;
+  unsigned day;
+};
+
+// дни от 1970-01-01 -> дата григорианского календаря (H. Hinnant, civil_from_days),
+// только арифметика - без таблиц и условных переходов
+CivilDate civilFromDays(int64_t days);
+
+// "YYYY-MM-DD" по дням от 1970-01-01
+void appendDate(std::string& out, int64_t unix_days);
+// "HH:MM:SS" по секундам от полуночи
+void appendTimeOfDay(std::string& out, int64_t seconds);
+// "YYYY-MM-DD HH:MM:SS" по секундам от 1970-01-01 (прежний формат strftime)
+void appendTimestamp(std::string& out, int64_t unix_seconds);
+
+// value * 10^scale точной десятичной записью: 12345 и -2 -> 123.45
+void appendDecimal(std::string& out, int64_t value, int scale);
+void appendInt128(std::string& out, const FB_I128& value, int scale);
+
+// DECFLOAT через IUtil; false - значение не число (NaN/Infinity), в out ничего не добавлено
+bool appendDecFloat16(std::string& out, const FB_DEC16& value);
+bool appendDecFloat34(std::string& out, const FB_DEC34& value);
+
+// INT128 в double - только для графиков (RowPlan::number)
+double int128ToDouble(const FB_I128& value);
+
+#endif // FB_FORMAT_H
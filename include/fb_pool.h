@@ -0,0 +1,135 @@
+#ifndef FB_POOL_H
+#define FB_POOL_H
+
+#include <fb_connect.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct FBPoolConfig {
+  size_t min_size = 2;   // сколько подключений держать открытыми всегда
+  size_t max_size = 16;  // верхняя граница одновременно открытых подключений
+  std::chrono::milliseconds acquire_timeout{5000};
+  std::chrono::seconds idle_timeout{300};           // простаивающие сверх min_size закрываются
+  std::chrono::seconds health_check_interval{30};   // ping перед выдачей, если дольше не проверяли
+  // таймаут statement'ов attachment'а по умолчанию - страховка для запросов без срока (0 - нет)
+  std::chrono::milliseconds statement_timeout{0};
+
+  // circuit breaker: после breaker_failures сетевых ошибок подряд узел не получает запросы
+  // breaker_open; затем пробные выдачи - первая удачная закрывает breaker
+  size_t breaker_failures = 3;
+  std::chrono::seconds breaker_open{10};
+
+  // API только читает - по умолчанию долгая READ ONLY READ COMMITTED транзакция на attachment
+  FBTxConfig tx = {TxMode::SharedReadOnly};
+};
+
+struct FBPoolStats {
+  size_t total = 0;
+  size_t idle = 0;
+  size_t leased = 0;
+
+  uint64_t acquired = 0;
+  uint64_t waited = 0;     // выдачи, которым пришлось ждать свободное подключение
+  uint64_t timeouts = 0;
+  uint64_t reconnects = 0;
+  uint64_t evicted = 0;
+  uint64_t breaker_trips = 0;
+
+  double wait_avg_ms = 0;
+  double wait_max_ms = 0;
+  double lease_ewma_ms = 0;  // сглаженное время аренды - цена запроса на этом узле
+  bool breaker_open = false;
+};
+
+class FirebirdPool;
+
+// RAII-аренда подключения: возвращается в пул в деструкторе
+class PooledConnection {
+private:
+  FirebirdPool* pool = nullptr;
+  std::unique_ptr<FirebirdConnection> conn;
+  std::chrono::steady_clock::time_point leasedAt;
+
+  friend class FirebirdPool;
+  PooledConnection(FirebirdPool* pool, std::unique_ptr<FirebirdConnection> conn);
+
+public:
+  PooledConnection() = default;
+  PooledConnection(PooledConnection&& other) noexcept;
+  PooledConnection& operator=(PooledConnection&& other) noexcept;
+  PooledConnection(const PooledConnection&) = delete;
+  PooledConnection& operator=(const PooledConnection&) = delete;
+  ~PooledConnection();
+
+  FirebirdConnection* operator->() const { return conn.get(); }
+  FirebirdConnection& operator*() const { return *conn; }
+  explicit operator bool() const { return conn != nullptr; }
+
+  // returns the connection to the pool early
+  void release();
+};
+
+class FirebirdPool {
+private:
+  struct IdleEntry {
+    std::unique_ptr<FirebirdConnection> conn;
+    std::chrono::steady_clock::time_point since;    // когда вернули в пул
+    std::chrono::steady_clock::time_point checked;  // последний успешный ping/connect
+  };
+
+  FBConnectionStruct config;
+  FBPoolConfig poolConfig;
+
+  mutable std::mutex poolMutex;
+  std::condition_variable available;
+  std::condition_variable stopSignal;
+  std::deque<IdleEntry> idle;  // back - последнее возвращенное (LIFO)
+  size_t total = 0;            // idle + leased + открываемые прямо сейчас
+  size_t maintained = 0;       // из total: у maintenance на health check или открытии, не выданы
+  bool stopping = false;
+
+  FBPoolStats counters;
+  double waitTotalMs = 0;
+
+  size_t failures = 0;  // сетевых отказов подряд
+  std::chrono::steady_clock::time_point breakerUntil;
+
+  std::thread maintenanceThread;
+
+  friend class PooledConnection;
+  void giveBack(std::unique_ptr<FirebirdConnection> conn, std::chrono::steady_clock::time_point leased_at);
+
+  // исход обращения к узлу для circuit breaker'а; вызываются под poolMutex
+  void breakerFailure();
+  void breakerSuccess();
+
+  std::unique_ptr<FirebirdConnection> open();
+  void recordWait(std::chrono::steady_clock::time_point start, bool waited);
+  void maintenance();
+
+public:
+  FirebirdPool(FBConnectionStruct conf, FBPoolConfig pool_conf = {});
+  ~FirebirdPool();
+
+  FirebirdPool(const FirebirdPool&) = delete;
+  FirebirdPool& operator=(const FirebirdPool&) = delete;
+
+  // throws std::runtime_error if no connection became available in acquire_timeout
+  // or the circuit breaker is open, QueryCancelled if the current request deadline
+  // (RequestDeadline) expires first
+  PooledConnection acquire();
+
+  // breaker закрыт или пора пробовать снова - узел можно выбирать
+  bool accepting() const;
+  // выданные сейчас подключения (для балансировки по наименьшей загрузке)
+  size_t outstanding() const;
+
+  FBPoolStats stats() const;
+};
+
+#endif // FB_POOL_H
@@ -0,0 +1,98 @@
+#ifndef FB_ROUTER_H
+#define FB_ROUTER_H
+
+#include <fb_pool.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FBRouterConfig {
+  // монотонный счетчик, который растет с основным потоком записи и реплицируется с primary.
+  // Для MAX(POINT_ID) нужен убывающий индекс (sql/uda_replica_lag.sql), иначе проба читает
+  // всю таблицу. Пусто - отставание не измеряется, реплики считаются догнавшими
+  std::string lag_query = "SELECT MAX(POINT_ID) FROM RD2_POINTS";
+  std::chrono::seconds probe_interval{2};
+  // допустимое отставание для запросов вне маршрута (PointFeed, схема таблиц)
+  std::chrono::milliseconds background_max_lag{5000};
+};
+
+struct FBNodeStats {
+  std::string name;  // host/port:path
+  bool primary = false;
+  int64_t lag_ms = -1;  // -1 - неизвестно (проба не прошла)
+  FBPoolStats pool;
+};
+
+// Чтение с primary и N реплик. У каждого узла свой FirebirdPool (и свой circuit breaker).
+// Запрос уходит на узел с наименьшей ожидаемой задержкой: (выдано + 1) * сглаженное время
+// аренды - least outstanding, взвешенный по скорости узла. Реплика участвует, только если
+// breaker закрыт и ее отставание не больше допустимого для маршрута (RouteTimeouts::max_lag
+// текущего RequestDeadline). Отставание меряет фоновая проба по lag_query: реплика догнала
+// primary до момента, когда на primary было видно то же значение счетчика.
+class FirebirdRouter {
+private:
+  struct Node {
+    std::string name;
+    std::unique_ptr<FirebirdPool> pool;
+    bool primary = false;
+    std::atomic<int64_t> lagMs{-1};
+  };
+
+  struct Sample {
+    std::chrono::steady_clock::time_point at;
+    int64_t value;
+  };
+
+  FBRouterConfig config;
+  std::vector<std::unique_ptr<Node>> nodes;  // [0] - primary
+
+  std::deque<Sample> primarySamples;  // только поток пробы
+  std::mutex probeMutex;
+  std::condition_variable wakeUp;
+  bool stopping = false;
+  std::thread probeThread;
+
+  std::chrono::milliseconds allowedLag() const;
+  Node* choose(std::chrono::milliseconds max_lag) const;
+
+  void probe();
+  void probeOnce();
+  static int64_t readCounter(FirebirdPool& pool, const std::string& query);
+
+public:
+  static constexpr size_t MAX_SAMPLES = 1024;
+
+  FirebirdRouter(FBConnectionStruct primary, std::vector<FBConnectionStruct> replicas,
+                 FBPoolConfig pool_conf = {}, FBRouterConfig router_conf = {});
+  ~FirebirdRouter();
+
+  FirebirdRouter(const FirebirdRouter&) = delete;
+  FirebirdRouter& operator=(const FirebirdRouter&) = delete;
+
+  // подключение для чтения; реплика выбирается по отставанию, допустимому для текущего запроса.
+  // Реплика не ответила - запрос уходит на primary
+  PooledConnection acquire();
+  // данные, которые сохраняются надолго (снимки сессий), читаются только с primary
+  PooledConnection acquirePrimary();
+
+  size_t nodeCount() const { return nodes.size(); }
+  std::vector<FBNodeStats> stats() const;
+  // сумма по всем узлам
+  FBPoolStats totals() const;
+
+  // отставание, нагрузка и breaker по узлам для /metrics (метка node)
+  void appendMetrics(std::string& out) const;
+};
+
+// "host/port:path;host/port:path" (как строка подключения Firebird); пользователь и пароль - из base.
+// std::invalid_argument на запись без хоста или порта
+std::vector<FBConnectionStruct> parseReplicaList(const std::string& list, const FBConnectionStruct& base);
+
+#endif // FB_ROUTER_H
@@ -0,0 +1,59 @@
+#ifndef FB_ROW_H
+#define FB_ROW_H
+
+#include <firebird/Interface.h>
+#include <crow/json.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Колонка выходного сообщения: всё, что нужно для чтения значения из буфера fetchNext
+struct FbColumn {
+  std::string name;
+  unsigned int type = 0;  // без бита nullable
+  unsigned int offset = 0;
+  unsigned int null_offset = 0;
+  unsigned int length = 0;
+  int scale = 0;
+  int sub_type = 0;
+};
+
+// План декодирования строки: метаданные читаются один раз на statement,
+// дальше каждая строка - это проход по плоскому массиву колонок
+class RowPlan {
+private:
+  std::vector<FbColumn> columns;
+  unsigned int messageLength = 0;
+
+public:
+  RowPlan() = default;
+  RowPlan(Firebird::ThrowStatusWrapper& status, Firebird::IMessageMetadata* meta);
+  // готовая раскладка сообщения без обращения к Firebird (синтетические буферы uda_bench)
+  RowPlan(std::vector<FbColumn> columns, unsigned int message_length)
+      : columns(std::move(columns)), messageLength(message_length) {}
+
+  const std::vector<FbColumn>& getColumns() const { return columns; }
+  unsigned int getMessageLength() const { return messageLength; }
+
+  static bool isNull(const FbColumn& col, const unsigned char* msg) {
+    return *reinterpret_cast<const short*>(msg + col.null_offset) != 0;
+  }
+
+  // индекс колонки по имени, -1 если нет
+  int find(std::string_view name) const;
+
+  // значение целочисленной колонки (SMALLINT/INTEGER/BIGINT без scale), nullopt для NULL
+  static std::optional<int64_t> integer(const FbColumn& col, const unsigned char* msg);
+  // числовое значение для графиков: целые со scale, FLOAT/DOUBLE,
+  // DATE/TIMESTAMP (секунды с 1970), TIME (секунды от полуночи);
+  // nullopt для NULL и прочих типов
+  static std::optional<double> number(const FbColumn& col, const unsigned char* msg);
+  // значение CHAR/VARCHAR колонки без хвостовых пробелов
+  static std::string_view text(const FbColumn& col, const unsigned char* msg);
+
+  crow::json::wvalue toJson(const unsigned char* msg) const;
+};
+
+#endif // FB_ROW_H
@@ -0,0 +1,51 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <fb_row.h>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Пишет JSON-текст прямо из буфера сообщения Firebird, минуя crow::json::wvalue.
+// Префиксы вида ,"NAME": экранируются один раз на план, числа пишутся через std::to_chars
+class JsonWriter {
+private:
+  std::string out;
+  const RowPlan* plan = nullptr;
+  std::pmr::vector<std::pmr::string> prefixes;
+  bool array = true;
+  bool finished = false;
+  size_t rows = 0;
+
+  std::function<void(const std::string& chunk)> sink;
+  size_t flushThreshold = 0;
+  size_t flushedBytes = 0;
+
+  void flush();
+
+  void preparePrefixes(const RowPlan& row_plan);
+
+public:
+  // array = false - пишется только первая строка как объект;
+  // resource - откуда брать служебные буферы (арена запроса)
+  explicit JsonWriter(bool array = true, size_t reserve = 4096,
+                      std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+  // Как только в буфере накопится threshold байт, он отдается в sink и очищается -
+  // память ограничена размером порции, сколько бы строк ни было
+  void setSink(std::function<void(const std::string& chunk)> chunk_sink, size_t threshold);
+  bool flushed() const { return flushedBytes > 0; }
+
+  void writeRow(const RowPlan& row_plan, const unsigned char* message);
+
+  // закрывает массив и возвращает готовое тело (после sink - остаток уже отдан, буфер пуст)
+  std::string& finish();
+
+  size_t rowCount() const { return rows; }
+
+  static void appendString(std::string& out, const char* str, size_t len);
+  static void appendValue(std::string& out, const FbColumn& col, const unsigned char* message);
+};
+
+#endif // JSON_WRITER_H
@@ -0,0 +1,123 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+enum class LogLevel : uint8_t {
+  Trace = 0,
+  Debug = 1,
+  Info = 2,
+  Warn = 3,
+  Error = 4,
+  Off = 5,
+};
+
+// Порог времени компиляции (CMake: -DUDA_LOG_LEVEL=trace|debug|info|warn|error).
+// Вызовы ниже порога выбрасываются компилятором вместе с вычислением аргументов
+#ifndef UDA_LOG_LEVEL
+#define UDA_LOG_LEVEL 1
+#endif
+
+// Поле записи key=value (logfmt). Строки не копируются: запись форматируется до возврата из write()
+struct LogField {
+  enum class Kind : uint8_t { Signed, Unsigned, Double, Text };
+
+  std::string_view key;
+  Kind kind;
+  int64_t signedValue = 0;
+  uint64_t unsignedValue = 0;
+  double doubleValue = 0;
+  std::string_view text;
+
+  LogField(std::string_view key, std::string_view value) : key(key), kind(Kind::Text), text(value) {}
+  LogField(std::string_view key, double value) : key(key), kind(Kind::Double), doubleValue(value) {}
+
+  template <std::signed_integral T>
+  LogField(std::string_view key, T value) : key(key), kind(Kind::Signed), signedValue(value) {}
+
+  template <std::unsigned_integral T>
+  LogField(std::string_view key, T value) : key(key), kind(Kind::Unsigned), unsignedValue(value) {}
+
+  // длительность пишется в миллисекундах (ключ стоит называть *_ms)
+  template <typename Rep, typename Period>
+  LogField(std::string_view key, std::chrono::duration<Rep, Period> value)
+      : key(key), kind(Kind::Double),
+        doubleValue(std::chrono::duration<double, std::milli>(value).count()) {}
+};
+
+// Повторы с одного места вызова: не больше BURST записей за секунду, остальные
+// только считаются и попадают в следующую выведенную запись полем suppressed
+class LogRateLimiter {
+private:
+  std::atomic<int64_t> windowStart{0};  // steady_clock, нс
+  std::atomic<uint32_t> inWindow{0};
+  std::atomic<uint64_t> skipped{0};
+
+public:
+  static constexpr uint32_t BURST = 10;
+
+  // false - запись пропустить; при true suppressed - сколько пропущено перед ней
+  bool allow(uint64_t& suppressed);
+};
+
+// Асинхронный журнал: поток пишет запись в свое кольцо (SPSC, без блокировок и выделений
+// после первой записи), фоновый поток раз в DRAIN_INTERVAL собирает кольца и выводит строки
+// logfmt в stderr одной записью. Кольцо переполнено - запись теряется и считается (dropped),
+// запрос из-за журнала не ждет никогда.
+class Logger {
+private:
+  static std::atomic<uint8_t> threshold;
+
+public:
+  static constexpr std::chrono::milliseconds DRAIN_INTERVAL{50};
+
+  static bool enabled(LogLevel level) {
+    return static_cast<uint8_t>(level) >= threshold.load(std::memory_order_relaxed);
+  }
+
+  // порог времени выполнения (не ниже порога компиляции)
+  static void setLevel(LogLevel level);
+  // "trace" ... "error", "off"; std::invalid_argument на неизвестное имя
+  static LogLevel parseLevel(std::string_view name);
+
+  static void write(LogLevel level, uint64_t suppressed, std::string_view message,
+                    std::initializer_list<LogField> fields = {});
+
+  // выводит все, что уже записано (перед выходом из процесса и в CLI-режимах)
+  static void flush();
+
+  static uint64_t dropped();
+};
+
+#define UDA_LOG_AT(level, ...)                                                          \
+  do {                                                                                  \
+    if constexpr (static_cast<int>(level) >= UDA_LOG_LEVEL) {                           \
+      if (Logger::enabled(level)) Logger::write(level, 0, __VA_ARGS__);                 \
+    }                                                                                   \
+  } while (0)
+
+// ошибки повторяются сериями (БД недоступна, реплика отстала) - у каждого места вызова свой лимит
+#define UDA_LOG_LIMITED(level, ...)                                                     \
+  do {                                                                                  \
+    if constexpr (static_cast<int>(level) >= UDA_LOG_LEVEL) {                           \
+      static LogRateLimiter uda_log_limiter;                                            \
+      uint64_t uda_log_suppressed = 0;                                                  \
+      if (Logger::enabled(level) && uda_log_limiter.allow(uda_log_suppressed))          \
+        Logger::write(level, uda_log_suppressed, __VA_ARGS__);                          \
+    }                                                                                   \
+  } while (0)
+
+// UDA_LOG_INFO("query", {{"route", "/api/points"}, {"id", id}, {"rows", rows}});
+#define UDA_LOG_TRACE(...) UDA_LOG_AT(LogLevel::Trace, __VA_ARGS__)
+#define UDA_LOG_DEBUG(...) UDA_LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define UDA_LOG_INFO(...) UDA_LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define UDA_LOG_WARN(...) UDA_LOG_LIMITED(LogLevel::Warn, __VA_ARGS__)
+#define UDA_LOG_ERROR(...) UDA_LOG_LIMITED(LogLevel::Error, __VA_ARGS__)
+
+#endif // LOGGER_H
@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Файл, отображенный в память только для чтения (mmap / MapViewOfFile).
+// Кидает std::runtime_error, если файл не открылся или не отобразился
+class MappedFile {
+private:
+  const uint8_t* bytes = nullptr;
+  size_t length = 0;
+
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#endif
+
+  void close();
+
+public:
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const { return bytes; }
+  size_t size() const { return length; }
+};
+
+#endif // MAPPED_FILE_H
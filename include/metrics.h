@@ -0,0 +1,125 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Этапы обработки запроса. Значения декодируются из буфера сообщения сразу в байты
+// ответа, поэтому декодирование входит в Serialize
+enum class Stage : uint8_t {
+  Queue = 0,      // ожидание в очереди DB executor'а
+  Acquire = 1,    // подключение из пула (attach, если свободных нет)
+  Prepare = 2,    // транзакция, prepare (или кэш statement'ов), параметры
+  Fetch = 3,      // openCursor и fetchNext - сеть и сервер
+  Serialize = 4,  // строки в JSON/колоночный формат, прореживание
+  Send = 5,       // передача ответа Crow
+  Total = 6,
+};
+
+constexpr size_t STAGE_COUNT = 7;
+
+class Metrics;
+
+// Маршрут, зарегистрированный в Metrics при старте - без поиска по имени на каждый запрос
+struct MetricsRoute {
+  Metrics* metrics = nullptr;
+  size_t index = 0;
+  const std::string* name = nullptr;  // для журнала запросов; строка живет вместе с Metrics
+};
+
+// Счетчики и гистограммы задержек для /metrics (формат Prometheus).
+// Каждый поток пишет в свой шард без блокировок и атомарных RMW; /metrics суммирует шарды.
+// Гистограммы логарифмически-линейные (как HDR): 4 корзины на каждую степень двойки
+// микросекунд, относительная ошибка не больше 25% во всем диапазоне
+class Metrics {
+private:
+  struct Shard;
+
+  mutable std::mutex registryMutex;
+  std::deque<std::string> routeNames;  // deque - адреса имен не меняются при регистрации
+  std::vector<std::unique_ptr<Shard>> shards;  // шард живет и после выхода потока - счетчики монотонны
+
+  Shard& localShard();
+
+  friend class RequestTrace;
+  void record(size_t route, const std::array<uint64_t, STAGE_COUNT>& nanos, uint32_t observed,
+              int status, uint64_t rows, uint64_t bytes);
+
+public:
+  static constexpr size_t MAX_ROUTES = 32;
+
+  Metrics();
+  ~Metrics();
+
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  // регистрирует маршрут (повторная регистрация возвращает тот же); кидает std::runtime_error сверх MAX_ROUTES
+  MetricsRoute route(const std::string& name);
+
+  // текстовый формат Prometheus 0.0.4
+  std::string render() const;
+
+  // ошибка Firebird по коду gds (errors[1] статус-вектора); счетчик общий на процесс
+  static void firebirdError(intptr_t code);
+
+  // запрос к БД прерван по времени или из-за ухода клиента (reason - метка); не ошибка Firebird
+  static void queryCancelled(const char* reason);
+
+  // одиночное значение без меток: type - "counter" или "gauge"
+  static void appendScalar(std::string& out, const char* name, const char* type,
+                           const char* help, double value);
+};
+
+// Замер одного запроса. Пока объект жив, он текущий для потока: нижние слои
+// (пул, FirebirdConnection, queryRows) добавляют этапы через статические методы,
+// ничего не зная о маршруте. Вне запроса (PointFeed, обслуживание снимков) это no-op
+class RequestTrace {
+private:
+  static thread_local RequestTrace* current;
+
+  MetricsRoute route;
+  std::chrono::steady_clock::time_point start;
+  std::array<uint64_t, STAGE_COUNT> nanos = {};
+  uint32_t observed = 0;  // битовая маска этапов, которые реально были
+  uint64_t rowCount = 0;
+  RequestTrace* previous;
+  bool finished = false;
+
+public:
+  // start - когда запрос пришел (до очереди executor'а)
+  explicit RequestTrace(MetricsRoute route,
+                        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now());
+  ~RequestTrace();
+
+  RequestTrace(const RequestTrace&) = delete;
+  RequestTrace& operator=(const RequestTrace&) = delete;
+
+  // записывает запрос в метрики (Total - от start до этого момента) и строку в журнал
+  void finish(int status, uint64_t bytes);
+
+  static void stage(Stage stage, std::chrono::steady_clock::duration elapsed);
+  static void rows(uint64_t count);
+};
+
+// Добавляет к этапу текущего запроса время жизни объекта
+class StageTimer {
+private:
+  Stage stage;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit StageTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+  ~StageTimer() { RequestTrace::stage(stage, std::chrono::steady_clock::now() - start); }
+
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,83 @@
+#ifndef POINT_FEED_H
+#define POINT_FEED_H
+
+#include <fb_router.h>
+#include <query_builder.h>
+
+#include <crow.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Живой поток новых точек активных сессий для WebSocket-клиентов.
+// На каждом такте по каждой сессии с подписчиками выполняется один инкрементальный
+// запрос (POINT_ID > последний отправленный), результат рассылается всем подписчикам -
+// нагрузка на БД не зависит от числа клиентов.
+//
+// Протокол (текстовые JSON-сообщения):
+//   клиент: {"subscribe": <session_id>} / {"unsubscribe": <session_id>}
+//   сервер: {"session": id, "subscribed": true, "after": <POINT_ID>}  - дальше придут точки после after
+//           {"session": id, "points": [...]}
+//           {"session": id, "error": "..."}  - подписка не принята (нет такой сессии, превышен лимит)
+//           {"error": "..."}
+//
+// Сессия проверяется по sessions_table при первом опросе: несуществующие не опрашиваются.
+// Подписок на соединение не больше MAX_SUBSCRIPTIONS, отслеживаемых сессий - MAX_SESSIONS:
+// каждая сессия - запрос к БД на каждом такте.
+class PointFeed {
+private:
+  struct Session {
+    std::set<crow::websocket::connection*> subscribers;
+    std::set<crow::websocket::connection*> pending;  // ждут ответа subscribed
+    std::optional<int64_t> lastKey;                   // nullopt - еще не прочитали MAX(key)
+  };
+
+  FirebirdRouter& pool;
+  KeysetSpec spec;
+  std::string sessionsTable;
+  std::chrono::milliseconds interval;
+
+  std::mutex feedMutex;
+  std::condition_variable stopSignal;
+  std::unordered_map<int64_t, Session> sessions;
+  std::unordered_map<crow::websocket::connection*, size_t> subscriptions;  // подписок (и ожидающих) на соединение
+  bool stopping = false;
+
+  std::thread ticker;
+
+  void run();
+  void poll(PooledConnection& fbc, int64_t session_id, std::optional<int64_t> last_key);
+  // под feedMutex: соединение больше не подписано на одну из сессий
+  void release(crow::websocket::connection* conn);
+
+public:
+  static constexpr size_t MAX_SUBSCRIPTIONS = 64;
+  static constexpr size_t MAX_SESSIONS = 1024;
+
+  // spec - таблица точек (RD2_POINTS по SESSION_ID); sessions_table - где искать саму сессию
+  PointFeed(FirebirdRouter& pool, KeysetSpec spec, std::string sessions_table,
+            std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+  ~PointFeed();
+
+  PointFeed(const PointFeed&) = delete;
+  PointFeed& operator=(const PointFeed&) = delete;
+
+  // вызывается из onmessage WebSocket-маршрута
+  void handleMessage(crow::websocket::connection& conn, const std::string& data);
+  void subscribe(crow::websocket::connection& conn, int64_t session_id);
+  void unsubscribe(crow::websocket::connection& conn, int64_t session_id);
+
+  // onclose: соединение снимается со всех сессий
+  void disconnect(crow::websocket::connection& conn);
+
+  size_t sessionCount();
+};
+
+#endif // POINT_FEED_H
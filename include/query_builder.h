@@ -0,0 +1,60 @@
+#ifndef QUERY_BUILDER_H
+#define QUERY_BUILDER_H
+
+#include <fb_router.h>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Таблица с keyset (seek) пагинацией: фильтр по родителю + сортировка по индексированному ключу
+struct KeysetSpec {
+  const char* table;
+  const char* filter_column;  // DEVICE_ID / SESSION_ID
+  const char* key_column;     // SESSION_ID / POINT_ID
+  bool descending;
+};
+
+struct PageRequest {
+  std::optional<int64_t> after;     // ключ последней строки предыдущей страницы
+  size_t limit = 0;                 // 0 - без ограничения
+  std::vector<std::string> fields;  // пусто - все колонки
+
+  bool paged() const { return after.has_value() || limit > 0; }
+};
+
+constexpr size_t DEFAULT_PAGE_LIMIT = 1000;
+constexpr size_t MAX_PAGE_LIMIT = 10000;
+
+// Разбирает ?after=&limit=&fields= (любой из аргументов может быть nullptr).
+// Кидает std::invalid_argument на некорректный ввод
+PageRequest parsePageRequest(const char* after, const char* limit, const char* fields);
+
+// Реальные колонки таблиц - читаются из RDB$RELATION_FIELDS один раз
+class SchemaCache {
+private:
+  std::mutex schemaMutex;
+  std::unordered_map<std::string, std::vector<std::string>> tables;
+
+public:
+  // подключение из пула берется только при первом обращении к таблице
+  std::vector<std::string> columns(FirebirdRouter& pool, const std::string& table);
+  void invalidate(const std::string& table);
+};
+
+// Собирает SELECT для страницы; колонки из fields проверяются по table_columns
+// (std::invalid_argument на неизвестную). Ключ всегда попадает в проекцию - нужен для курсора.
+// not_null_column (уже проверенная колонка) отсекает строки с NULL - для прореживания.
+std::string buildKeysetQuery(const KeysetSpec& spec, const PageRequest& page,
+                             const std::vector<std::string>& table_columns,
+                             int64_t filter_value, SqlParams& params,
+                             const std::string& not_null_column = {});
+
+// COUNT(*) строк, которые вернул бы buildKeysetQuery без limit. Подключение - то же, что у
+// самого запроса: узлы с разным отставанием посчитали бы разные строки
+uint64_t countKeysetRows(PooledConnection& fbc, const KeysetSpec& spec, const PageRequest& page,
+                         int64_t filter_value, const std::string& not_null_column = {});
+
+#endif // QUERY_BUILDER_H
@@ -0,0 +1,138 @@
+#ifndef QUERY_DEADLINE_H
+#define QUERY_DEADLINE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+// Ограничения времени маршрута; 0 - без ограничения
+struct RouteTimeouts {
+  std::chrono::milliseconds statement{0};  // IStatement::setTimeout на каждый запрос к БД
+  std::chrono::milliseconds deadline{0};   // весь запрос от прихода, включая очередь executor'а
+  // насколько реплика может отставать от primary (FirebirdRouter); здесь 0 - читать только с primary
+  std::chrono::milliseconds max_lag{0};
+};
+
+enum class CancelReason {
+  StatementTimeout,  // сработал таймаут statement'а на сервере
+  Deadline,          // истек общий срок запроса
+  ClientGone,        // клиент закрыл соединение
+};
+
+// Запрос прерван по времени или из-за ухода клиента - маршруты отвечают 504.
+// Считается отдельно от ошибок Firebird (uda_query_cancelled_total)
+class QueryCancelled : public std::runtime_error {
+private:
+  CancelReason why;
+
+public:
+  explicit QueryCancelled(CancelReason reason);
+
+  CancelReason reason() const { return why; }
+
+  // считает отмену в метриках и бросает исключение
+  [[noreturn]] static void raise(CancelReason reason);
+};
+
+// Срок текущего запроса. Как и RequestTrace, пока объект жив, он текущий для потока:
+// пул и FirebirdConnection берут из него таймауты, не зная о маршруте.
+// Вне запроса (PointFeed, снимки) сроков нет
+class RequestDeadline {
+private:
+  static thread_local RequestDeadline* current;
+
+  RouteTimeouts timeouts;
+  std::chrono::steady_clock::time_point expires;
+  std::function<bool()> clientAlive;
+  RequestDeadline* previous;
+
+public:
+  // client_alive вызывается из потока watchdog'а
+  RequestDeadline(RouteTimeouts timeouts, std::chrono::steady_clock::time_point start,
+                  std::function<bool()> client_alive = {});
+  ~RequestDeadline();
+
+  RequestDeadline(const RequestDeadline&) = delete;
+  RequestDeadline& operator=(const RequestDeadline&) = delete;
+
+  static RequestDeadline* active() { return current; }
+
+  // time_point::max() - срока нет
+  std::chrono::steady_clock::time_point expiresAt() const { return expires; }
+
+  bool clientGone() const { return clientAlive && !clientAlive(); }
+
+  // бросает QueryCancelled, если срок истек или клиент ушел
+  void check() const;
+
+  // для IStatement::setTimeout: меньшее из таймаута маршрута и остатка срока, 0 - без ограничения
+  unsigned int statementTimeoutMs() const;
+
+  std::chrono::milliseconds maxReplicaLag() const { return timeouts.max_lag; }
+
+  friend class QueryWatchdog;
+};
+
+class FirebirdConnection;
+
+// Поток, который прерывает выполняющиеся запросы через IAttachment::cancelOperation,
+// когда истекает срок запроса или клиент закрывает соединение. Запрос регистрируется
+// на время fetch (Guard); пока идет отмена, Guard не отпускает подключение
+class QueryWatchdog {
+private:
+  struct Entry {
+    FirebirdConnection* conn;
+    std::chrono::steady_clock::time_point expires;
+    std::function<bool()> clientAlive;
+    std::optional<CancelReason> fired;
+    bool cancelling = false;
+  };
+
+  std::mutex watchMutex;
+  std::condition_variable wakeUp;
+  std::condition_variable cancelled;
+  std::list<Entry> entries;
+  bool stopping = false;
+
+  std::thread thread;
+
+  QueryWatchdog();
+  void run();
+
+public:
+  // как часто опрашивается, жив ли клиент
+  static constexpr std::chrono::milliseconds POLL_INTERVAL{100};
+
+  ~QueryWatchdog();
+
+  QueryWatchdog(const QueryWatchdog&) = delete;
+  QueryWatchdog& operator=(const QueryWatchdog&) = delete;
+
+  // общий на процесс, поток стартует при первом обращении
+  static QueryWatchdog& instance();
+
+  class Guard {
+  private:
+    QueryWatchdog& watchdog;
+    std::list<Entry>::iterator entry;
+    bool released = false;
+    std::optional<CancelReason> result;
+
+  public:
+    Guard(FirebirdConnection& conn, const RequestDeadline& deadline);
+    ~Guard();
+
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+    // снимает запрос с наблюдения (дожидаясь идущей отмены); причина, если отмена была
+    std::optional<CancelReason> release();
+  };
+};
+
+#endif // QUERY_DEADLINE_H
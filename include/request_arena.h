@@ -0,0 +1,34 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+// Память одного запроса: мелкие временные буферы построения ответа (префиксы колонок,
+// буферы колонок, копии строк прореживания) берутся последовательно из блока и
+// освобождаются разом, когда арена уничтожается. Первый блок - thread_local
+// и переиспользуется следующими запросами того же потока, так что обычный запрос
+// не обращается к общему malloc вовсе. Крупные растущие буферы идут в upstream
+// и освобождаются сразу - арена не держит их старые копии до конца запроса.
+class RequestArena : public std::pmr::memory_resource {
+private:
+  std::byte* block;  // thread_local блок, nullptr - его уже занимает внешняя арена
+  std::pmr::memory_resource* upstream;
+  std::pmr::monotonic_buffer_resource small;
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+public:
+  static constexpr size_t THREAD_BLOCK = 256 * 1024;
+  static constexpr size_t LARGE_ALLOCATION = 64 * 1024;
+
+  RequestArena();
+  ~RequestArena() override;
+
+  RequestArena(const RequestArena&) = delete;
+  RequestArena& operator=(const RequestArena&) = delete;
+};
+
+#endif // REQUEST_ARENA_H
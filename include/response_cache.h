@@ -0,0 +1,104 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <compression.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct CachedResponse {
+  std::string body;
+  std::string content_type;
+  std::string etag;  // в кавычках, как в заголовке
+  std::string next_cursor;
+  std::chrono::steady_clock::time_point expires;
+
+  // сжатые варианты body по ContentEncoding: считаются при первом запросе
+  // с такой кодировкой и дальше отдаются всем (ResponseCache::encoded)
+  mutable std::mutex encodedMutex;
+  mutable std::array<std::shared_ptr<const std::string>, CONTENT_ENCODING_COUNT> encoded;
+};
+
+struct ResponseCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;  // вытеснены по размеру
+  uint64_t expired = 0;    // истек TTL
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// Кэш готовых тел ответов: ключ - маршрут с параметрами, у каждой записи свой TTL.
+// Разбит на шарды со своими мьютексами и LRU, общий размер ограничен в байтах.
+class ResponseCache {
+private:
+  static constexpr size_t SHARDS = 16;
+
+  struct Entry {
+    std::shared_ptr<const CachedResponse> value;
+    std::list<std::string>::iterator lru;
+    size_t bytes = 0;  // вместе со сжатыми вариантами
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru;  // front - последний использованный
+    size_t bytes = 0;
+  };
+
+  std::array<Shard, SHARDS> shards;
+  size_t maxShardBytes;
+  CompressionConfig compression;
+
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> evictions{0};
+  std::atomic<uint64_t> expired{0};
+  std::atomic<uint64_t> invalidations{0};
+
+  Shard& shardFor(const std::string& key);
+  static size_t entrySize(const std::string& key, const CachedResponse& value);
+  void erase(Shard& shard, std::unordered_map<std::string, Entry>::iterator it);
+
+public:
+  explicit ResponseCache(size_t max_bytes = 64 * 1024 * 1024, CompressionConfig compression = {});
+
+  // nullptr - нет в кэше или истек TTL
+  std::shared_ptr<const CachedResponse> get(const std::string& key);
+
+  std::shared_ptr<const CachedResponse> put(const std::string& key, std::string body,
+                                            std::string content_type, std::chrono::milliseconds ttl,
+                                            std::string next_cursor = {});
+
+  // будет ли вариант value в encoding сжатым (encoded() вернет не nullptr) - без сжатия
+  bool compresses(const CachedResponse& value, ContentEncoding encoding) const {
+    return encoding != ContentEncoding::Identity && value.body.size() >= compression.min_size;
+  }
+
+  // тело value (записи key) в кодировке encoding; сжимается один раз, вариант хранится
+  // в записи и входит в ее размер. nullptr - отдавать body как есть (Identity или тело меньше порога)
+  std::shared_ptr<const std::string> encoded(const std::string& key, const CachedResponse& value,
+                                             ContentEncoding encoding);
+
+  void invalidate(const std::string& key);
+  // все ключи, начинающиеся с prefix (страницы одного списка); "" - весь кэш
+  void invalidatePrefix(const std::string& prefix);
+
+  // растет при каждой инвалидации: ответ, собранный из БД, пока шла инвалидация,
+  // мог прочитать старые данные - класть его в кэш нельзя
+  uint64_t generation() const { return invalidations; }
+
+  ResponseCacheStats stats();
+
+  // хэш содержимого (FNV-1a 64) для ETag
+  static std::string etagFor(const std::string& body);
+};
+
+#endif // RESPONSE_CACHE_H
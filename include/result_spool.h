@@ -0,0 +1,61 @@
+#ifndef RESULT_SPOOL_H
+#define RESULT_SPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+// Временные файлы для больших ответов: тело пишется на диск порциями по мере fetch,
+// а Crow отдает файл кусками, не загружая его в память целиком.
+// Файл нельзя удалить сразу после ответа (Crow открывает его при отправке),
+// поэтому старые файлы подчищаются по ttl.
+class ResultSpool {
+private:
+  std::filesystem::path dir;
+  std::chrono::seconds ttl;
+
+  std::string instance;  // префикс имен - несколько процессов могут делить каталог
+  std::atomic<uint64_t> counter{0};
+
+  std::mutex sweepMutex;
+  std::chrono::steady_clock::time_point lastSweep;
+
+  void sweep();
+
+public:
+  explicit ResultSpool(std::filesystem::path dir = std::filesystem::temp_directory_path() / "uda-spool",
+                       std::chrono::seconds ttl = std::chrono::minutes(10));
+
+  // новый уникальный путь внутри каталога
+  std::filesystem::path create(const std::string& extension = ".json");
+
+  // Копия чужого файла для ответа (жесткая ссылка, иначе копирование): Crow откроет ее уже после
+  // возврата из обработчика, и владелец исходного файла волен удалить или заменить его раньше
+  std::filesystem::path link(const std::filesystem::path& source, const std::string& extension);
+};
+
+// Файл spool'а, который открывается только при первой записи
+class SpoolFile {
+private:
+  ResultSpool& spool;
+  std::string extension;  // по расширению Crow выбирает Content-Type, если он не задан явно
+  std::filesystem::path path;
+  std::ofstream file;
+
+public:
+  explicit SpoolFile(ResultSpool& spool, std::string extension = ".json")
+      : spool(spool), extension(std::move(extension)) {}
+  ~SpoolFile();
+
+  void write(const std::string& chunk);
+
+  // закрывает файл и возвращает путь; после этого файл принадлежит ответу
+  std::string commit();
+
+  bool opened() const { return !path.empty(); }
+};
+
+#endif // RESULT_SPOOL_H
@@ -0,0 +1,100 @@
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <query_deadline.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Склеивает одинаковые одновременные запросы: пока запрос с ключом key выполняется,
+// остальные вызовы с тем же ключом ждут его результат вместо своего похода в БД.
+// Результат не кэшируется - следующий вызов после завершения выполнит fn заново.
+// Ожидающий соблюдает свой RequestDeadline, а отмену лидера из-за его клиента или срока
+// не получает: он повторяет запрос сам (становится новым лидером или ждет следующего).
+template <typename T>
+class SingleFlight {
+private:
+  std::mutex flightMutex;
+  std::unordered_map<std::string, std::shared_future<T>> inFlight;
+
+  std::atomic<uint64_t> executed{0};
+  std::atomic<uint64_t> coalesced{0};
+
+  // лидер мог прийти раньше и ждать дольше - срок и клиент ожидающего проверяются, пока он ждет
+  static void await(const std::shared_future<T>& future) {
+    const RequestDeadline* deadline = RequestDeadline::active();
+    if (!deadline) {
+      future.wait();
+      return;
+    }
+
+    while (future.wait_until(std::min(deadline->expiresAt(),
+                                      std::chrono::steady_clock::now() + QueryWatchdog::POLL_INTERVAL))
+           != std::future_status::ready) {
+      deadline->check();
+    }
+  }
+
+  // отмена касается запроса лидера, а не этого; таймаут statement'а - общий для всех
+  static bool leaderOnly(const QueryCancelled& e) {
+    return e.reason() == CancelReason::ClientGone || e.reason() == CancelReason::Deadline;
+  }
+
+public:
+  T run(const std::string& key, const std::function<T()>& fn) {
+    for (;;) {
+      std::promise<T> promise;
+      std::shared_future<T> future;
+      {
+        std::lock_guard<std::mutex> lock(flightMutex);
+        auto it = inFlight.find(key);
+        if (it != inFlight.end()) {
+          future = it->second;
+        } else {
+          inFlight.emplace(key, promise.get_future().share());
+        }
+      }
+
+      if (future.valid()) {
+        coalesced++;
+        await(future);
+        try {
+          return future.get();  // исключение лидера пробрасывается всем ожидающим
+        } catch (const QueryCancelled& e) {
+          if (!leaderOnly(e)) throw;
+          // свой срок мог истечь, пока ждали, - тогда отменяется и этот запрос
+          if (const RequestDeadline* deadline = RequestDeadline::active()) deadline->check();
+          continue;
+        }
+      }
+      executed++;
+
+      auto finish = [&]() {
+        std::lock_guard<std::mutex> lock(flightMutex);
+        inFlight.erase(key);
+      };
+
+      try {
+        T value = fn();
+        finish();
+        promise.set_value(value);
+        return value;
+      } catch (...) {
+        finish();
+        promise.set_exception(std::current_exception());
+        throw;
+      }
+    }
+  }
+
+  uint64_t executedCount() const { return executed; }
+  uint64_t coalescedCount() const { return coalesced; }
+};
+
+#endif // SINGLE_FLIGHT_H
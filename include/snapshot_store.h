@@ -0,0 +1,115 @@
+#ifndef SNAPSHOT_STORE_H
+#define SNAPSHOT_STORE_H
+
+#include <columnar_reader.h>
+#include <fb_router.h>
+#include <mapped_file.h>
+#include <query_builder.h>
+#include <single_flight.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct SnapshotConfig {
+  std::filesystem::path dir = "snapshots";
+  uint64_t max_bytes = 4ull << 30;  // сверх этого вытесняются давно не читанные снимки
+
+  // Сессия закрыта - ее точки больше не меняются. Условие подставляется в
+  // SELECT 1 FROM <sessions_table> WHERE SESSION_ID = ? AND (...); пусто - хранилище выключено
+  std::string sessions_table = "RD2_SESSIONS";
+  std::string closed_condition;
+};
+
+struct SnapshotStats {
+  size_t entries = 0;
+  uint64_t bytes = 0;
+  uint64_t hits = 0;
+  uint64_t builds = 0;
+  uint64_t evictions = 0;
+};
+
+// Неизменяемый снимок точек одной сессии: mmap файла в колоночном формате
+struct Snapshot {
+  std::filesystem::path path;
+  MappedFile file;
+  ColumnarReader reader;
+
+  explicit Snapshot(const std::filesystem::path& snapshot_path);
+};
+
+using SharedSnapshot = std::shared_ptr<const Snapshot>;
+
+// Постоянный локальный уровень для закрытых сессий: при первом чтении точки сессии
+// пишутся в файл колоночного формата (session-<id>.udac), дальше запросы отдаются
+// из mmap без обращения к БД. Файлы пишутся через временный и rename - битый файл
+// после падения не появится. Общий размер ограничен max_bytes (LRU по чтениям).
+class SnapshotStore {
+private:
+  struct Entry {
+    uint64_t bytes = 0;
+    SharedSnapshot snapshot;  // отображается при первом чтении после запуска
+    std::chrono::steady_clock::time_point used;
+  };
+
+  SnapshotConfig config;
+  KeysetSpec spec;
+
+  // Сборка читает БД долго, и изменение может прийти посреди нее: remove() сдвигает поколение
+  // сессии, и собранный снимок со старыми данными не регистрируется
+  struct Build {
+    unsigned builders = 0;
+    uint64_t generation = 0;
+  };
+
+  std::mutex storeMutex;
+  std::unordered_map<int64_t, Entry> entries;
+  std::unordered_map<int64_t, Build> building;  // только сессии, которые сейчас собираются
+  uint64_t totalBytes = 0;
+  SnapshotStats counters;
+
+  SingleFlight<SharedSnapshot> builds;
+
+  std::filesystem::path pathFor(int64_t session_id) const;
+
+  bool closed(PooledConnection& fbc, int64_t session_id);
+  SharedSnapshot build(PooledConnection& fbc, int64_t session_id);
+  // поколение сессии на начало сборки; каждому beginBuild - один finishBuild
+  uint64_t beginBuild(int64_t session_id);
+  // регистрирует снимок, если сессию не меняли с beginBuild; иначе удаляет его файл и возвращает nullptr.
+  // snapshot == nullptr - сборка не состоялась
+  SharedSnapshot finishBuild(int64_t session_id, uint64_t generation, SharedSnapshot snapshot);
+  void add(int64_t session_id, SharedSnapshot snapshot);
+  void evict();
+  void remove(int64_t session_id);
+
+public:
+  // spec - таблица точек (RD2_POINTS по SESSION_ID, порядок по POINT_ID)
+  SnapshotStore(SnapshotConfig conf, KeysetSpec spec);
+
+  bool enabled() const { return !config.closed_condition.empty(); }
+
+  // Снимок закрытой сессии (при первом обращении строится из БД); nullptr - сессия еще идет
+  SharedSnapshot get(FirebirdRouter& pool, int64_t session_id);
+
+  // Точки закрытой сессии изменились в БД: снимок удаляется, следующее чтение соберет новый
+  void invalidate(int64_t session_id) { remove(session_id); }
+
+  // Неизвестно, что изменилось (DDL, потерян журнал изменений): удаляются все снимки
+  void clear();
+
+  // Проверяет все снимки: структура файла и число строк против COUNT(*) в БД.
+  // Битые удаляются; возвращает их количество
+  size_t verify(FirebirdRouter& pool);
+
+  // Пересобирает все снимки из БД; возвращает число пересобранных
+  size_t rebuild(FirebirdRouter& pool);
+
+  SnapshotStats stats();
+};
+
+#endif // SNAPSHOT_STORE_H
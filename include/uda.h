@@ -3,10 +3,23 @@
 
 #define CROW_PORT 8080
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
 
+#include <alloc_stats.h>
+#include <api_response.h>
+#include <change_listener.h>
+#include <db_executor.h>
 #include <fb_connect.h>
+#include <fb_router.h>
+#include <logger.h>
+#include <metrics.h>
+#include <point_feed.h>
+#include <query_builder.h>
 
 #include <crow.h>
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Журнал изменений и события Firebird для сброса кэша ответов uda (ChangeListener).
+ *
+ * POST_EVENT передает только имя события, без ключей, поэтому триггеры пишут
+ * измененный ключ в UDA_CHANGES, а событие лишь будит слушателя. Событие доставляется
+ * при commit транзакции, в которой оно вызвано, вместе со строками журнала.
+ *
+ * Установка (Firebird 3+): isql -i uda_events.sql <база>, затем запуск uda с UDA_EVENTS=1
+ * (без этой переменной слушатель не запускается, кэш живет короткие TTL).
+ * API только читает базу, поэтому старые строки журнала удаляет обслуживание:
+ *   EXECUTE PROCEDURE UDA_PURGE_CHANGES(7);
+ */
+
+SET TERM ^ ;
+
+CREATE TABLE UDA_CHANGES (
+    CHANGE_ID  BIGINT GENERATED BY DEFAULT AS IDENTITY PRIMARY KEY,
+    TABLE_NAME VARCHAR(63) NOT NULL,
+    ROW_ID     BIGINT NOT NULL,
+    PARENT_ID  BIGINT,
+    CHANGED_AT TIMESTAMP DEFAULT CURRENT_TIMESTAMP NOT NULL
+)^
+
+CREATE INDEX UDA_CHANGES_CHANGED_AT ON UDA_CHANGES (CHANGED_AT)^
+
+/* /api/boards, /api/boards/<id> */
+CREATE OR ALTER TRIGGER UDA_DEVICES_CHANGED FOR DEVICES
+AFTER INSERT OR UPDATE OR DELETE
+AS
+BEGIN
+    INSERT INTO UDA_CHANGES (TABLE_NAME, ROW_ID)
+    VALUES ('DEVICES', IIF(DELETING, OLD.DEVICE_ID, NEW.DEVICE_ID));
+    POST_EVENT 'UDA_CHANGED';
+END^
+
+/* /api/param/<DEVICE_ID> */
+CREATE OR ALTER TRIGGER UDA_PASSP_SCAN_CHANGED FOR PASSP_SCAN
+AFTER INSERT OR UPDATE OR DELETE
+AS
+BEGIN
+    INSERT INTO UDA_CHANGES (TABLE_NAME, ROW_ID)
+    VALUES ('PASSP_SCAN', IIF(DELETING, OLD.DEVICE_ID, NEW.DEVICE_ID));
+    POST_EVENT 'UDA_CHANGED';
+END^
+
+/* /api/session/<id>, страницы /api/sessions/<DEVICE_ID>, снимок сессии */
+CREATE OR ALTER TRIGGER UDA_SESSIONS_CHANGED FOR RD2_SESSIONS
+AFTER INSERT OR UPDATE OR DELETE
+AS
+BEGIN
+    INSERT INTO UDA_CHANGES (TABLE_NAME, ROW_ID, PARENT_ID)
+    VALUES ('RD2_SESSIONS',
+            IIF(DELETING, OLD.SESSION_ID, NEW.SESSION_ID),
+            IIF(DELETING, OLD.DEVICE_ID, NEW.DEVICE_ID));
+
+    /* сессия перешла на другое устройство - устаревает и старый список */
+    IF (UPDATING AND OLD.DEVICE_ID IS DISTINCT FROM NEW.DEVICE_ID) THEN
+        INSERT INTO UDA_CHANGES (TABLE_NAME, ROW_ID, PARENT_ID)
+        VALUES ('RD2_SESSIONS', OLD.SESSION_ID, OLD.DEVICE_ID);
+
+    POST_EVENT 'UDA_CHANGED';
+END^
+
+/*
+ * Точки нужны только для снимков закрытых сессий. Вставка - обычный поток записи
+ * активной сессии, ее не журналируем: снимок строится только после закрытия.
+ *
+ * Триггер строчный, а снимку важна только сессия: массовый UPDATE/DELETE писал бы строку
+ * журнала на каждую точку. Сессии, уже записанные в этой транзакции, помечаются
+ * переменной контекста USER_TRANSACTION (сбрасывается при commit/rollback) - одна
+ * строка на сессию за транзакцию. Переменных на транзакцию не больше 1000, поэтому
+ * помечается не больше UDA_POINTS_MAX_TRACKED сессий; дальше строки пишутся без отсева.
+ */
+CREATE OR ALTER TRIGGER UDA_POINTS_CHANGED FOR RD2_POINTS
+AFTER UPDATE OR DELETE
+AS
+DECLARE VARIABLE SEEN VARCHAR(40);
+DECLARE VARIABLE TRACKED INTEGER;
+DECLARE VARIABLE UDA_POINTS_MAX_TRACKED INTEGER = 500;
+DECLARE VARIABLE DUMMY INTEGER;
+BEGIN
+    SEEN = 'UDA_POINTS_' || OLD.SESSION_ID;
+    IF (RDB$GET_CONTEXT('USER_TRANSACTION', SEEN) IS NOT NULL) THEN
+        EXIT;
+
+    INSERT INTO UDA_CHANGES (TABLE_NAME, ROW_ID, PARENT_ID)
+    VALUES ('RD2_POINTS', OLD.POINT_ID, OLD.SESSION_ID);
+    POST_EVENT 'UDA_CHANGED';
+
+    TRACKED = COALESCE(CAST(RDB$GET_CONTEXT('USER_TRANSACTION', 'UDA_POINTS_TRACKED') AS INTEGER), 0);
+    IF (TRACKED < UDA_POINTS_MAX_TRACKED) THEN
+    BEGIN
+        DUMMY = RDB$SET_CONTEXT('USER_TRANSACTION', SEEN, 1);
+        DUMMY = RDB$SET_CONTEXT('USER_TRANSACTION', 'UDA_POINTS_TRACKED', TRACKED + 1);
+    END
+END^
+
+/* любая DDL: колонки таблиц (SchemaCache) и все ответы сбрасываются целиком */
+CREATE OR ALTER TRIGGER UDA_SCHEMA_CHANGED
+AFTER ANY DDL STATEMENT
+AS
+BEGIN
+    POST_EVENT 'UDA_SCHEMA';
+END^
+
+CREATE OR ALTER PROCEDURE UDA_PURGE_CHANGES (KEEP_DAYS INTEGER)
+AS
+BEGIN
+    DELETE FROM UDA_CHANGES
+    WHERE CHANGED_AT < DATEADD(-:KEEP_DAYS DAY TO CURRENT_TIMESTAMP);
+END^
+
+SET TERM ; ^
+
+COMMIT;
@@ -0,0 +1,18 @@
+/*
+ * Проба отставания реплик uda (FirebirdRouter, UDA_DB_REPLICAS).
+ *
+ * Проба раз в пару секунд читает на primary и на каждой реплике монотонный счетчик
+ * (UDA_DB_LAG_QUERY, по умолчанию SELECT MAX(POINT_ID) FROM RD2_POINTS) и считает
+ * отставание реплики по тому, когда primary показывал такое же значение. Счетчик должен
+ * расти с основным потоком записи - вставкой точек - и реплицироваться вместе с ним.
+ *
+ * MAX() в Firebird берется из индекса, только если индекс убывающий; по первичному
+ * ключу (возрастающему) проба читала бы всю таблицу точек. Индекс нужен на primary
+ * и на всех репликах.
+ *
+ * Установка: isql -i uda_replica_lag.sql <база>
+ */
+
+CREATE DESCENDING INDEX UDA_POINTS_ID_DESC ON RD2_POINTS (POINT_ID);
+
+COMMIT;
@@ -0,0 +1,26 @@
+// Замена глобального operator new со счетчиком выделений (AllocStats).
+// Не входит в uda_core: линкуется в uda_bench и в uda с -DUDA_COUNT_ALLOCATIONS=ON.
+// Остальные формы new/delete по стандарту вызывают эти две, выровненные не трогаем.
+#include "alloc_stats.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+const bool hooks_enabled = (AllocStats::enableCounting(), true);
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    AllocStats::record();
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
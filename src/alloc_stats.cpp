@@ -0,0 +1,69 @@
+#include "alloc_stats.h"
+#include <array>
+#include <atomic>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// общий счетчик на каждое выделение стал бы точкой contention между потоками Crow:
+// потоки раскладываются по своим строкам кэша, сумма собирается при чтении
+constexpr size_t COUNTER_SHARDS = 64;
+
+struct alignas(64) Counter {
+    std::atomic<uint64_t> value{0};
+};
+
+std::array<Counter, COUNTER_SHARDS> counters;
+std::atomic<bool> hooked{false};
+std::atomic<size_t> nextShard{0};
+
+size_t shardIndex() {
+    thread_local const size_t index = nextShard.fetch_add(1, std::memory_order_relaxed) % COUNTER_SHARDS;
+    return index;
+}
+
+} // namespace
+
+void AllocStats::record() {
+    counters[shardIndex()].value.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocStats::enableCounting() {
+    hooked = true;
+}
+
+bool AllocStats::counting() {
+    return hooked;
+}
+
+uint64_t AllocStats::allocations() {
+    uint64_t total = 0;
+    for (const Counter& counter : counters) {
+        total += counter.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t AllocStats::peakRssBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS info;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info))) return 0;
+    return info.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);  // байты
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // килобайты
+#endif
+#endif
+}
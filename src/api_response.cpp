@@ -0,0 +1,398 @@
+#include "api_response.h"
+#include "request_arena.h"
+#include <optional>
+
+bool acceptsColumnar(const crow::request& req) {
+    return req.get_header_value("Accept").find(COLUMNAR_CONTENT_TYPE) != std::string::npos;
+}
+
+ContentEncoding acceptedEncoding(const crow::request& req) {
+    return negotiateEncoding(req.get_header_value("Accept-Encoding"));
+}
+
+// Spool-файл, в который тело попадает уже сжатым: кодер получает порции по мере генерации,
+// и сжатие идет параллельно с fetch, а не отдельным проходом по готовому файлу
+class EncodedSpool {
+private:
+    SpoolFile file;
+    ContentEncoding encoding;
+    const CompressionConfig& config;
+    std::unique_ptr<Compressor> compressor;  // создается при первой порции - маленьким ответам не нужен
+    std::string buffer;
+
+public:
+    EncodedSpool(ResultSpool& spool, const QueryOptions& opts)
+        : file(spool, opts.columnar ? ".udac" : ".json"), encoding(opts.encoding), config(opts.compression) {}
+
+    void write(const std::string& chunk) {
+        if (encoding == ContentEncoding::Identity) {
+            file.write(chunk);
+            return;
+        }
+        if (!compressor) {
+            compressor = Compressor::create(encoding, config);
+        }
+
+        // пустая порция тоже открывает файл: opened() означает, что тело ушло в spool
+        buffer.clear();
+        compressor->write(chunk, buffer);
+        file.write(buffer);
+    }
+
+    // дописывает хвост кодера; результат - путь и кодировка файла
+    void commit(QueryResult& result) {
+        if (compressor) {
+            buffer.clear();
+            compressor->finish(buffer);
+            file.write(buffer);
+            result.encoding = encoding;
+        }
+        result.static_file = file.commit();
+    }
+
+    bool opened() const { return file.opened(); }
+};
+
+// тело в памяти сжимается целиком, если оно не меньше порога
+static void encodeBody(QueryResult& result, const QueryOptions& opts) {
+    if (opts.encoding == ContentEncoding::Identity || opts.cacheable
+        || result.body.size() < opts.compression.min_size) {
+        return;
+    }
+    result.body = compressBody(opts.encoding, result.body, opts.compression);
+    result.encoding = opts.encoding;
+}
+
+// С spool большие выборки пишутся на диск порциями и отдаются Crow кусками с диска,
+// так что память не растет вместе с размером сессии. JSON уходит в файл по мере fetch;
+// колонки копятся до конца выборки, но сверх SPOOL_CHUNK сбрасываются во временный файл.
+QueryResult queryRows(PooledConnection& fbc, const std::string& query,
+                      const SqlParams& params, const QueryOptions& opts) {
+    // служебные буферы запроса - из арены, освобождаются разом в конце
+    RequestArena arena;
+    JsonWriter writer(opts.array, 4096, &arena);
+    ColumnarWriter columnar(&arena);
+
+    std::optional<EncodedSpool> file;
+    if (opts.spool) {
+        file.emplace(*opts.spool, opts);
+        if (opts.columnar) {
+            columnar.setSpill(SPOOL_CHUNK);
+        } else {
+            writer.setSink([&](const std::string& chunk) { file->write(chunk); }, SPOOL_CHUNK);
+        }
+    }
+
+    auto write = [&](const RowPlan& plan, const unsigned char* message) {
+        if (opts.columnar) {
+            columnar.writeRow(plan, message);
+        } else {
+            writer.writeRow(plan, message);
+        }
+    };
+
+    // размер ответа задает разрешение графика, а не длина сессии
+    std::optional<Downsampler> downsampler;
+    if (opts.downsample) {
+        downsampler.emplace(*opts.downsample, write, &arena);
+    }
+
+    const RowPlan* cursor_plan = nullptr;
+    int cursor_index = -1;
+    std::optional<int64_t> last_key;
+
+    size_t rows = fbc->fetch(query, params, [&](const RowPlan& plan, const unsigned char* message) {
+        if (downsampler) {
+            downsampler->add(plan, message);
+        } else {
+            write(plan, message);
+        }
+
+        if (!opts.cursor_column.empty()) {
+            if (cursor_plan != &plan) {
+                cursor_plan = &plan;
+                cursor_index = plan.find(opts.cursor_column);
+            }
+            if (cursor_index >= 0) {
+                last_key = RowPlan::integer(plan.getColumns()[cursor_index], message);
+            }
+        }
+    });
+
+    // план живет в кэше statement'ов подключения, которое мы все еще держим
+    if (downsampler) {
+        StageTimer timer(Stage::Serialize);
+        downsampler->finish();
+    }
+
+    RequestTrace::rows(rows);
+    QueryResult result;
+
+    // пустая страница при пагинации - это конец списка, а не ошибка
+    if (rows == 0 && opts.page_limit == 0) {
+        result.code = 404;
+        result.body = "Not found";
+        return result;
+    }
+
+    StageTimer timer(Stage::Serialize);
+    if (opts.columnar) {
+        result.content_type = COLUMNAR_CONTENT_TYPE;
+
+        // маленький ответ - из памяти, большой - порциями в spool, как JSON
+        if (file && columnar.spilled()) {
+            columnar.finish([&](const std::string& chunk) { file->write(chunk); }, SPOOL_CHUNK);
+            file->commit(result);
+        } else {
+            result.body = columnar.finish();
+            encodeBody(result, opts);
+        }
+    } else {
+        std::string& body = writer.finish();
+
+        if (file && file->opened()) {
+            file->commit(result);
+        } else {
+            result.body = std::move(body);
+            result.content_type = "application/json";
+            encodeBody(result, opts);
+        }
+    }
+
+    if (opts.page_limit && rows == opts.page_limit && last_key) {
+        result.next_cursor = std::to_string(*last_key);
+    }
+
+    return result;
+}
+
+static std::string flightKey(const std::string& query, const SqlParams& params, const QueryOptions& opts) {
+    std::string key = query;
+    for (const SqlParam& param : params) {
+        key.push_back('\x1f');
+        std::visit([&](const auto& value) {
+            using T = std::decay_t<decltype(value)>;
+            if constexpr (std::is_same_v<T, std::nullptr_t>) key += "null";
+            else if constexpr (std::is_same_v<T, std::string>) key += value;
+            else key += std::to_string(value);
+        }, param);
+    }
+    key.push_back('\x1e');
+    key.push_back(opts.array ? 'a' : 'o');
+    key.push_back(opts.columnar ? 'c' : 'j');
+    key.push_back(opts.spool ? 's' : 'm');
+    key.push_back(static_cast<char>('0' + static_cast<int>(opts.encoding)));
+    key.push_back(opts.cacheable ? 'k' : 'n');
+    key += opts.cursor_column;
+    if (opts.downsample) {
+        const DownsampleSpec& ds = *opts.downsample;
+        key.push_back('\x1e');
+        key += ds.method == DownsampleMethod::Lttb ? "lttb" : "minmax";
+        key += ':' + std::to_string(ds.points) + ':' + std::to_string(ds.total_rows)
+             + ':' + ds.x_column + ':' + ds.y_column;
+    }
+    return key;
+}
+
+SharedResult querySharedRows(QueryFlight& flight, FirebirdRouter& pool, const std::string& query,
+                             const SqlParams& params, const QueryOptions& opts) {
+    return querySharedRows(flight, pool, query, params, opts, [&](PooledConnection& fbc) {
+        return queryRows(fbc, query, params, opts);
+    });
+}
+
+SharedResult querySharedRows(QueryFlight& flight, FirebirdRouter& pool, const std::string& query,
+                             const SqlParams& params, const QueryOptions& opts,
+                             const std::function<QueryResult(PooledConnection&)>& produce) {
+    return flight.run(flightKey(query, params, opts), [&]() {
+        PooledConnection fbc = pool.acquire();
+        return std::make_shared<const QueryResult>(produce(fbc));
+    });
+}
+
+QueryResult snapshotRows(const Snapshot& snapshot, const QueryOptions& opts) {
+    const ColumnarReader& reader = snapshot.reader;
+    QueryResult result;
+
+    if (reader.rowCount() == 0) {
+        result.code = 404;
+        result.body = "Not found";
+        return result;
+    }
+
+    // файл снимка отдается как есть: сжатая копия на каждый снимок удвоила бы место на диске.
+    // Crow откроет файл уже после выхода из обработчика - к этому времени снимок могут вытеснить
+    // или пересобрать, поэтому ответ получает свою ссылку на файл в spool
+    if (opts.columnar) {
+        result.static_file = (opts.spool ? opts.spool->link(snapshot.path, ".udac") : snapshot.path).string();
+        result.content_type = COLUMNAR_CONTENT_TYPE;
+        return result;
+    }
+
+    std::optional<EncodedSpool> file;
+    if (opts.spool) {
+        file.emplace(*opts.spool, opts);
+    }
+
+    StageTimer timer(Stage::Serialize);
+    std::string out;
+    const uint64_t rows = opts.array ? reader.rowCount() : 1;
+    RequestTrace::rows(rows);
+    if (opts.array) out.push_back('[');
+
+    for (uint64_t row = 0; row < rows; row++) {
+        if (row > 0) out.push_back(',');
+        reader.appendJson(out, row);
+
+        if (file && out.size() >= SPOOL_CHUNK) {
+            file->write(out);
+            out.clear();
+        }
+    }
+    if (opts.array) out.push_back(']');
+
+    if (file && file->opened()) {
+        file->write(out);
+        file->commit(result);
+    } else {
+        result.body = std::move(out);
+        result.content_type = "application/json";
+        encodeBody(result, opts);
+    }
+    return result;
+}
+
+void toResponse(crow::response& res, const QueryResult& result) {
+    if (!result.static_file.empty()) {
+        res.set_static_file_info_unsafe(result.static_file);
+        if (!result.content_type.empty()) {
+            res.set_header("Content-Type", result.content_type);
+        }
+    } else {
+        res.code = result.code;
+        res.body = result.body;
+        if (!result.content_type.empty()) {
+            res.set_header("Content-Type", result.content_type);
+        }
+    }
+
+    if (result.encoding != ContentEncoding::Identity) {
+        res.set_header("Content-Encoding", encodingName(result.encoding));
+    }
+    // тело зависит от Accept-Encoding - промежуточные кэши не должны путать варианты
+    if (result.code == 200) {
+        res.set_header("Vary", "Accept-Encoding");
+    }
+
+    if (!result.next_cursor.empty()) {
+        res.set_header("X-Next-Cursor", result.next_cursor);
+    }
+}
+
+static void fromCache(crow::response& res, ResponseCache& cache, const std::string& key,
+                      const CachedResponse& cached, const crow::request& req) {
+    const ContentEncoding encoding = acceptedEncoding(req);
+    const bool compressed = cache.compresses(cached, encoding);
+
+    // у сжатого варианта свой ETag: "<хэш>-gzip"
+    std::string etag = cached.etag;
+    if (compressed) {
+        etag.insert(etag.size() - 1, std::string("-") + encodingName(encoding));
+    }
+    res.set_header("ETag", etag);
+    res.set_header("Vary", "Accept-Encoding");
+
+    // клиент уже держит эту версию - тело не нужно
+    const std::string& if_none_match = req.get_header_value("If-None-Match");
+    if (!if_none_match.empty()
+        && (if_none_match == "*" || if_none_match.find(etag) != std::string::npos)) {
+        res.code = 304;
+        return;
+    }
+
+    // сжатие - только когда тело действительно уходит клиенту
+    std::shared_ptr<const std::string> encoded = compressed ? cache.encoded(key, cached, encoding) : nullptr;
+
+    res.code = 200;
+    if (encoded) {
+        res.body = *encoded;
+        res.set_header("Content-Encoding", encodingName(encoding));
+    } else {
+        res.body = cached.body;
+    }
+    res.set_header("Content-Type", cached.content_type);
+    if (!cached.next_cursor.empty()) {
+        res.set_header("X-Next-Cursor", cached.next_cursor);
+    }
+}
+
+void cachedResponse(crow::response& res, ResponseCache& cache, const crow::request& req,
+                    const std::string& key, std::chrono::milliseconds ttl,
+                    const std::function<SharedResult()>& produce) {
+    std::shared_ptr<const CachedResponse> cached = cache.get(key);
+
+    if (!cached) {
+        const uint64_t generation = cache.generation();
+
+        // кэшируются только успешные несжатые ответы с телом в памяти
+        SharedResult result = produce();
+        if (result->code != 200 || result->body.empty() || result->encoding != ContentEncoding::Identity) {
+            toResponse(res, *result);
+            return;
+        }
+        cached = cache.put(key, result->body, result->content_type, ttl, result->next_cursor);
+
+        // пока шел запрос, данные поменялись - этот ответ отдаем, но не храним
+        if (cache.generation() != generation) {
+            cache.invalidate(key);
+        }
+    }
+
+    fromCache(res, cache, key, *cached, req);
+}
+
+// статус и размер тела берутся до end(): после него ответ принадлежит Crow
+static void endTraced(RequestTrace& trace, crow::response& res) {
+    const int status = res.code;
+    const uint64_t bytes = res.is_static_type() ? static_cast<uint64_t>(res.file_info.statbuf.st_size)
+                                                : res.body.size();
+    {
+        StageTimer timer(Stage::Send);
+        res.end();
+    }
+    trace.finish(status, bytes);
+}
+
+void respondAsync(DbExecutor& executor, MetricsRoute route, DbPriority priority, RouteTimeouts timeouts,
+                  crow::response& res, std::function<void(crow::response&)> handler) {
+    const auto queued = std::chrono::steady_clock::now();
+
+    bool accepted = executor.submit(priority, [&res, route, timeouts, queued, handler = std::move(handler)]() {
+        RequestTrace trace(route, queued);
+        RequestTrace::stage(Stage::Queue, std::chrono::steady_clock::now() - queued);
+
+        // срок считается от прихода запроса: время в очереди тоже входит
+        RequestDeadline deadline(timeouts, queued, [&res]() { return res.is_alive(); });
+
+        try {
+            deadline.check();
+            handler(res);
+        } catch (const QueryCancelled& e) {
+            res.code = 504;
+            res.body = e.what();
+        } catch (const std::exception& e) {
+            res.code = 500;
+            res.body = e.what();
+        }
+        endTraced(trace, res);
+    });
+
+    if (!accepted) {
+        // быстрый отказ лучше, чем ответ, который придет после таймаута клиента
+        RequestTrace trace(route, queued);
+        res.code = 503;
+        res.body = "Server is busy";
+        res.set_header("Retry-After", "1");
+        endTraced(trace, res);
+    }
+}
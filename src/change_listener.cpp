@@ -0,0 +1,274 @@
+#include "change_listener.h"
+#include "logger.h"
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+constexpr unsigned char EPB_VERSION1 = 1;
+
+// подписка, на которую еще не пришел callback, отменяется при выходе из listen()
+class QueuedEvents {
+private:
+  Firebird::IEvents* events;
+
+public:
+  explicit QueuedEvents(Firebird::IEvents* events) : events(events) {}
+
+  ~QueuedEvents() {
+      if (!events) return;
+
+      Firebird::IStatus* status = fb_get_master_interface()->getStatus();
+      try {
+          Firebird::ThrowStatusWrapper wrapper(status);
+          events->cancel(&wrapper);
+      } catch (const Firebird::FbException&) {
+          // attachment уже потерян - отменять нечего
+      }
+      status->dispose();
+      events->release();
+  }
+
+  QueuedEvents(const QueuedEvents&) = delete;
+  QueuedEvents& operator=(const QueuedEvents&) = delete;
+
+  // callback пришел - подписка отработала
+  void delivered() {
+      events->release();
+      events = nullptr;
+  }
+};
+
+} // namespace
+
+ChangeListener::ChangeListener(FBConnectionStruct conf, ChangeListenerConfig listener_conf,
+                               std::function<void(const ChangeEvent&)> on_change,
+                               std::function<void()> on_reset)
+    : config(std::move(listener_conf)),
+      conn(std::move(conf)),
+      onChange(std::move(on_change)),
+      onReset(std::move(on_reset)),
+      callback(*this) {
+    conn.setTransactionConfig({TxMode::SharedReadOnly});
+    thread = std::thread(&ChangeListener::run, this);
+}
+
+ChangeListener::~ChangeListener() {
+    {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ChangeListener::Callback::eventCallbackFunction(unsigned int length, const ISC_UCHAR* events) {
+    std::lock_guard<std::mutex> lock(listener.listenerMutex);
+    listener.delivered.assign(events, events + (events ? length : 0));
+    listener.fired = true;
+    listener.wakeUp.notify_all();
+}
+
+std::vector<unsigned char> ChangeListener::eventBlock() const {
+    // EPB: версия, затем для каждого события длина имени, имя и счетчик (4 байта, little-endian)
+    std::vector<unsigned char> epb = {EPB_VERSION1};
+    for (const std::string& name : {config.change_event, config.schema_event}) {
+        epb.push_back(static_cast<unsigned char>(name.size()));
+        epb.insert(epb.end(), name.begin(), name.end());
+        epb.insert(epb.end(), 4, 0);
+    }
+    return epb;
+}
+
+std::vector<uint32_t> ChangeListener::eventCounts(const std::vector<unsigned char>& epb) {
+    std::vector<uint32_t> counts;
+    size_t pos = 1;
+    while (pos < epb.size()) {
+        pos += 1 + epb[pos];
+        if (pos + 4 > epb.size()) break;
+
+        counts.push_back(static_cast<uint32_t>(epb[pos]) | static_cast<uint32_t>(epb[pos + 1]) << 8
+                         | static_cast<uint32_t>(epb[pos + 2]) << 16 | static_cast<uint32_t>(epb[pos + 3]) << 24);
+        pos += 4;
+    }
+    return counts;
+}
+
+void ChangeListener::run() {
+    std::unique_lock<std::mutex> lock(listenerMutex);
+    while (!stopping) {
+        lock.unlock();
+        try {
+            listen();
+        } catch (const std::exception& e) {
+            UDA_LOG_WARN("Change listener failed", {{"error", e.what()}});
+        }
+        subscribed = false;
+        lock.lock();
+
+        // пока слушателя нет, кэши живут по обычным TTL (active() == false)
+        wakeUp.wait_for(lock, config.reconnect_delay, [this] { return stopping; });
+    }
+}
+
+void ChangeListener::listen() {
+    if (!conn.connected() && !conn.reconnect()) {
+        throw std::runtime_error("Failed to connect to Firebird database");
+    }
+
+    if (!lastChange) {
+        startChanges();
+        caughtUp = true;
+    } else {
+        // после переподключения - все, что накопилось без событий
+        readChanges();
+    }
+
+    std::vector<unsigned char> epb = eventBlock();
+    // первый callback приносит текущие счетчики сервера, а не изменение
+    bool baseline = true;
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(listenerMutex);
+            if (stopping) return;
+            fired = false;
+        }
+
+        QueuedEvents events(conn.queEvents(&callback, epb));
+        subscribed = true;
+
+        std::vector<unsigned char> result;
+        {
+            std::unique_lock<std::mutex> lock(listenerMutex);
+            while (!fired && !stopping) {
+                if (!wakeUp.wait_for(lock, config.poll_interval, [this] { return fired || stopping; })) {
+                    // давно тихо - сверяемся с журналом; заодно проверяется attachment
+                    lock.unlock();
+                    readChanges();
+                    lock.lock();
+                }
+            }
+            if (!fired) return;
+            result.swap(delivered);
+        }
+        events.delivered();
+
+        if (result.empty()) {
+            throw std::runtime_error("Firebird event subscription was cancelled");
+        }
+
+        std::vector<uint32_t> before = eventCounts(epb);
+        std::vector<uint32_t> after = eventCounts(result);
+        // следующая подписка сработает на изменения после этих счетчиков
+        epb = std::move(result);
+
+        if (!baseline && before.size() == 2 && after.size() == 2 && before[1] != after[1]) {
+            onReset();
+        }
+        baseline = false;
+
+        readChanges();
+    }
+}
+
+void ChangeListener::startChanges() {
+    std::optional<int64_t> min_id;
+    int64_t max_id = 0;
+    conn.fetch("SELECT MIN(CHANGE_ID), MAX(CHANGE_ID) FROM " + config.changes_table, {},
+               [&](const RowPlan& plan, const unsigned char* message) {
+        min_id = RowPlan::integer(plan.getColumns()[0], message);
+        max_id = RowPlan::integer(plan.getColumns()[1], message).value_or(0);
+    });
+
+    std::optional<int64_t> saved = loadPosition();
+    if (saved && *saved <= max_id && (!min_id || *min_id <= *saved + 1)) {
+        // изменения за время простоя: снимки на диске могли устареть. Запас CHANGE_LOOKBACK
+        // разошлется повторно - лишняя инвалидация дешевле пропущенной
+        lastChange = *saved;
+        readChanges();
+        return;
+    }
+
+    // хвост журнала только запоминается, чтобы не разослать его повторно
+    lastChange = max_id;
+    readChanges(false);
+
+    // без сохраненной позиции (журнал почищен дальше нее или пересоздан) не узнать, что менялось без нас
+    if (!config.position_file.empty()) {
+        UDA_LOG_INFO("Change journal position unknown, resetting caches", {{"saved", saved.value_or(-1)}});
+        onReset();
+    }
+}
+
+std::optional<int64_t> ChangeListener::loadPosition() const {
+    if (config.position_file.empty()) return std::nullopt;
+
+    std::ifstream in(config.position_file);
+    int64_t position = 0;
+    if (!(in >> position)) return std::nullopt;
+    return position;
+}
+
+void ChangeListener::savePosition() const {
+    if (config.position_file.empty()) return;
+
+    // через временный файл и rename - после падения остается старая позиция, а не обрывок
+    std::filesystem::path tmp = config.position_file;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << *lastChange << '\n';
+        if (!out.flush()) {
+            UDA_LOG_WARN("Failed to save change journal position", {{"file", tmp.string()}});
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, config.position_file, ec);
+    if (ec) {
+        UDA_LOG_WARN("Failed to save change journal position", {{"file", config.position_file.string()}, {"error", ec.message()}});
+    }
+}
+
+void ChangeListener::readChanges(bool notify) {
+    const int64_t from = std::max<int64_t>(*lastChange - CHANGE_LOOKBACK, 0);
+    std::string query = "SELECT CHANGE_ID, TABLE_NAME, ROW_ID, PARENT_ID FROM " + config.changes_table
+                      + " WHERE CHANGE_ID > ? ORDER BY CHANGE_ID";
+
+    std::vector<ChangeEvent> changes;
+    const int64_t previous = *lastChange;
+    int64_t last = previous;
+
+    conn.fetch(query, {from}, [&](const RowPlan& plan, const unsigned char* message) {
+        const std::vector<FbColumn>& columns = plan.getColumns();
+
+        std::optional<int64_t> id = RowPlan::integer(columns[0], message);
+        if (!id || !recentChanges.insert(*id).second) return;
+        last = std::max(last, *id);
+
+        if (!notify) return;
+
+        ChangeEvent change;
+        change.table = std::string(RowPlan::text(columns[1], message));
+        change.row_id = RowPlan::integer(columns[2], message).value_or(0);
+        change.parent_id = RowPlan::integer(columns[3], message);
+        changes.push_back(std::move(change));
+    });
+
+    lastChange = last;
+    recentChanges.erase(recentChanges.begin(), recentChanges.upper_bound(last - CHANGE_LOOKBACK));
+
+    for (const ChangeEvent& change : changes) {
+        onChange(change);
+    }
+
+    // позиция сохраняется после обработчиков: упадем посреди - при старте разошлем заново
+    if (last != previous || !notify) {
+        savePosition();
+    }
+}
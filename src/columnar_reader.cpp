@@ -0,0 +1,225 @@
+#include "columnar_reader.h"
+#include "fb_format.h"
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+template <typename T>
+T load(const uint8_t* ptr) {
+    T value;
+    std::memcpy(&value, ptr, sizeof(T));  // данные в буфере не выровнены
+    return value;
+}
+
+template <typename T>
+void appendNumber(std::string& out, T value) {
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, end);
+}
+
+size_t fixedWidth(ColumnType type) {
+    switch (type) {
+        case ColumnType::Int32:
+        case ColumnType::Date32: return 4;
+        case ColumnType::Int64:
+        case ColumnType::Float64:
+        case ColumnType::Timestamp:
+        case ColumnType::Decimal64:
+        case ColumnType::Time64: return 8;
+        case ColumnType::Decimal128: return 16;
+        case ColumnType::Bool: return 1;
+        default: return 0;
+    }
+}
+
+} // namespace
+
+bool ColumnarReader::open(const uint8_t* data, size_t size, std::string& error) {
+    columns.clear();
+    rows = 0;
+
+    size_t pos = 0;
+    auto need = [&](uint64_t bytes) {
+        if (bytes > size - pos) {
+            error = "Truncated at offset " + std::to_string(pos);
+            return false;
+        }
+        return true;
+    };
+
+    // 1. Заголовок
+    if (!need(16)) return false;
+    if (std::memcmp(data, "UDAC", 4) != 0) {
+        error = "Bad magic";
+        return false;
+    }
+    uint16_t version = load<uint16_t>(data + 4);
+    if (version != 1) {
+        error = "Unsupported version " + std::to_string(version);
+        return false;
+    }
+    uint16_t count = load<uint16_t>(data + 6);
+    rows = load<uint64_t>(data + 8);
+    pos = 16;
+
+    // 2. Колонки
+    const uint64_t validity_len = (rows + 7) / 8;
+    columns.reserve(count);
+
+    for (uint16_t i = 0; i < count; i++) {
+        Column column;
+
+        if (!need(2)) return false;
+        uint16_t name_len = load<uint16_t>(data + pos);
+        pos += 2;
+        if (!need(name_len + 2u)) return false;
+        column.name.assign(reinterpret_cast<const char*>(data + pos), name_len);
+        pos += name_len;
+
+        column.type = static_cast<ColumnType>(data[pos]);
+        column.scale = static_cast<int8_t>(data[pos + 1]);
+        pos += 2;
+        if (column.type > ColumnType::Decimal128) {
+            error = "Unknown type of column " + column.name;
+            return false;
+        }
+
+        if (!need(validity_len)) return false;
+        column.validity = data + pos;
+        pos += validity_len;
+
+        if (!need(8)) return false;
+        uint64_t data_len = load<uint64_t>(data + pos);
+        pos += 8;
+        if (!need(data_len)) return false;
+
+        if (column.type == ColumnType::Utf8) {
+            uint64_t offsets_len = (rows + 1) * sizeof(uint32_t);
+            if (data_len < offsets_len) {
+                error = "Short offsets of column " + column.name;
+                return false;
+            }
+            column.offsets = data + pos;
+            column.data = data + pos + offsets_len;
+
+            // смещения не убывают и не выходят за данные
+            uint64_t bytes = data_len - offsets_len;
+            uint32_t prev = 0;
+            for (uint64_t row = 0; row <= rows; row++) {
+                uint32_t offset = load<uint32_t>(column.offsets + row * sizeof(uint32_t));
+                if (offset < prev || offset > bytes) {
+                    error = "Bad offsets of column " + column.name;
+                    return false;
+                }
+                prev = offset;
+            }
+
+            // десятичная запись уходит в JSON без кавычек - только символы числа
+            if (column.scale == COLUMNAR_SOURCE_DECFLOAT) {
+                const uint8_t* text = column.data;
+                for (uint64_t i = 0; i < prev; i++) {
+                    const uint8_t c = text[i];
+                    if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')) {
+                        error = "Bad decimal text in column " + column.name;
+                        return false;
+                    }
+                }
+            }
+        } else {
+            if (data_len != rows * fixedWidth(column.type)) {
+                error = "Bad data length of column " + column.name;
+                return false;
+            }
+            column.data = data + pos;
+        }
+        pos += data_len;
+
+        column.prefix = i == 0 ? "{" : ",";
+        JsonWriter::appendString(column.prefix, column.name.data(), column.name.size());
+        column.prefix.push_back(':');
+
+        columns.push_back(std::move(column));
+    }
+
+    if (pos != size) {
+        error = "Trailing bytes after last column";
+        return false;
+    }
+    return true;
+}
+
+void ColumnarReader::appendJson(std::string& out, uint64_t row) const {
+    if (columns.empty()) {
+        out += "{}";
+        return;
+    }
+
+    for (const Column& column : columns) {
+        out += column.prefix;
+
+        if (!isValid(column, row)) {
+            out += "null";
+            continue;
+        }
+
+        switch (column.type) {
+            case ColumnType::Int32:
+                appendNumber(out, load<int32_t>(column.data + row * 4));
+                break;
+            case ColumnType::Int64:
+                appendNumber(out, load<int64_t>(column.data + row * 8));
+                break;
+            case ColumnType::Decimal64:
+                appendDecimal(out, load<int64_t>(column.data + row * 8), column.scale);
+                break;
+            case ColumnType::Float64: {
+                double value = load<double>(column.data + row * 8);
+                if (!std::isfinite(value)) out += "null";
+                // float -> double -> float без потерь: та же запись, что у живого ответа
+                else if (column.scale == COLUMNAR_SOURCE_FLOAT32) appendNumber(out, static_cast<float>(value));
+                else appendNumber(out, value);
+                break;
+            }
+            case ColumnType::Timestamp: {
+                int64_t micros = load<int64_t>(column.data + row * 8);
+                out.push_back('"');
+                appendTimestamp(out, micros / 1000000 - (micros % 1000000 < 0));
+                out.push_back('"');
+                break;
+            }
+            case ColumnType::Date32:
+                out.push_back('"');
+                appendDate(out, load<int32_t>(column.data + row * 4));
+                out.push_back('"');
+                break;
+            case ColumnType::Time64:
+                out.push_back('"');
+                appendTimeOfDay(out, load<int64_t>(column.data + row * 8) / 1000000);
+                out.push_back('"');
+                break;
+            case ColumnType::Decimal128:
+                appendInt128(out, load<FB_I128>(column.data + row * 16), column.scale);
+                break;
+            case ColumnType::Bool:
+                out += column.data[row] ? "true" : "false";
+                break;
+            case ColumnType::Utf8: {
+                uint32_t begin = load<uint32_t>(column.offsets + row * sizeof(uint32_t));
+                uint32_t end = load<uint32_t>(column.offsets + (row + 1) * sizeof(uint32_t));
+                const char* text = reinterpret_cast<const char*>(column.data) + begin;
+                if (column.scale == COLUMNAR_SOURCE_DECFLOAT) out.append(end > begin ? std::string_view(text, end - begin) : "null");
+                else JsonWriter::appendString(out, text, end - begin);
+                break;
+            }
+            case ColumnType::Null:
+                out += "null";
+                break;
+        }
+    }
+
+    out.push_back('}');
+}
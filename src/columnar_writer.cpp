@@ -0,0 +1,319 @@
+#include "columnar_writer.h"
+#include "fb_format.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+static_assert(std::endian::native == std::endian::little,
+              "columnar format is written with native little-endian stores");
+
+namespace {
+
+template <typename T>
+void put(std::pmr::vector<uint8_t>& buf, T value) {
+    size_t pos = buf.size();
+    buf.resize(pos + sizeof(T));
+    std::memcpy(buf.data() + pos, &value, sizeof(T));
+}
+
+// смещения во временном файле больше 2 ГБ: на Windows long 32-битный
+bool seekTo(std::FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+// проверка, не пора ли сбросить буферы, - раз в столько строк (кратно 8: байты validity целые)
+constexpr uint64_t SPILL_CHECK_ROWS = 1024;
+
+} // namespace
+
+ColumnType ColumnarWriter::columnType(const FbColumn& col) {
+    switch (col.type) {
+        case SQL_SHORT:
+        case SQL_LONG:
+            return col.scale ? ColumnType::Decimal64 : ColumnType::Int32;
+        case SQL_INT64:
+            return col.scale ? ColumnType::Decimal64 : ColumnType::Int64;
+        case SQL_INT128:
+            return ColumnType::Decimal128;
+        case SQL_FLOAT:
+        case SQL_DOUBLE:
+            return ColumnType::Float64;
+        case SQL_TIMESTAMP:
+            return ColumnType::Timestamp;
+        case SQL_TYPE_DATE:
+            return ColumnType::Date32;
+        case SQL_TYPE_TIME:
+            return ColumnType::Time64;
+        case SQL_BOOLEAN:
+            return ColumnType::Bool;
+        case SQL_TEXT:
+        case SQL_VARYING:
+        case SQL_DEC16:
+        case SQL_DEC34:
+            return ColumnType::Utf8;
+        default:
+            return ColumnType::Null;
+    }
+}
+
+void ColumnarWriter::preparePlan(const RowPlan& row_plan) {
+    // план меняется только между запросами - колонки начинаем заново
+    plan = &row_plan;
+    columns.clear();
+    columns.reserve(row_plan.getColumns().size());
+    for (size_t i = 0; i < row_plan.getColumns().size(); i++) {
+        columns.emplace_back(resource);
+    }
+    rows = 0;
+    spillSize = 0;
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        const FbColumn& col = row_plan.getColumns()[i];
+        columns[i].type = columnType(col);
+        columns[i].scale = columns[i].type == ColumnType::Decimal64 || columns[i].type == ColumnType::Decimal128
+                           ? static_cast<int8_t>(col.scale) : 0;
+        if (col.type == SQL_FLOAT) {
+            columns[i].scale = COLUMNAR_SOURCE_FLOAT32;
+        } else if (col.type == SQL_DEC16 || col.type == SQL_DEC34) {
+            columns[i].scale = COLUMNAR_SOURCE_DECFLOAT;
+        }
+        if (columns[i].type == ColumnType::Utf8) {
+            columns[i].offsets.push_back(0);
+        }
+    }
+}
+
+void ColumnarWriter::writeRow(const RowPlan& row_plan, const unsigned char* message) {
+    if (plan != &row_plan) {
+        preparePlan(row_plan);
+    }
+
+    const std::vector<FbColumn>& fb_columns = row_plan.getColumns();
+    const size_t bit = rows & 7;
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        Column& column = columns[i];
+        const FbColumn& col = fb_columns[i];
+
+        if (bit == 0) {
+            column.validity.push_back(0);
+        }
+
+        bool present = !RowPlan::isNull(col, message) && column.type != ColumnType::Null;
+        if (present) {
+            column.validity.back() |= static_cast<uint8_t>(1u << bit);
+        }
+
+        const unsigned char* data = message + col.offset;
+
+        switch (column.type) {
+            case ColumnType::Int32:
+                put<int32_t>(column.data, !present ? 0
+                             : col.type == SQL_SHORT ? *reinterpret_cast<const int16_t*>(data)
+                                                     : *reinterpret_cast<const int32_t*>(data));
+                break;
+            case ColumnType::Int64:
+            case ColumnType::Decimal64: {
+                int64_t value = 0;
+                if (present) {
+                    if (col.type == SQL_SHORT) value = *reinterpret_cast<const int16_t*>(data);
+                    else if (col.type == SQL_LONG) value = *reinterpret_cast<const int32_t*>(data);
+                    else value = *reinterpret_cast<const int64_t*>(data);
+                }
+                put<int64_t>(column.data, value);
+                break;
+            }
+            case ColumnType::Float64:
+                put<double>(column.data, !present ? 0.0
+                            : col.type == SQL_FLOAT ? *reinterpret_cast<const float*>(data)
+                                                    : *reinterpret_cast<const double*>(data));
+                break;
+            case ColumnType::Timestamp: {
+                int64_t micros = 0;
+                if (present) {
+                    const ISC_TIMESTAMP* ts = reinterpret_cast<const ISC_TIMESTAMP*>(data);
+                    micros = (static_cast<int64_t>(ts->timestamp_date) - ISC_UNIX_EPOCH_DAYS) * 86400000000LL
+                           + static_cast<int64_t>(ts->timestamp_time) * 100;
+                }
+                put<int64_t>(column.data, micros);
+                break;
+            }
+            case ColumnType::Date32:
+                put<int32_t>(column.data, !present ? 0
+                             : static_cast<int32_t>(*reinterpret_cast<const ISC_DATE*>(data) - ISC_UNIX_EPOCH_DAYS));
+                break;
+            case ColumnType::Time64:
+                put<int64_t>(column.data, !present ? 0
+                             : static_cast<int64_t>(*reinterpret_cast<const ISC_TIME*>(data)) * 100);
+                break;
+            case ColumnType::Decimal128: {
+                FB_I128 value = {};
+                if (present) std::memcpy(&value, data, sizeof(value));
+                put<FB_I128>(column.data, value);
+                break;
+            }
+            case ColumnType::Bool:
+                column.data.push_back(present && *data ? 1 : 0);
+                break;
+            case ColumnType::Utf8: {
+                if (present && (col.type == SQL_DEC16 || col.type == SQL_DEC34)) {
+                    // DECFLOAT - точным текстом; NaN/Infinity - NULL
+                    std::string text;
+                    present = col.type == SQL_DEC16
+                        ? appendDecFloat16(text, *reinterpret_cast<const FB_DEC16*>(data))
+                        : appendDecFloat34(text, *reinterpret_cast<const FB_DEC34*>(data));
+                    column.data.insert(column.data.end(), text.begin(), text.end());
+                    if (!present) column.validity.back() &= static_cast<uint8_t>(~(1u << bit));
+                } else if (present) {
+                    std::string_view str = RowPlan::text(col, message);
+                    column.data.insert(column.data.end(), str.begin(), str.end());
+                }
+                column.offsets.push_back(static_cast<uint32_t>(column.spilledData.bytes + column.data.size()));
+                break;
+            }
+            case ColumnType::Null:
+                break;
+        }
+    }
+
+    rows++;
+
+    if (spillThreshold && rows % SPILL_CHECK_ROWS == 0 && buffered() >= spillThreshold) {
+        spill();
+    }
+}
+
+size_t ColumnarWriter::buffered() const {
+    size_t total = 0;
+    for (const Column& column : columns) {
+        total += column.validity.size() + column.data.size() + column.offsets.size() * sizeof(uint32_t);
+    }
+    return total;
+}
+
+void ColumnarWriter::spillBuffer(Spilled& spilled, const void* data, size_t size) {
+    if (size == 0) return;
+
+    if (!spillFile) {
+        spillFile.reset(std::tmpfile());
+        if (!spillFile) {
+            throw std::runtime_error("Cannot create columnar spill file");
+        }
+    }
+
+    if (!seekTo(spillFile.get(), spillSize) || std::fwrite(data, 1, size, spillFile.get()) != size) {
+        throw std::runtime_error("Failed to write columnar spill file");
+    }
+    spilled.segments.push_back({spillSize, size});
+    spilled.bytes += size;
+    spillSize += size;
+}
+
+void ColumnarWriter::spill() {
+    // емкость буферов остается - следующие строки пишутся без новых выделений
+    for (Column& column : columns) {
+        spillBuffer(column.spilledValidity, column.validity.data(), column.validity.size());
+        spillBuffer(column.spilledOffsets, column.offsets.data(), column.offsets.size() * sizeof(uint32_t));
+        spillBuffer(column.spilledData, column.data.data(), column.data.size());
+        column.validity.clear();
+        column.offsets.clear();
+        column.data.clear();
+    }
+}
+
+void ColumnarWriter::emitSpilled(const Spilled& spilled, const Emit& emit) {
+    if (spilled.segments.empty()) return;
+
+    std::fflush(spillFile.get());
+    std::vector<char> block(std::min<uint64_t>(spilled.bytes, 256 * 1024));
+
+    for (const Segment& segment : spilled.segments) {
+        if (!seekTo(spillFile.get(), segment.offset)) {
+            throw std::runtime_error("Failed to read columnar spill file");
+        }
+        uint64_t left = segment.length;
+        while (left > 0) {
+            size_t part = static_cast<size_t>(std::min<uint64_t>(left, block.size()));
+            if (std::fread(block.data(), 1, part, spillFile.get()) != part) {
+                throw std::runtime_error("Failed to read columnar spill file");
+            }
+            emit(block.data(), part);
+            left -= part;
+        }
+    }
+}
+
+void ColumnarWriter::writeBody(const Emit& emit) {
+    auto put = [&](auto value) {
+        emit(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+
+    emit("UDAC", 4);
+    put(uint16_t(1));
+    put(static_cast<uint16_t>(columns.size()));
+    put(rows);
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        const Column& column = columns[i];
+        const std::string& name = plan->getColumns()[i].name;
+
+        put(static_cast<uint16_t>(name.size()));
+        emit(name.data(), name.size());
+        put(static_cast<uint8_t>(column.type));
+        put(column.scale);
+        emitSpilled(column.spilledValidity, emit);
+        emit(reinterpret_cast<const char*>(column.validity.data()), column.validity.size());
+
+        const uint64_t data_bytes = column.spilledData.bytes + column.data.size();
+        if (column.type == ColumnType::Utf8) {
+            const size_t offsets_bytes = column.offsets.size() * sizeof(uint32_t);
+            put(uint64_t(column.spilledOffsets.bytes + offsets_bytes + data_bytes));
+            emitSpilled(column.spilledOffsets, emit);
+            emit(reinterpret_cast<const char*>(column.offsets.data()), offsets_bytes);
+        } else {
+            put(data_bytes);
+        }
+        emitSpilled(column.spilledData, emit);
+        emit(reinterpret_cast<const char*>(column.data.data()), column.data.size());
+    }
+}
+
+std::string ColumnarWriter::finish() {
+    size_t total = 16 + buffered();
+    for (const Column& column : columns) {
+        total += 32 + column.spilledValidity.bytes + column.spilledData.bytes + column.spilledOffsets.bytes;
+    }
+
+    std::string out;
+    out.reserve(total);
+    writeBody([&](const char* data, size_t size) { out.append(data, size); });
+    return out;
+}
+
+void ColumnarWriter::finish(const std::function<void(const std::string& chunk)>& sink, size_t chunk_size) {
+    std::string out;
+    out.reserve(chunk_size);
+
+    writeBody([&](const char* data, size_t size) {
+        while (size > 0) {
+            size_t part = std::min(size, chunk_size - out.size());
+            out.append(data, part);
+            data += part;
+            size -= part;
+
+            if (out.size() >= chunk_size) {
+                sink(out);
+                out.clear();
+            }
+        }
+    });
+
+    if (!out.empty()) {
+        sink(out);
+    }
+}
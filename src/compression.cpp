@@ -0,0 +1,260 @@
+#include "compression.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <zlib.h>
+
+#ifdef UDA_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef UDA_WITH_BROTLI
+#include <brotli/encode.h>
+#endif
+
+// сжатые данные дописываются в out блоками такого размера
+static constexpr size_t OUT_BLOCK = 64 * 1024;
+
+// Порядок при равном q - в порядке предпочтения
+static constexpr ContentEncoding SUPPORTED[] = {
+#ifdef UDA_WITH_ZSTD
+    ContentEncoding::Zstd,
+#endif
+#ifdef UDA_WITH_BROTLI
+    ContentEncoding::Brotli,
+#endif
+    ContentEncoding::Gzip,
+};
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+ContentEncoding negotiateEncoding(std::string_view accept_encoding) {
+    // q каждой кодировки из заголовка; -1 - не упомянута
+    double q[CONTENT_ENCODING_COUNT] = {-1, -1, -1, -1};
+    double any = -1;  // "*"
+
+    while (!accept_encoding.empty()) {
+        size_t comma = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, comma);
+        accept_encoding.remove_prefix(comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+        // "gzip;q=0.8"
+        double weight = 1;
+        size_t semicolon = item.find(';');
+        std::string_view name = trim(item.substr(0, semicolon));
+        if (semicolon != std::string_view::npos) {
+            std::string_view param = trim(item.substr(semicolon + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                weight = std::strtod(std::string(param.substr(2)).c_str(), nullptr);
+            }
+        }
+
+        if (name == "*") any = weight;
+        else if (equalsIgnoreCase(name, "gzip") || equalsIgnoreCase(name, "x-gzip")) q[static_cast<size_t>(ContentEncoding::Gzip)] = weight;
+        else if (equalsIgnoreCase(name, "zstd")) q[static_cast<size_t>(ContentEncoding::Zstd)] = weight;
+        else if (equalsIgnoreCase(name, "br")) q[static_cast<size_t>(ContentEncoding::Brotli)] = weight;
+    }
+
+    ContentEncoding best = ContentEncoding::Identity;
+    double best_q = 0;
+    for (ContentEncoding encoding : SUPPORTED) {
+        double weight = q[static_cast<size_t>(encoding)];
+        if (weight < 0) weight = any;
+        // q=0 - клиент явно отказался от кодировки
+        if (weight > best_q) {
+            best = encoding;
+            best_q = weight;
+        }
+    }
+    return best;
+}
+
+const char* encodingName(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip: return "gzip";
+        case ContentEncoding::Zstd: return "zstd";
+        case ContentEncoding::Brotli: return "br";
+        default: return "";
+    }
+}
+
+// Свободное место в конце out под очередной блок; после кодера лишнее отрезается
+static unsigned char* reserveBlock(std::string& out, size_t& used) {
+    used = out.size();
+    out.resize(used + OUT_BLOCK);
+    return reinterpret_cast<unsigned char*>(out.data() + used);
+}
+
+class GzipCompressor : public Compressor {
+private:
+    z_stream stream{};
+
+    void run(std::string_view chunk, std::string& out, int flush) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(chunk.data()));
+        stream.avail_in = static_cast<uInt>(chunk.size());
+
+        int rc;
+        do {
+            size_t used;
+            stream.next_out = reserveBlock(out, used);
+            stream.avail_out = static_cast<uInt>(OUT_BLOCK);
+
+            rc = deflate(&stream, flush);
+            if (rc == Z_STREAM_ERROR) {
+                throw std::runtime_error("gzip: deflate failed");
+            }
+            out.resize(used + OUT_BLOCK - stream.avail_out);
+        } while (stream.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+    }
+
+public:
+    explicit GzipCompressor(int level) {
+        // windowBits 15 + 16 - заголовок и CRC gzip вместо zlib
+        if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("gzip: deflateInit2 failed");
+        }
+    }
+
+    ~GzipCompressor() override {
+        deflateEnd(&stream);
+    }
+
+    void write(std::string_view chunk, std::string& out) override {
+        run(chunk, out, Z_NO_FLUSH);
+    }
+
+    void finish(std::string& out) override {
+        run({}, out, Z_FINISH);
+    }
+};
+
+#ifdef UDA_WITH_ZSTD
+class ZstdCompressor : public Compressor {
+private:
+    ZSTD_CCtx* context;
+
+    void run(std::string_view chunk, std::string& out, ZSTD_EndDirective mode) {
+        ZSTD_inBuffer in{chunk.data(), chunk.size(), 0};
+
+        size_t remaining;
+        do {
+            size_t used;
+            ZSTD_outBuffer block{reserveBlock(out, used), OUT_BLOCK, 0};
+
+            remaining = ZSTD_compressStream2(context, &block, &in, mode);
+            if (ZSTD_isError(remaining)) {
+                out.resize(used);
+                throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(remaining));
+            }
+            out.resize(used + block.pos);
+        } while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+    }
+
+public:
+    explicit ZstdCompressor(int level) : context(ZSTD_createCCtx()) {
+        if (!context) {
+            throw std::runtime_error("zstd: cannot create context");
+        }
+        ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+    }
+
+    ~ZstdCompressor() override {
+        ZSTD_freeCCtx(context);
+    }
+
+    void write(std::string_view chunk, std::string& out) override {
+        run(chunk, out, ZSTD_e_continue);
+    }
+
+    void finish(std::string& out) override {
+        run({}, out, ZSTD_e_end);
+    }
+};
+#endif
+
+#ifdef UDA_WITH_BROTLI
+class BrotliCompressor : public Compressor {
+private:
+    BrotliEncoderState* state;
+
+    void run(std::string_view chunk, std::string& out, BrotliEncoderOperation operation) {
+        size_t available_in = chunk.size();
+        const uint8_t* next_in = reinterpret_cast<const uint8_t*>(chunk.data());
+
+        do {
+            size_t used;
+            uint8_t* next_out = reserveBlock(out, used);
+            size_t available_out = OUT_BLOCK;
+
+            if (!BrotliEncoderCompressStream(state, operation, &available_in, &next_in,
+                                             &available_out, &next_out, nullptr)) {
+                out.resize(used);
+                throw std::runtime_error("brotli: compression failed");
+            }
+            out.resize(used + OUT_BLOCK - available_out);
+        } while (available_in > 0 || BrotliEncoderHasMoreOutput(state)
+                 || (operation == BROTLI_OPERATION_FINISH && !BrotliEncoderIsFinished(state)));
+    }
+
+public:
+    explicit BrotliCompressor(int level) : state(BrotliEncoderCreateInstance(nullptr, nullptr, nullptr)) {
+        if (!state) {
+            throw std::runtime_error("brotli: cannot create encoder");
+        }
+        BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, static_cast<uint32_t>(level));
+        BrotliEncoderSetParameter(state, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+    }
+
+    ~BrotliCompressor() override {
+        BrotliEncoderDestroyInstance(state);
+    }
+
+    void write(std::string_view chunk, std::string& out) override {
+        run(chunk, out, BROTLI_OPERATION_PROCESS);
+    }
+
+    void finish(std::string& out) override {
+        run({}, out, BROTLI_OPERATION_FINISH);
+    }
+};
+#endif
+
+std::unique_ptr<Compressor> Compressor::create(ContentEncoding encoding, const CompressionConfig& config) {
+    switch (encoding) {
+        case ContentEncoding::Gzip:
+            return std::make_unique<GzipCompressor>(config.gzip_level);
+#ifdef UDA_WITH_ZSTD
+        case ContentEncoding::Zstd:
+            return std::make_unique<ZstdCompressor>(config.zstd_level);
+#endif
+#ifdef UDA_WITH_BROTLI
+        case ContentEncoding::Brotli:
+            return std::make_unique<BrotliCompressor>(config.brotli_level);
+#endif
+        default:
+            throw std::runtime_error(std::string("Content encoding '") + encodingName(encoding) + "' is not available");
+    }
+}
+
+std::string compressBody(ContentEncoding encoding, std::string_view body, const CompressionConfig& config) {
+    std::unique_ptr<Compressor> compressor = Compressor::create(encoding, config);
+
+    std::string out;
+    // JSON точек сжимается в разы - с запасом на четверть исходного
+    out.reserve(body.size() / 4 + OUT_BLOCK);
+    compressor->write(body, out);
+    compressor->finish(out);
+    out.shrink_to_fit();
+    return out;
+}
@@ -0,0 +1,89 @@
+#include "db_executor.h"
+#include "logger.h"
+#include <algorithm>
+
+DbExecutor::DbExecutor(DbExecutorConfig conf) : config(conf) {
+    config.threads = std::max<size_t>(config.threads, 1);
+
+    workers.reserve(config.threads);
+    for (size_t i = 0; i < config.threads; i++) {
+        workers.emplace_back(&DbExecutor::worker, this);
+    }
+}
+
+DbExecutor::~DbExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+bool DbExecutor::submit(DbPriority priority, std::function<void()> task) {
+    auto index = static_cast<size_t>(priority);
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping || queues[index].size() >= config.queue_limits[index]) {
+            rejected++;
+            return false;
+        }
+        queues[index].push_back(std::move(task));
+    }
+
+    wakeUp.notify_one();
+    return true;
+}
+
+void DbExecutor::worker() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    while (true) {
+        wakeUp.wait(lock, [this] {
+            return stopping || std::any_of(queues.begin(), queues.end(),
+                                           [](const auto& queue) { return !queue.empty(); });
+        });
+
+        // при остановке дорабатываем то, что уже принято - ответы должны завершиться
+        auto queue = std::find_if(queues.begin(), queues.end(),
+                                  [](const auto& q) { return !q.empty(); });
+        if (queue == queues.end()) {
+            return;  // stopping и очереди пусты
+        }
+
+        // сначала более высокий приоритет
+        std::function<void()> task = std::move(queue->front());
+        queue->pop_front();
+        active++;
+        lock.unlock();
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            UDA_LOG_ERROR("DB executor task failed", {{"error", e.what()}});
+        } catch (...) {
+            UDA_LOG_ERROR("DB executor task failed");
+        }
+
+        lock.lock();
+        active--;
+        completed++;
+    }
+}
+
+DbExecutorStats DbExecutor::stats() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
+
+    DbExecutorStats result;
+    for (size_t i = 0; i < DB_PRIORITIES; i++) {
+        result.queued[i] = queues[i].size();
+    }
+    result.active = active;
+    result.completed = completed;
+    result.rejected = rejected;
+    return result;
+}
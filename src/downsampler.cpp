@@ -0,0 +1,367 @@
+#include "downsampler.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+std::optional<DownsampleSpec> parseDownsample(const char* points, const char* method,
+                                              const char* x_column, const char* y_column) {
+    if (!points) return std::nullopt;
+
+    DownsampleSpec spec;
+
+    char* end = nullptr;
+    long long value = std::strtoll(points, &end, 10);
+    if (end == points || *end != '\0' || value < 3
+        || static_cast<unsigned long long>(value) > MAX_DOWNSAMPLE_POINTS) {
+        throw std::invalid_argument("downsample must be an integer from 3 to "
+                                    + std::to_string(MAX_DOWNSAMPLE_POINTS));
+    }
+    spec.points = static_cast<size_t>(value);
+
+    std::string name = method ? method : "lttb";
+    if (name == "lttb") {
+        spec.method = DownsampleMethod::Lttb;
+    } else if (name == "minmax") {
+        spec.method = DownsampleMethod::MinMax;
+    } else {
+        throw std::invalid_argument("method must be lttb or minmax");
+    }
+
+    if (!y_column || !*y_column) {
+        throw std::invalid_argument("downsample requires y=<column>");
+    }
+    spec.y_column = y_column;
+    if (x_column && *x_column) {
+        spec.x_column = x_column;
+    }
+
+    // имена колонок в метаданных - в верхнем регистре
+    auto upper = [](std::string& str) {
+        std::transform(str.begin(), str.end(), str.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    };
+    upper(spec.x_column);
+    upper(spec.y_column);
+
+    return spec;
+}
+
+void minMaxBlock(const double* values, size_t count, size_t& min_index, size_t& max_index) {
+    min_index = max_index = 0;
+    if (count == 0) return;
+
+    // 1. Значения: LANES независимых аккумуляторов, сравнение через select -
+    //    нет зависимости между итерациями и нет ветвлений
+    constexpr size_t LANES = 8;
+    double lo[LANES];
+    double hi[LANES];
+    std::fill(lo, lo + LANES, values[0]);
+    std::fill(hi, hi + LANES, values[0]);
+
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        for (size_t lane = 0; lane < LANES; lane++) {
+            double v = values[i + lane];
+            lo[lane] = v < lo[lane] ? v : lo[lane];
+            hi[lane] = v > hi[lane] ? v : hi[lane];
+        }
+    }
+
+    double min_value = lo[0];
+    double max_value = hi[0];
+    for (size_t lane = 1; lane < LANES; lane++) {
+        min_value = std::min(min_value, lo[lane]);
+        max_value = std::max(max_value, hi[lane]);
+    }
+    for (; i < count; i++) {
+        min_value = std::min(min_value, values[i]);
+        max_value = std::max(max_value, values[i]);
+    }
+
+    // 2. Индексы - первые вхождения найденных значений
+    min_index = static_cast<size_t>(std::find(values, values + count, min_value) - values);
+    max_index = static_cast<size_t>(std::find(values, values + count, max_value) - values);
+}
+
+Downsampler::Downsampler(DownsampleSpec spec, RowHandler emit, std::pmr::memory_resource* resource)
+    : spec(std::move(spec)), emit(std::move(emit)),
+      slotData(resource), slotRefs(resource), freeSlots(resource),
+      pending(resource), current(resource),
+      blockValues(resource), blockOrdinals(resource), blockMessages(resource),
+      minMessage(resource), maxMessage(resource) {}
+
+void Downsampler::init(const RowPlan& row_plan) {
+    plan = &row_plan;
+    messageLength = row_plan.getMessageLength();
+
+    xIndex = row_plan.find(spec.x_column);
+    yIndex = row_plan.find(spec.y_column);
+    if (yIndex < 0 || (spec.method == DownsampleMethod::Lttb && xIndex < 0)) {
+        throw std::runtime_error("Downsample column is missing from the result");
+    }
+
+    // строк и так не больше, чем просили
+    passThrough = spec.total_rows <= spec.points;
+
+    if (spec.method == DownsampleMethod::Lttb) {
+        // первая и последняя строки - отдельно, остальные делятся на points - 2 корзины
+        buckets = spec.points - 2;
+    } else {
+        // по две строки (min и max) на корзину
+        buckets = spec.points / 2;
+        blockValues.reserve(BLOCK);
+        blockOrdinals.reserve(BLOCK);
+        blockMessages.reserve(BLOCK * messageLength);
+        minMessage.resize(messageLength);
+        maxMessage.resize(messageLength);
+    }
+}
+
+void Downsampler::add(const RowPlan& row_plan, const unsigned char* message) {
+    if (!plan) init(row_plan);
+
+    if (passThrough) {
+        emit(row_plan, message);
+        return;
+    }
+
+    // строки, вставленные после COUNT(*), в корзины уже не попадают
+    if (ordinal >= spec.total_rows) return;
+
+    std::optional<double> y = RowPlan::number(plan->getColumns()[yIndex], message);
+    if (!y || std::isnan(*y)) return;
+
+    if (spec.method == DownsampleMethod::Lttb) {
+        double x = RowPlan::number(plan->getColumns()[xIndex], message).value_or(lastX);
+        // оболочка строится в порядке x: отступающие назад значения прижимаем
+        if (ordinal > 0) x = std::max(x, lastX);
+        lastX = x;
+        addLttb(x, *y, message);
+    } else {
+        addMinMax(*y, message);
+    }
+
+    ordinal++;
+}
+
+void Downsampler::finish() {
+    if (!plan || passThrough) return;
+
+    if (spec.method == DownsampleMethod::MinMax) {
+        flushBlock();
+        emitBucket();
+        return;
+    }
+
+    // строк пришло меньше, чем насчитал COUNT(*) - последней строки не было,
+    // вместо нее берется среднее последней корзины
+    if (pending.count) {
+        const Hull& next = current.count ? current : pending;
+        selectFrom(pending, next.sumX / next.count, next.sumY / next.count);
+    }
+    if (current.count) {
+        selectFrom(current, current.sumX / current.count, current.sumY / current.count);
+    }
+}
+
+size_t Downsampler::acquireSlot(const unsigned char* message) {
+    size_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = slotRefs.size();
+        slotRefs.push_back(0);
+        slotData.resize(slotData.size() + messageLength);
+    }
+
+    std::memcpy(slotData.data() + slot * messageLength, message, messageLength);
+    slotRefs[slot] = 0;
+    return slot;
+}
+
+void Downsampler::releaseSlot(size_t slot) {
+    if (--slotRefs[slot] == 0) {
+        freeSlots.push_back(slot);
+    }
+}
+
+void Downsampler::addLttb(double x, double y, const unsigned char* message) {
+    // 1. Первая строка выводится всегда
+    if (ordinal == 0) {
+        emit(*plan, message);
+        anchorX = x;
+        anchorY = y;
+        return;
+    }
+
+    // 2. Последняя строка: закрываем обе корзины и выводим ее саму
+    if (ordinal == spec.total_rows - 1) {
+        if (pending.count) {
+            if (current.count) {
+                selectFrom(pending, current.sumX / current.count, current.sumY / current.count);
+            } else {
+                selectFrom(pending, x, y);
+            }
+        }
+        if (current.count) {
+            selectFrom(current, x, y);
+        }
+        emit(*plan, message);
+        return;
+    }
+
+    // 3. Корзина закончилась - теперь известно ее среднее и можно выбрать точку из предыдущей
+    size_t b = static_cast<size_t>((ordinal - 1) * buckets / (spec.total_rows - 2));
+    if (b != bucket && current.count) {
+        if (pending.count) {
+            selectFrom(pending, current.sumX / current.count, current.sumY / current.count);
+        }
+        std::swap(pending, current);
+    }
+    bucket = b;
+
+    pushHull(current, x, y, message);
+}
+
+void Downsampler::pushHull(Hull& hull, double x, double y, const unsigned char* message) {
+    hull.sumX += x;
+    hull.sumY += y;
+    hull.count++;
+
+    auto cross = [](const Vertex& o, const Vertex& a, double bx, double by) {
+        return (a.x - o.x) * (by - o.y) - (a.y - o.y) * (bx - o.x);
+    };
+
+    // При равном x (повтор времени или x, прижатый к lastX) в нижней цепочке остается
+    // вершина с меньшим y, в верхней - с большим: поворот между ними нулевой, и общий
+    // цикл ниже выбросил бы экстремум, а не промежуточную точку
+    const bool to_lower = hull.lower.empty() || hull.lower.back().x != x || y < hull.lower.back().y;
+    const bool to_upper = hull.upper.empty() || hull.upper.back().x != x || y > hull.upper.back().y;
+    if (!to_lower && !to_upper) return;
+
+    // точки, ушедшие внутрь оболочки, уже никогда не дадут максимум площади
+    size_t slot = acquireSlot(message);
+
+    if (to_lower) {
+        if (!hull.lower.empty() && hull.lower.back().x == x) {
+            releaseSlot(hull.lower.back().slot);
+            hull.lower.pop_back();
+        }
+        while (hull.lower.size() >= 2
+               && cross(hull.lower[hull.lower.size() - 2], hull.lower.back(), x, y) <= 0) {
+            releaseSlot(hull.lower.back().slot);
+            hull.lower.pop_back();
+        }
+        hull.lower.push_back({x, y, slot});
+        slotRefs[slot]++;
+    }
+
+    if (to_upper) {
+        if (!hull.upper.empty() && hull.upper.back().x == x) {
+            releaseSlot(hull.upper.back().slot);
+            hull.upper.pop_back();
+        }
+        while (hull.upper.size() >= 2
+               && cross(hull.upper[hull.upper.size() - 2], hull.upper.back(), x, y) >= 0) {
+            releaseSlot(hull.upper.back().slot);
+            hull.upper.pop_back();
+        }
+        hull.upper.push_back({x, y, slot});
+        slotRefs[slot]++;
+    }
+}
+
+void Downsampler::selectFrom(Hull& hull, double next_x, double next_y) {
+    // площадь треугольника (anchor, v, next) - линейна по v, максимум на вершине оболочки
+    const Vertex* best = nullptr;
+    double best_area = -1;
+    for (const std::pmr::vector<Vertex>* chain : {&hull.lower, &hull.upper}) {
+        for (const Vertex& v : *chain) {
+            double area = std::fabs((anchorX - next_x) * (v.y - anchorY)
+                                    - (anchorX - v.x) * (next_y - anchorY));
+            if (area > best_area) {
+                best_area = area;
+                best = &v;
+            }
+        }
+    }
+
+    if (best) {
+        emit(*plan, slotMessage(best->slot));
+        anchorX = best->x;
+        anchorY = best->y;
+    }
+
+    clearHull(hull);
+}
+
+void Downsampler::clearHull(Hull& hull) {
+    for (const Vertex& v : hull.lower) releaseSlot(v.slot);
+    for (const Vertex& v : hull.upper) releaseSlot(v.slot);
+    hull.lower.clear();
+    hull.upper.clear();
+    hull.sumX = hull.sumY = 0;
+    hull.count = 0;
+}
+
+void Downsampler::addMinMax(double y, const unsigned char* message) {
+    size_t b = static_cast<size_t>(ordinal * buckets / spec.total_rows);
+    if (b != bucket) {
+        flushBlock();
+        emitBucket();
+        bucket = b;
+    }
+
+    blockValues.push_back(y);
+    blockOrdinals.push_back(ordinal);
+    blockMessages.insert(blockMessages.end(), message, message + messageLength);
+
+    if (blockValues.size() == BLOCK) {
+        flushBlock();
+    }
+}
+
+void Downsampler::flushBlock() {
+    if (blockValues.empty()) return;
+
+    size_t lo, hi;
+    minMaxBlock(blockValues.data(), blockValues.size(), lo, hi);
+
+    // строгое сравнение: при равенстве остается более ранняя строка
+    if (!hasBucketValue || blockValues[lo] < minValue) {
+        minValue = blockValues[lo];
+        minOrdinal = blockOrdinals[lo];
+        std::memcpy(minMessage.data(), blockMessages.data() + lo * messageLength, messageLength);
+    }
+    if (!hasBucketValue || blockValues[hi] > maxValue) {
+        maxValue = blockValues[hi];
+        maxOrdinal = blockOrdinals[hi];
+        std::memcpy(maxMessage.data(), blockMessages.data() + hi * messageLength, messageLength);
+    }
+    hasBucketValue = true;
+
+    blockValues.clear();
+    blockOrdinals.clear();
+    blockMessages.clear();
+}
+
+void Downsampler::emitBucket() {
+    if (!hasBucketValue) return;
+
+    // в исходном порядке строк
+    if (minOrdinal == maxOrdinal) {
+        emit(*plan, minMessage.data());
+    } else if (minOrdinal < maxOrdinal) {
+        emit(*plan, minMessage.data());
+        emit(*plan, maxMessage.data());
+    } else {
+        emit(*plan, maxMessage.data());
+        emit(*plan, minMessage.data());
+    }
+
+    hasBucketValue = false;
+}
@@ -1,9 +1,50 @@
 #include "fb_connect.h"
+#include "logger.h"
+#include "metrics.h"
+#include "query_deadline.h"
+#include <algorithm>
 #include <format>
 #include <sstream>
 #include <utility>
 
-std::mutex FirebirdConnection::fb_mutex_;
+namespace {
+
+// в fetch время обработчика строк замеряется на каждой такой строке
+constexpr size_t SERIALIZE_SAMPLE = 16;
+
+// isc_cancelled и причины срабатывания таймаутов statement'ов (Firebird 4+)
+bool isCancelError(const ISC_STATUS* errors) {
+    if (!errors) return false;
+
+    for (size_t i = 0; errors[i] != isc_arg_end;) {
+        if (errors[i] == isc_arg_gds) {
+            switch (errors[i + 1]) {
+                case 335544794: // isc_cancelled
+                case 335545247: // isc_cfg_stmt_timeout
+                case 335545248: // isc_att_stmt_timeout
+                case 335545249: // isc_req_stmt_timeout
+                    return true;
+            }
+        }
+        i += errors[i] == isc_arg_cstring ? 3 : 2;
+    }
+    return false;
+}
+
+// счетчик ошибок по коду gds для /metrics
+// код gds первой ошибки статус-вектора (0 - нет)
+int64_t statusCode(const Firebird::FbException& e) {
+    const ISC_STATUS* errors = e.getStatus() ? e.getStatus()->getErrors() : nullptr;
+    return errors && errors[0] == 1 ? static_cast<int64_t>(errors[1]) : 0;
+}
+
+void countErrors(const Firebird::FbException& e) {
+    if (int64_t code = statusCode(e)) {
+        Metrics::firebirdError(static_cast<intptr_t>(code));
+    }
+}
+
+} // namespace
 
 void FirebirdConnection::fbInit() {
     using namespace Firebird;
@@ -32,13 +73,13 @@ void FirebirdConnection::fbInit() {
             throw std::runtime_error("Failed to create DPB builder");
         }
 
-        std::cout << "Firebird API initialized successfully" << std::endl;
+        UDA_LOG_DEBUG("Firebird API initialized");
 
     } catch (const FbException& e) {
-        std::cerr << "Firebird initialization failed: " << e.getStatus() << std::endl;
+        UDA_LOG_ERROR("Firebird initialization failed", {{"gds", statusCode(e)}});
         throw;
     } catch (const std::exception& e) {
-        std::cerr << "Initialization error: " << e.what() << std::endl;
+        UDA_LOG_ERROR("Firebird initialization failed", {{"error", e.what()}});
         throw;
     }
 }
@@ -75,7 +116,7 @@ bool FirebirdConnection::connect() {
     using namespace Firebird;
 
     if (!rawStatus || !dpb || !master) {
-        std::cerr << "Firebird not properly initialized" << std::endl;
+        UDA_LOG_ERROR("Firebird not properly initialized");
         return false;
     }
 
@@ -90,8 +131,10 @@ bool FirebirdConnection::connect() {
         dpb->insertString(&status, isc_dpb_password, config.db_password.c_str());
         dpb->insertInt(&status, isc_dpb_sql_dialect, 3);
 
-        // connection string
-        std::string connection_string = config.db_host + "/" + config.db_port + ":" + config.db_path;
+        // connection string; без хоста - embedded (локальная база, например для uda_bench)
+        std::string connection_string = config.db_host.empty()
+            ? config.db_path
+            : config.db_host + "/" + config.db_port + ":" + config.db_path;
 
         // getting provider interface
         provider = master->getDispatcher();
@@ -106,19 +149,24 @@ bool FirebirdConnection::connect() {
             dpb->getBuffer(&status));
 
         if (attachment) {
+            if (statementTimeout.count() > 0) {
+                attachment->setStatementTimeout(&status, static_cast<unsigned int>(statementTimeout.count()));
+            }
+
             isConnected = true;
-            std::cout << "Connected to database successfully" << std::endl;
+            UDA_LOG_INFO("connected", {{"db", connection_string}});
             return true;
         } else {
             throw std::runtime_error("Failed to attach database");
         }
 
     } catch (const FbException& e) {
-        std::cerr << "Firebird connection error: " << e.getStatus() << std::endl;
+        countErrors(e);
+        UDA_LOG_ERROR("Firebird connection failed", {{"db", config.db_path}, {"gds", statusCode(e)}});
         isConnected = false;
         return false;
     } catch (const std::exception& e) {
-        std::cerr << "Connection error: " << e.what() << std::endl;
+        UDA_LOG_ERROR("Firebird connection failed", {{"db", config.db_path}, {"error", e.what()}});
         isConnected = false;
         return false;
     }
@@ -127,6 +175,9 @@ bool FirebirdConnection::connect() {
 void FirebirdConnection::disconnect() {
     if (!isConnected) return;
 
+    endSharedTransaction(true);
+    clearStatements();
+
     if (attachment) {
         try {
             Firebird::ThrowStatusWrapper status(rawStatus);
@@ -140,216 +191,562 @@ void FirebirdConnection::disconnect() {
 
     provider = nullptr;
     isConnected = false;
-    std::cout << "Disconnected from database" << std::endl;
+    UDA_LOG_INFO("disconnected", {{"db", config.db_path}});
 }
 
-std::vector<crow::json::wvalue> FirebirdConnection::getSQL(const std::string& query) {
-    using namespace Firebird;
+bool FirebirdConnection::reconnect() {
+    disconnect();
+    isHealthy = true;
+    return connect();
+}
+
+bool FirebirdConnection::ping() {
+    if (!isConnected || !attachment) return false;
+
+    try {
+        Firebird::ThrowStatusWrapper status(rawStatus);
+        attachment->ping(&status);
+        return true;
+    } catch (const Firebird::FbException& e) {
+        countErrors(e);
+        UDA_LOG_WARN("Firebird ping failed, attachment is broken", {{"gds", statusCode(e)}});
+        isHealthy = false;
+        return false;
+    }
+}
+
+void FirebirdConnection::setStatementTimeout(std::chrono::milliseconds timeout) {
+    statementTimeout = timeout;
+    if (!isConnected || !attachment) return;
+
+    try {
+        Firebird::ThrowStatusWrapper status(rawStatus);
+        attachment->setStatementTimeout(&status, static_cast<unsigned int>(timeout.count()));
+    } catch (const Firebird::FbException& e) {
+        countErrors(e);
+        UDA_LOG_WARN("Failed to set statement timeout", {{"gds", statusCode(e)}});
+    }
+}
+
+void FirebirdConnection::cancel() {
+    if (!master || !attachment) return;
+
+    // свой статус: rawStatus в это время использует поток, выполняющий запрос
+    Firebird::IStatus* cancelStatus = master->getStatus();
+    try {
+        Firebird::ThrowStatusWrapper status(cancelStatus);
+        attachment->cancelOperation(&status, fb_cancel_raise);
+    } catch (const Firebird::FbException&) {
+        // запрос уже закончился - отменять нечего
+    }
+    cancelStatus->dispose();
+}
 
-    std::lock_guard<std::mutex> lock(fb_mutex_);
+void FirebirdConnection::resetCancel() {
+    if (!attachment) return;
 
+    // fb_cancel_enable после fb_cancel_disable сбрасывает и отложенный fb_cancel_raise
+    try {
+        Firebird::ThrowStatusWrapper status(rawStatus);
+        attachment->cancelOperation(&status, fb_cancel_disable);
+        attachment->cancelOperation(&status, fb_cancel_enable);
+    } catch (const Firebird::FbException& e) {
+        countErrors(e);
+        isHealthy = false;  // состояние attachment'а неизвестно - пул переподключит
+    }
+}
+
+Firebird::IEvents* FirebirdConnection::queEvents(Firebird::IEventCallback* callback,
+                                                const std::vector<unsigned char>& epb) {
     if (!isConnected || !attachment) {
         throw std::runtime_error("FirebirdConnection is not connected");
     }
 
+    try {
+        Firebird::ThrowStatusWrapper status(rawStatus);
+        return attachment->queEvents(&status, callback, static_cast<unsigned int>(epb.size()), epb.data());
+    } catch (const Firebird::FbException& e) {
+        countErrors(e);
+        if (e.getStatus() && isNetworkError(e.getStatus()->getErrors())) {
+            isHealthy = false;
+        }
+        throw std::runtime_error("Failed to subscribe to Firebird events");
+    }
+}
+
+void FirebirdConnection::setTransactionConfig(const FBTxConfig& conf) {
+    if (conf.mode != txConfig.mode) {
+        endSharedTransaction(true);
+    }
+    txConfig = conf;
+}
+
+Firebird::ITransaction* FirebirdConnection::startSharedTransaction(Firebird::ThrowStatusWrapper& status) {
+    using namespace Firebird;
+
+    // пересоздаем по возрасту/числу запросов, чтобы транзакция не жила бесконечно
+    if (sharedTx && (std::chrono::steady_clock::now() - sharedTxStarted > txConfig.max_age
+                     || sharedTxQueries >= txConfig.max_queries)) {
+        endSharedTransaction(true);
+    }
+
+    if (!sharedTx) {
+        IXpbBuilder* tpb = utl->getXpbBuilder(&status, IXpbBuilder::TPB, nullptr, 0);
+        try {
+            tpb->insertTag(&status, isc_tpb_read);
+            tpb->insertTag(&status, isc_tpb_read_committed);
+#ifdef isc_tpb_read_consistency
+            tpb->insertTag(&status, isc_tpb_read_consistency);
+#else
+            tpb->insertTag(&status, isc_tpb_rec_version);
+#endif
+            tpb->insertTag(&status, isc_tpb_wait);
+
+            sharedTx = attachment->startTransaction(&status, tpb->getBufferLength(&status),
+                                                    tpb->getBuffer(&status));
+        } catch (...) {
+            tpb->dispose();
+            throw;
+        }
+        tpb->dispose();
+
+        sharedTxStarted = std::chrono::steady_clock::now();
+        sharedTxQueries = 0;
+    }
+
+    sharedTxQueries++;
+    return sharedTx;
+}
+
+void FirebirdConnection::endSharedTransaction(bool commit) {
+    if (!sharedTx) return;
+
+    try {
+        Firebird::IStatus* txStatus = master->getStatus();
+        Firebird::ThrowStatusWrapper wrapper(txStatus);
+        try {
+            // commit/rollback освобождают интерфейс при успехе
+            if (commit) {
+                sharedTx->commit(&wrapper);
+            } else {
+                sharedTx->rollback(&wrapper);
+            }
+            sharedTx = nullptr;
+        } catch (...) {
+            txStatus->dispose();
+            throw;
+        }
+        txStatus->dispose();
+    } catch (...) {
+        // транзакция уже недействительна (например, обрыв связи) - просто отпускаем
+        sharedTx->release();
+        sharedTx = nullptr;
+    }
+}
+
+bool FirebirdConnection::isNetworkError(const ISC_STATUS* errors) {
+    if (!errors || errors[0] != 1) return false;
+
+    switch (errors[1]) {
+        case 335544721: // isc_network_error
+        case 335544726: // isc_net_read_err
+        case 335544727: // isc_net_write_err
+        case 335544741: // isc_lost_db_connection
+        case 335544856: // isc_att_shutdown
+            return true;
+        default:
+            return false;
+    }
+}
+
+FirebirdConnection::CachedStatement& FirebirdConnection::prepareCached(Firebird::ThrowStatusWrapper& status,
+                                                                      Firebird::ITransaction* transaction,
+                                                                      const std::string& query) {
+    auto it = statements.find(query);
+    if (it != statements.end()) {
+        statementsLru.splice(statementsLru.begin(), statementsLru, it->second.lru);
+        return it->second;
+    }
+
+    // вытесняем самый старый statement
+    if (statements.size() >= maxCachedStatements) {
+        dropStatement(statementsLru.back());
+    }
+
+    CachedStatement cached;
+    try {
+        cached.stmt = attachment->prepare(&status, transaction, 0, query.c_str(), SQL_DIALECT_V6,
+                                          Firebird::IStatement::PREPARE_PREFETCH_METADATA);
+        cached.inMeta = cached.stmt->getInputMetadata(&status);
+        cached.outMeta = cached.stmt->getOutputMetadata(&status);
+        cached.plan = RowPlan(status, cached.outMeta);
+    } catch (...) {
+        releaseStatement(cached);
+        throw;
+    }
+    cached.outBuffer.resize(cached.plan.getMessageLength());
+
+    statementsLru.push_front(query);
+    cached.lru = statementsLru.begin();
+    return statements.emplace(query, std::move(cached)).first->second;
+}
+
+void FirebirdConnection::releaseStatement(CachedStatement& cached) {
+    if (cached.boundMeta) cached.boundMeta->release();
+    if (cached.outMeta) cached.outMeta->release();
+    if (cached.inMeta) cached.inMeta->release();
+    if (cached.stmt) cached.stmt->release();
+    cached.boundMeta = nullptr;
+    cached.outMeta = nullptr;
+    cached.inMeta = nullptr;
+    cached.stmt = nullptr;
+}
+
+void FirebirdConnection::dropStatement(const std::string& query) {
+    auto it = statements.find(query);
+    if (it == statements.end()) return;
+
+    releaseStatement(it->second);
+    statementsLru.erase(it->second.lru);
+    statements.erase(it);
+}
+
+void FirebirdConnection::clearStatements() {
+    for (auto& [query, cached] : statements) {
+        releaseStatement(cached);
+    }
+    statements.clear();
+    statementsLru.clear();
+}
+
+Firebird::IMessageMetadata* FirebirdConnection::bindParams(Firebird::ThrowStatusWrapper& status,
+                                                           CachedStatement& cached,
+                                                           const SqlParams& params) {
+    using namespace Firebird;
+
+    unsigned int count = cached.inMeta->getCount(&status);
+    if (params.size() != count) {
+        throw std::runtime_error("Query expects " + std::to_string(count) + " parameters, got "
+                                 + std::to_string(params.size()));
+    }
+    if (count == 0) return nullptr;
+
+    // Типы значений (и длины строк) этого вызова: совпали с прошлым - метаданные те же
+    paramSignature.clear();
+    for (const SqlParam& param : params) {
+        paramSignature.push_back(static_cast<char>('0' + param.index()));
+        if (const auto* v = std::get_if<std::string>(&param)) {
+            paramSignature += std::to_string(v->size());
+            paramSignature.push_back(';');
+        }
+    }
+
+    if (!cached.boundMeta || cached.boundSignature != paramSignature) {
+        if (cached.boundMeta) {
+            cached.boundMeta->release();
+            cached.boundMeta = nullptr;
+        }
+        cached.boundMeta = buildParamsMeta(status, cached.inMeta, params);
+        cached.boundSignature = paramSignature;
+    }
+
+    IMessageMetadata* meta = cached.boundMeta;
+    std::vector<unsigned char>& message = cached.inBuffer;
+    message.assign(meta->getMessageLength(&status), 0);
+
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned char* data = message.data() + meta->getOffset(&status, i);
+        auto* null_flag = reinterpret_cast<short*>(message.data() + meta->getNullOffset(&status, i));
+        const SqlParam& param = params[i];
+
+        *null_flag = std::holds_alternative<std::nullptr_t>(param) ? -1 : 0;
+
+        if (const auto* v = std::get_if<int32_t>(&param)) {
+            *reinterpret_cast<int32_t*>(data) = *v;
+        } else if (const auto* v = std::get_if<int64_t>(&param)) {
+            *reinterpret_cast<int64_t*>(data) = *v;
+        } else if (const auto* v = std::get_if<double>(&param)) {
+            *reinterpret_cast<double*>(data) = *v;
+        } else if (const auto* v = std::get_if<bool>(&param)) {
+            *data = *v ? 1 : 0;
+        } else if (const auto* v = std::get_if<std::string>(&param)) {
+            *reinterpret_cast<unsigned short*>(data) = static_cast<unsigned short>(v->size());
+            std::copy(v->begin(), v->end(), data + sizeof(unsigned short));
+        }
+    }
+
+    return meta;
+}
+
+Firebird::IMessageMetadata* FirebirdConnection::buildParamsMeta(Firebird::ThrowStatusWrapper& status,
+                                                                Firebird::IMessageMetadata* declared,
+                                                                const SqlParams& params) {
+    using namespace Firebird;
+
+    unsigned int count = static_cast<unsigned int>(params.size());
+
+    // Подменяем типы параметров на типы переданных значений - приведение делает сервер
+    IMetadataBuilder* builder = declared->getBuilder(&status);
+    IMessageMetadata* meta = nullptr;
+    try {
+        for (unsigned int i = 0; i < count; i++) {
+            const SqlParam& param = params[i];
+            if (std::holds_alternative<std::nullptr_t>(param)) {
+                continue;  // тип как объявлен, выставим только NULL флаг
+            }
+
+            builder->setScale(&status, i, 0);
+            builder->setSubType(&status, i, 0);
+
+            if (std::holds_alternative<int32_t>(param)) {
+                builder->setType(&status, i, SQL_LONG + 1);
+                builder->setLength(&status, i, sizeof(int32_t));
+            } else if (std::holds_alternative<int64_t>(param)) {
+                builder->setType(&status, i, SQL_INT64 + 1);
+                builder->setLength(&status, i, sizeof(int64_t));
+            } else if (std::holds_alternative<double>(param)) {
+                builder->setType(&status, i, SQL_DOUBLE + 1);
+                builder->setLength(&status, i, sizeof(double));
+            } else if (std::holds_alternative<bool>(param)) {
+                builder->setType(&status, i, SQL_BOOLEAN + 1);
+                builder->setLength(&status, i, sizeof(unsigned char));
+            } else {
+                const std::string& str = std::get<std::string>(param);
+                builder->setType(&status, i, SQL_VARYING + 1);
+                builder->setLength(&status, i, static_cast<unsigned int>(str.size()));
+            }
+        }
+        meta = builder->getMetadata(&status);
+    } catch (...) {
+        builder->release();
+        throw;
+    }
+    builder->release();
+
+    return meta;
+}
+
+std::vector<crow::json::wvalue> FirebirdConnection::getSQL(const std::string& query) {
+    return getSQL(query, {});
+}
+
+std::vector<crow::json::wvalue> FirebirdConnection::getSQL(const std::string& query, const SqlParams& params) {
     std::vector<crow::json::wvalue> result_json;
+
+    fetch(query, params, [&](const RowPlan& plan, const unsigned char* message) {
+        result_json.push_back(plan.toJson(message));
+    });
+
+    if (result_json.empty())
+        throw std::runtime_error("No results found");
+
+    return result_json;
+}
+
+size_t FirebirdConnection::fetch(const std::string& query, const SqlParams& params, const RowHandler& onRow) {
+    using namespace Firebird;
+
+    if (!isConnected || !attachment) {
+        throw std::runtime_error("FirebirdConnection is not connected");
+    }
+
+    // срок запроса: истекший не выполняем, выполняющийся прервет watchdog
+    RequestDeadline* deadline = RequestDeadline::active();
+    if (deadline) {
+        deadline->check();
+    }
+    std::optional<QueryWatchdog::Guard> watch;
+
+    size_t rows = 0;
     ITransaction* transaction = nullptr;
-    IStatement* stmt = nullptr;
+    bool shared = txConfig.mode == TxMode::SharedReadOnly;
     IMessageMetadata* meta = nullptr;
+    IMessageMetadata* inMeta = nullptr;
     IResultSet* rs = nullptr;
-    unsigned char* buffer = nullptr;
+
+    // снимает запрос с наблюдения; отмена, пришедшая после конца запроса,
+    // не должна прервать следующий запрос на этом attachment'е
+    auto unwatch = [&]() -> std::optional<CancelReason> {
+        std::optional<CancelReason> fired = watch ? watch->release() : std::nullopt;
+        if (fired) {
+            resetCancel();
+        }
+        return fired;
+    };
 
     // ВАЖНО: Создаем новый объект статуса для этой операции
     IStatus* localStatus = master->getStatus();
     ThrowStatusWrapper statusWrapper(localStatus);
 
+    // Освобождаем ресурсы - и при успехе, и перед пробросом исключения.
+    // meta, inMeta и буферы сообщений принадлежат кэшу statement'ов
+    auto cleanup = [&]() {
+        if (rs) {
+            rs->release();
+            rs = nullptr;
+        }
+        if (transaction && !shared) {
+            transaction->release();
+            transaction = nullptr;
+        }
+        if (localStatus) {
+            localStatus->dispose();
+            localStatus = nullptr;
+        }
+    };
+
+    // Своя транзакция откатывается; общую после ошибки не переиспользуем - выбрасываем целиком
+    auto rollback = [&]() {
+        if (!transaction) return;
+
+        if (shared) {
+            endSharedTransaction(false);
+            transaction = nullptr;
+            return;
+        }
+
+        IStatus* rollbackStatus = master->getStatus();
+        try {
+            ThrowStatusWrapper rollbackWrapper(rollbackStatus);
+            transaction->rollback(&rollbackWrapper);
+            transaction = nullptr;  // rollback() освобождает интерфейс
+        } catch (...) {
+            // Игнорируем ошибки отката
+        }
+        rollbackStatus->dispose();
+    };
+
     try {
-        // 1. Начинаем транзакцию
-        transaction = attachment->startTransaction(&statusWrapper, 0, nullptr);
+        using Clock = std::chrono::steady_clock;
+        const auto prepare_start = Clock::now();
 
-        // 2. Подготавливаем запрос
-        stmt = attachment->prepare(&statusWrapper, transaction, 0,
-                                   query.c_str(), SQL_DIALECT_V6, 0);
+        // 1. Берем транзакцию: долгую общую или новую на этот запрос
+        transaction = shared ? startSharedTransaction(statusWrapper)
+                             : attachment->startTransaction(&statusWrapper, 0, nullptr);
 
-        // 3. Получаем метаданные результата
-        meta = stmt->getOutputMetadata(&statusWrapper);
+        // 2. Берем подготовленный запрос из кэша (prepare только при первом обращении)
+        CachedStatement& cached = prepareCached(statusWrapper, transaction, query);
 
-        // 4. Вычисляем размер буфера
-        unsigned int msg_len = meta->getMessageLength(&statusWrapper);
-        buffer = new unsigned char[msg_len];
+        // 3. Метаданные результата и параметры
+        meta = cached.outMeta;
+        inMeta = bindParams(statusWrapper, cached, params);
 
-        // 5. Открываем курсор
-        rs = stmt->openCursor(&statusWrapper, transaction, nullptr, nullptr, meta, 0);
+        // 4. Буфер строки - свой у каждого statement'а, выделен при prepare
+        unsigned char* buffer = cached.outBuffer.data();
 
-        // 6. Читаем строки
+        const auto fetch_start = Clock::now();
+        RequestTrace::stage(Stage::Prepare, fetch_start - prepare_start);
+
+        // 5. Открываем курсор. Таймаут ставится каждый раз - statement из кэша помнит прошлый
+        cached.stmt->setTimeout(&statusWrapper, deadline ? deadline->statementTimeoutMs() : 0);
+        if (deadline) {
+            watch.emplace(*this, *deadline);
+        }
+        rs = cached.stmt->openCursor(&statusWrapper, transaction, inMeta,
+                                     inMeta ? cached.inBuffer.data() : nullptr, meta, 0);
+
+        // 6. Читаем строки - декодирование идет по плану, без обращений к метаданным.
+        // Время обработчика замеряется на каждой SERIALIZE_SAMPLE-й строке - два вызова
+        // часов на строку заметны рядом с ее сериализацией
+        Clock::duration sampled{0};
+        size_t sampled_rows = 0;
         while (rs->fetchNext(&statusWrapper, buffer) == IStatus::RESULT_OK) {
-            crow::json::wvalue row_json;
-
-            for (unsigned int i = 0; i < meta->getCount(&statusWrapper); i++) {
-                // Получаем имя поля
-                const char* field_name_cstr = meta->getField(&statusWrapper, i);
-                std::string field_name = field_name_cstr ? field_name_cstr : "";
-
-                // Получаем смещение для NULL флага и данных
-                unsigned int null_offset = meta->getNullOffset(&statusWrapper, i);
-                unsigned int data_offset = meta->getOffset(&statusWrapper, i);
-                unsigned int type = meta->getType(&statusWrapper, i);
-                unsigned int len = meta->getLength(&statusWrapper, i);
-
-                // Проверяем NULL
-                bool is_null = (buffer[null_offset] != 0);
-
-                if (is_null) {
-                    row_json[field_name] = nullptr;
-                } else {
-                    switch (type & ~1) {
-                        case SQL_VARYING: {
-                            unsigned char* field_start = buffer + data_offset;
-                            unsigned short str_len = *(unsigned short*)field_start;
-                            const char* str_data = (const char*)(field_start + sizeof(unsigned short));
-                            row_json[field_name] = std::string(str_data, str_len);
-                            break;
-                        }
-                        case SQL_TEXT: {
-                            const char* text_data = (const char*)(buffer + data_offset);
-                            int real_len = len;
-                            while (real_len > 0 && text_data[real_len - 1] == ' ') {
-                                real_len--;
-                            }
-                            row_json[field_name] = std::string(text_data, real_len);
-                            break;
-                        }
-                        case SQL_LONG: {
-                            int32_t value = *reinterpret_cast<int32_t*>(buffer + data_offset);
-                            row_json[field_name] = static_cast<int64_t>(value);
-                            break;
-                        }
-                        case SQL_FLOAT: {
-                            float value = *reinterpret_cast<float*>(buffer + data_offset);
-                            row_json[field_name] = static_cast<double>(value);
-                            break;
-                        }
-                        case SQL_DOUBLE: {
-                            double value = *reinterpret_cast<double*>(buffer + data_offset);
-                            row_json[field_name] = value;
-                            break;
-                        }
-                        case SQL_BOOLEAN: {
-                            bool value = *reinterpret_cast<bool*>(buffer + data_offset);
-                            row_json[field_name] = value;
-                            break;
-                        }
-                        case SQL_TIMESTAMP: {
-                            ISC_TIMESTAMP* ts = reinterpret_cast<ISC_TIMESTAMP*>(buffer + data_offset);
-                            struct tm tm_time;
-                            isc_decode_timestamp(ts, &tm_time);
-                            char buf[64];
-                            strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_time);
-                            row_json[field_name] = std::string(buf);
-                            break;
-                        }
-                        default: {
-                            row_json[field_name] = nullptr;
-                            break;
-                        }
-                    }
-                }
+            if (rows % SERIALIZE_SAMPLE == 0) {
+                const auto row_start = Clock::now();
+                onRow(cached.plan, buffer);
+                sampled += Clock::now() - row_start;
+                sampled_rows++;
+            } else {
+                onRow(cached.plan, buffer);
             }
-            result_json.push_back(std::move(row_json));
+            rows++;
         }
 
-        // 7. Фиксируем транзакцию
-        transaction->commit(&statusWrapper);
+        const auto loop = Clock::now() - fetch_start;
+        const auto serialize = sampled_rows ? std::min<Clock::duration>(sampled * rows / sampled_rows, loop)
+                                            : Clock::duration{0};
+        RequestTrace::stage(Stage::Fetch, loop - serialize);
+        RequestTrace::stage(Stage::Serialize, serialize);
+
+        // 7. Закрываем курсор - statement и общая транзакция переиспользуются
+        rs->close(&statusWrapper);
+        rs = nullptr;  // close() освобождает интерфейс
+
+        // 8. Фиксируем свою транзакцию; общая остается открытой
+        if (!shared) {
+            transaction->commit(&statusWrapper);
+            transaction = nullptr;  // commit() освобождает интерфейс
+        }
 
     } catch (const FbException& e) {
+        // Прерван по сроку или клиент ушел - не ошибка БД: attachment и statement исправны
+        std::optional<CancelReason> cancelled = unwatch();
+        if (!cancelled && e.getStatus() && isCancelError(e.getStatus()->getErrors())) {
+            cancelled = CancelReason::StatementTimeout;
+        }
+        if (cancelled) {
+            rollback();
+            cleanup();
+            QueryCancelled::raise(*cancelled);
+        }
+
         // Анализируем ошибку
         if (e.getStatus()) {
             const ISC_STATUS* errors = e.getStatus()->getErrors();
             if (errors) {
-                std::cerr << "Error codes: ";
-                for (int i = 0; i < 5 && errors[i] != isc_arg_end; i++) {
-                    std::cerr << errors[i] << " ";
+                countErrors(e);
+
+                if (isNetworkError(errors)) {
+                    isHealthy = false;
                 }
-                std::cerr << std::endl;
 
                 if (errors[1] != 0) {
-                    std::cerr << "SQLCODE: " << errors[1] << std::endl;
-
                     // Распространенные коды ошибок prepare:
+                    const char* reason;
                     switch (errors[1]) {
                         case 335544569:
-                            std::cerr << "ERROR: Network connection lost during query preparation" << std::endl;
+                            reason = "Network connection lost during query preparation";
                         break;
                         case 335544436: // isc_sqlerr
-                            std::cerr << "ERROR: SQL syntax error in query" << std::endl;
+                            reason = "SQL syntax error in query";
                         break;
                         case 335544347: // isc_no_cur_rec
-                            std::cerr << "ERROR: No current record for operation" << std::endl;
+                            reason = "No current record for operation";
                         break;
                         case 335544453: // isc_stream_eof
-                            std::cerr << "ERROR: End of file reached unexpectedly" << std::endl;
+                            reason = "End of file reached unexpectedly";
                         break;
                         default:
-                            std::cerr << "Unknown Firebird error" << std::endl;
+                            reason = "Unknown Firebird error";
                     }
+                    UDA_LOG_ERROR("Firebird query failed", {{"gds", static_cast<int64_t>(errors[1])},
+                                                            {"reason", reason}, {"sql", query}});
                 }
             }
         }
 
         // Если транзакция была создана, пытаемся откатить
-        if (transaction) {
-            try {
-                // Для отката нужен новый статус
-                IStatus* rollbackStatus = master->getStatus();
-                ThrowStatusWrapper rollbackWrapper(rollbackStatus);
-                transaction->rollback(&rollbackWrapper);
-                rollbackStatus->dispose();
-            } catch (...) {
-                // Игнорируем ошибки отката
-            }
-        }
+        rollback();
+
+        // statement мог устареть (например, после изменения метаданных) - подготовим заново
+        dropStatement(query);
+        cleanup();
 
         throw std::runtime_error("Firebird query failed");
 
     } catch (const std::exception& e) {
-        std::cerr << "General error: " << e.what() << std::endl;
+        UDA_LOG_ERROR("Firebird query failed", {{"error", e.what()}, {"sql", query}});
 
         // Откатываем транзакцию при любой другой ошибке
-        if (transaction) {
-            try {
-                IStatus* rollbackStatus = master->getStatus();
-                ThrowStatusWrapper rollbackWrapper(rollbackStatus);
-                transaction->rollback(&rollbackWrapper);
-                rollbackStatus->dispose();
-            } catch (...) {
-                // Игнорируем ошибки отката
-            }
-        }
+        unwatch();
+        rollback();
+        cleanup();
         throw;
 
-    } finally_cleanup:
-        // Освобождаем ресурсы
-        if (buffer) {
-            delete[] buffer;
-        }
-        if (rs) {
-            rs->release();
-        }
-        if (meta) {
-            meta->release();
-        }
-        if (stmt) {
-            stmt->release();
-        }
-        if (transaction) {
-            transaction->release();
-        }
-        if (localStatus) {
-            localStatus->dispose();
-        }
+    }
 
-    if (result_json.empty())
-        throw std::runtime_error("No results found");
+    unwatch();
+    cleanup();
 
-    return result_json;
+    return rows;
 }
\ No newline at end of file
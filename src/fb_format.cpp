@@ -0,0 +1,173 @@
+#include "fb_format.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+constexpr char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+inline void put2(char* p, unsigned value) {
+    std::memcpy(p, DIGIT_PAIRS + value * 2, 2);
+}
+
+// floor-деление для отрицательных значений (даты до 1970)
+inline int64_t floorDiv(int64_t a, int64_t b) {
+    return a / b - (a % b < 0);
+}
+
+// разряды беззнакового числа уже в буфере: расставляем знак и десятичную точку
+void appendScaled(std::string& out, bool negative, const char* digits, size_t len, int scale) {
+    if (negative) out.push_back('-');
+
+    if (scale >= 0) {
+        out.append(digits, len);
+        out.append(static_cast<size_t>(scale), '0');
+        return;
+    }
+
+    size_t frac = static_cast<size_t>(-scale);
+    if (len <= frac) {
+        out += "0.";
+        out.append(frac - len, '0');
+        out.append(digits, len);
+    } else {
+        out.append(digits, len - frac);
+        out.push_back('.');
+        out.append(digits + len - frac, frac);
+    }
+}
+
+// IStatus на поток: DECFLOAT/INT128 без __int128 форматирует клиентская библиотека
+Firebird::ThrowStatusWrapper& threadStatus() {
+    struct Holder {
+        Firebird::IStatus* status;
+        Firebird::ThrowStatusWrapper wrapper;
+
+        Holder() : status(fb_get_master_interface()->getStatus()), wrapper(status) {}
+        ~Holder() { status->dispose(); }
+    };
+    thread_local Holder holder;
+    return holder.wrapper;
+}
+
+Firebird::IUtil* util() {
+    static Firebird::IUtil* instance = fb_get_master_interface()->getUtilInterface();
+    return instance;
+}
+
+// корректное JSON-число заканчивается цифрой ("1.5E+3"), а NaN/Infinity/sNaN - нет
+bool appendNumberText(std::string& out, const char* text) {
+    size_t len = std::strlen(text);
+    if (len == 0 || text[len - 1] < '0' || text[len - 1] > '9') return false;
+    out.append(text, len);
+    return true;
+}
+
+} // namespace
+
+CivilDate civilFromDays(int64_t days) {
+    const int64_t z = days + 719468;
+    const int64_t era = floorDiv(z, 146097);
+    const int64_t doe = z - era * 146097;                                     // [0, 146096]
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // [0, 399]
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);                // [0, 365]
+    const int64_t mp = (5 * doy + 2) / 153;                                     // [0, 11], март = 0
+    const int64_t day = doy - (153 * mp + 2) / 5 + 1;
+    // mp < 10 ? mp + 3 : mp - 9 - без перехода
+    const int64_t month = mp + 3 - 12 * (mp >= 10);
+
+    return {yoe + era * 400 + (month <= 2), static_cast<unsigned>(month), static_cast<unsigned>(day)};
+}
+
+void appendDate(std::string& out, int64_t unix_days) {
+    CivilDate date = civilFromDays(unix_days);
+
+    // годы вне 0..9999 в Firebird не бывают
+    unsigned year = static_cast<unsigned>(date.year) % 10000;
+
+    char buf[10];
+    put2(buf, year / 100);
+    put2(buf + 2, year % 100);
+    buf[4] = '-';
+    put2(buf + 5, date.month);
+    buf[7] = '-';
+    put2(buf + 8, date.day);
+    out.append(buf, sizeof(buf));
+}
+
+void appendTimeOfDay(std::string& out, int64_t seconds) {
+    unsigned sod = static_cast<unsigned>(seconds - floorDiv(seconds, 86400) * 86400);
+
+    char buf[8];
+    put2(buf, sod / 3600);
+    buf[2] = ':';
+    put2(buf + 3, sod / 60 % 60);
+    buf[5] = ':';
+    put2(buf + 6, sod % 60);
+    out.append(buf, sizeof(buf));
+}
+
+void appendTimestamp(std::string& out, int64_t unix_seconds) {
+    appendDate(out, floorDiv(unix_seconds, 86400));
+    out.push_back(' ');
+    appendTimeOfDay(out, unix_seconds);
+}
+
+void appendDecimal(std::string& out, int64_t value, int scale) {
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+
+    char digits[24];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), magnitude);
+    appendScaled(out, value < 0, digits, static_cast<size_t>(end - digits), scale);
+}
+
+void appendInt128(std::string& out, const FB_I128& value, int scale) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 bits = (static_cast<unsigned __int128>(value.fb_data[1]) << 64) | value.fb_data[0];
+    const bool negative = static_cast<__int128>(bits) < 0;
+    unsigned __int128 magnitude = negative ? 0 - bits : bits;
+
+    // разряды с конца, по два за деление
+    char digits[40];
+    char* p = digits + sizeof(digits);
+    while (magnitude >= 100) {
+        p -= 2;
+        put2(p, static_cast<unsigned>(magnitude % 100));
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        p -= 2;
+        put2(p, static_cast<unsigned>(magnitude));
+    } else {
+        *--p = static_cast<char>('0' + static_cast<unsigned>(magnitude));
+    }
+
+    appendScaled(out, negative, p, static_cast<size_t>(digits + sizeof(digits) - p), scale);
+#else
+    // MSVC: нет 128-битного целого - форматирует IInt128 клиентской библиотеки
+    char buf[Firebird::IInt128::STRING_SIZE];
+    util()->getInt128(&threadStatus())->toString(&threadStatus(), &value, scale, sizeof(buf), buf);
+    out += buf;
+#endif
+}
+
+bool appendDecFloat16(std::string& out, const FB_DEC16& value) {
+    char buf[Firebird::IDecFloat16::STRING_SIZE];
+    util()->getDecFloat16(&threadStatus())->toString(&threadStatus(), &value, sizeof(buf), buf);
+    return appendNumberText(out, buf);
+}
+
+bool appendDecFloat34(std::string& out, const FB_DEC34& value) {
+    char buf[Firebird::IDecFloat34::STRING_SIZE];
+    util()->getDecFloat34(&threadStatus())->toString(&threadStatus(), &value, sizeof(buf), buf);
+    return appendNumberText(out, buf);
+}
+
+double int128ToDouble(const FB_I128& value) {
+    // старшая половина со знаком, младшая - без
+    return static_cast<double>(static_cast<int64_t>(value.fb_data[1])) * 18446744073709551616.0
+         + static_cast<double>(value.fb_data[0]);
+}
@@ -0,0 +1,348 @@
+#include "fb_pool.h"
+#include "logger.h"
+#include "metrics.h"
+#include "query_deadline.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// доля нового замера в сглаженном времени аренды
+static constexpr double LEASE_EWMA_WEIGHT = 0.1;
+
+PooledConnection::PooledConnection(FirebirdPool* pool, std::unique_ptr<FirebirdConnection> conn)
+    : pool(pool), conn(std::move(conn)), leasedAt(Clock::now()) {}
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+    : pool(std::exchange(other.pool, nullptr)), conn(std::move(other.conn)), leasedAt(other.leasedAt) {}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool = std::exchange(other.pool, nullptr);
+        conn = std::move(other.conn);
+        leasedAt = other.leasedAt;
+    }
+    return *this;
+}
+
+PooledConnection::~PooledConnection() {
+    release();
+}
+
+void PooledConnection::release() {
+    if (pool && conn) {
+        pool->giveBack(std::move(conn), leasedAt);
+    }
+    pool = nullptr;
+    conn.reset();
+}
+
+FirebirdPool::FirebirdPool(FBConnectionStruct conf, FBPoolConfig pool_conf)
+    : config(std::move(conf)), poolConfig(pool_conf) {
+    poolConfig.max_size = std::max<size_t>(poolConfig.max_size, 1);
+    poolConfig.min_size = std::min(poolConfig.min_size, poolConfig.max_size);
+
+    // заранее открываем min_size подключений, чтобы первые запросы не ждали attach
+    for (size_t i = 0; i < poolConfig.min_size; i++) {
+        auto conn = open();
+        if (!conn) {
+            UDA_LOG_WARN("Firebird pool: failed to pre-attach connection",
+                         {{"attached", i}, {"min_size", poolConfig.min_size}});
+            break;
+        }
+        auto now = Clock::now();
+        idle.push_back({std::move(conn), now, now});
+        total++;
+    }
+
+    maintenanceThread = std::thread(&FirebirdPool::maintenance, this);
+}
+
+FirebirdPool::~FirebirdPool() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+    }
+    stopSignal.notify_all();
+    available.notify_all();
+
+    if (maintenanceThread.joinable()) {
+        maintenanceThread.join();
+    }
+
+    // деструкторы FirebirdConnection делают detach
+    idle.clear();
+}
+
+std::unique_ptr<FirebirdConnection> FirebirdPool::open() {
+    try {
+        auto conn = std::make_unique<FirebirdConnection>(config);
+        conn->setTransactionConfig(poolConfig.tx);
+        conn->setStatementTimeout(poolConfig.statement_timeout);
+        if (!conn->connect()) {
+            return nullptr;
+        }
+        return conn;
+    } catch (const std::exception& e) {
+        UDA_LOG_ERROR("Firebird pool: cannot open connection", {{"error", e.what()}});
+        return nullptr;
+    }
+}
+
+PooledConnection FirebirdPool::acquire() {
+    StageTimer timer(Stage::Acquire);
+    const auto start = Clock::now();
+    auto deadline = start + poolConfig.acquire_timeout;
+    bool waited = false;
+
+    // срок запроса короче ожидания пула - ждем только до него
+    const RequestDeadline* request = RequestDeadline::active();
+    const bool request_bound = request && request->expiresAt() < deadline;
+    if (request_bound) {
+        deadline = request->expiresAt();
+    }
+
+    std::unique_lock<std::mutex> lock(poolMutex);
+    if (failures >= poolConfig.breaker_failures && Clock::now() < breakerUntil) {
+        throw std::runtime_error("Firebird endpoint " + config.db_host + " is unavailable (circuit open)");
+    }
+
+    while (true) {
+        if (stopping) {
+            throw std::runtime_error("Firebird pool is shutting down");
+        }
+
+        // 1. Свободное подключение из пула
+        if (!idle.empty()) {
+            IdleEntry entry = std::move(idle.back());
+            idle.pop_back();
+            lock.unlock();
+
+            bool alive = entry.conn->connected();
+            if (alive && Clock::now() - entry.checked > poolConfig.health_check_interval) {
+                alive = entry.conn->ping();
+            }
+            if (!alive) {
+                alive = entry.conn->reconnect();
+
+                std::lock_guard<std::mutex> guard(poolMutex);
+                if (alive) {
+                    counters.reconnects++;
+                    breakerSuccess();
+                } else {
+                    breakerFailure();
+                }
+            }
+
+            if (alive) {
+                recordWait(start, waited);
+                return PooledConnection(this, std::move(entry.conn));
+            }
+
+            // переподключиться не удалось - выбрасываем и пробуем дальше
+            entry.conn.reset();
+            lock.lock();
+            total--;
+            continue;
+        }
+
+        // 2. Есть место - открываем новое
+        if (total < poolConfig.max_size) {
+            total++;
+            lock.unlock();
+
+            auto conn = open();
+            if (!conn) {
+                lock.lock();
+                total--;
+                breakerFailure();
+                available.notify_one();
+                throw std::runtime_error("Failed to connect to Firebird database");
+            }
+
+            recordWait(start, waited);
+            return PooledConnection(this, std::move(conn));
+        }
+
+        // 3. Ждем, пока кто-нибудь вернет подключение
+        waited = true;
+        if (available.wait_until(lock, deadline) == std::cv_status::timeout
+            && idle.empty() && total >= poolConfig.max_size) {
+            counters.timeouts++;
+            if (request_bound) {
+                lock.unlock();
+                QueryCancelled::raise(CancelReason::Deadline);
+            }
+            throw std::runtime_error("Timed out waiting for a Firebird connection");
+        }
+    }
+}
+
+void FirebirdPool::giveBack(std::unique_ptr<FirebirdConnection> conn, Clock::time_point leased_at) {
+    std::unique_lock<std::mutex> lock(poolMutex);
+
+    if (stopping || !conn->connected()) {
+        // сломанное подключение не возвращаем - следующий acquire откроет новое
+        total--;
+        if (!stopping) {
+            breakerFailure();
+        }
+        lock.unlock();
+        available.notify_one();
+        conn.reset();
+        return;
+    }
+
+    auto now = Clock::now();
+    double lease_ms = std::chrono::duration<double, std::milli>(now - leased_at).count();
+    counters.lease_ewma_ms = counters.lease_ewma_ms == 0
+        ? lease_ms
+        : counters.lease_ewma_ms + (lease_ms - counters.lease_ewma_ms) * LEASE_EWMA_WEIGHT;
+    breakerSuccess();
+
+    idle.push_back({std::move(conn), now, now});
+    lock.unlock();
+    available.notify_one();
+}
+
+void FirebirdPool::breakerFailure() {
+    failures++;
+    // порог достигнут или не удалась пробная выдача после паузы - узел снова закрыт
+    if (failures >= poolConfig.breaker_failures) {
+        auto now = Clock::now();
+        if (failures == poolConfig.breaker_failures || now >= breakerUntil) {
+            counters.breaker_trips++;
+        }
+        breakerUntil = now + poolConfig.breaker_open;
+    }
+}
+
+void FirebirdPool::breakerSuccess() {
+    failures = 0;
+}
+
+bool FirebirdPool::accepting() const {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return failures < poolConfig.breaker_failures || Clock::now() >= breakerUntil;
+}
+
+size_t FirebirdPool::outstanding() const {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return total - idle.size() - maintained;
+}
+
+void FirebirdPool::recordWait(Clock::time_point start, bool waited) {
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    counters.acquired++;
+    if (waited) {
+        counters.waited++;
+    }
+    waitTotalMs += ms;
+    counters.wait_max_ms = std::max(counters.wait_max_ms, ms);
+}
+
+void FirebirdPool::maintenance() {
+    const auto period = std::max<Clock::duration>(
+        std::min<Clock::duration>(poolConfig.idle_timeout, poolConfig.health_check_interval) / 2,
+        std::chrono::seconds(1));
+
+    std::unique_lock<std::mutex> lock(poolMutex);
+    while (!stopping) {
+        stopSignal.wait_for(lock, period, [this] { return stopping; });
+        if (stopping) break;
+
+        auto now = Clock::now();
+
+        // 1. Idle eviction: самые старые в начале очереди
+        std::vector<std::unique_ptr<FirebirdConnection>> evict;
+        while (!idle.empty() && total > poolConfig.min_size
+               && now - idle.front().since > poolConfig.idle_timeout) {
+            evict.push_back(std::move(idle.front().conn));
+            idle.pop_front();
+            total--;
+            counters.evicted++;
+        }
+
+        // 2. Давно не проверенные забираем на health check (в total они остаются)
+        std::vector<IdleEntry> check;
+        for (auto it = idle.begin(); it != idle.end();) {
+            if (now - it->checked > poolConfig.health_check_interval) {
+                check.push_back(std::move(*it));
+                it = idle.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // 3. Добираем до min_size
+        size_t missing = total < poolConfig.min_size ? poolConfig.min_size - total : 0;
+        total += missing;
+        maintained = check.size() + missing;
+
+        // сетевые операции - без блокировки
+        lock.unlock();
+
+        evict.clear();
+
+        size_t reconnected = 0;
+        size_t failed = 0;
+        for (auto& entry : check) {
+            if (!entry.conn->ping()) {
+                if (entry.conn->reconnect()) {
+                    reconnected++;
+                } else {
+                    entry.conn.reset();
+                    failed++;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<FirebirdConnection>> opened;
+        for (size_t i = 0; i < missing; i++) {
+            auto conn = open();
+            if (!conn) break;
+            opened.push_back(std::move(conn));
+        }
+
+        lock.lock();
+        now = Clock::now();
+        counters.reconnects += reconnected;
+        maintained = 0;
+
+        // фоновые проверки тоже пробуют узел: недоступный закрывается без участия запросов
+        if (opened.size() < missing) failed++;
+        for (size_t i = 0; i < failed; i++) breakerFailure();
+        if (!failed && (reconnected || !opened.empty())) breakerSuccess();
+
+        for (auto& entry : check) {
+            if (entry.conn) {
+                entry.checked = now;
+                idle.push_back(std::move(entry));
+            } else {
+                total--;
+            }
+        }
+        total -= missing - opened.size();
+        for (auto& conn : opened) {
+            idle.push_back({std::move(conn), now, now});
+        }
+
+        available.notify_all();
+    }
+}
+
+FBPoolStats FirebirdPool::stats() const {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    FBPoolStats result = counters;
+    result.total = total;
+    result.idle = idle.size();
+    result.leased = total - idle.size() - maintained;
+    result.wait_avg_ms = counters.acquired ? waitTotalMs / counters.acquired : 0;
+    result.breaker_open = failures >= poolConfig.breaker_failures && Clock::now() < breakerUntil;
+    return result;
+}
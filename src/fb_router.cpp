@@ -0,0 +1,276 @@
+#include "fb_router.h"
+#include "logger.h"
+#include "query_deadline.h"
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+static std::string nodeName(const FBConnectionStruct& conf) {
+    return conf.db_host.empty() ? conf.db_path : conf.db_host + "/" + conf.db_port + ":" + conf.db_path;
+}
+
+std::vector<FBConnectionStruct> parseReplicaList(const std::string& list, const FBConnectionStruct& base) {
+    std::vector<FBConnectionStruct> replicas;
+
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(';', start);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+
+        // путь может содержать ':' (C:\base\...) - делим по первому '/' и первому ':' после него
+        size_t slash = item.find('/');
+        size_t colon = slash == std::string::npos ? std::string::npos : item.find(':', slash);
+        if (slash == 0 || colon == std::string::npos || colon == slash + 1 || colon + 1 == item.size()) {
+            throw std::invalid_argument("Invalid replica '" + item + "', expected host/port:path");
+        }
+
+        FBConnectionStruct conf = base;
+        conf.db_host = item.substr(0, slash);
+        conf.db_port = item.substr(slash + 1, colon - slash - 1);
+        conf.db_path = item.substr(colon + 1);
+        replicas.push_back(std::move(conf));
+    }
+    return replicas;
+}
+
+FirebirdRouter::FirebirdRouter(FBConnectionStruct primary, std::vector<FBConnectionStruct> replicas,
+                               FBPoolConfig pool_conf, FBRouterConfig router_conf)
+    : config(std::move(router_conf)) {
+    auto add = [&](FBConnectionStruct conf, bool is_primary) {
+        auto node = std::make_unique<Node>();
+        node->name = nodeName(conf);
+        node->primary = is_primary;
+        node->pool = std::make_unique<FirebirdPool>(std::move(conf), pool_conf);
+        nodes.push_back(std::move(node));
+    };
+
+    add(std::move(primary), true);
+    nodes[0]->lagMs = 0;
+    for (FBConnectionStruct& replica : replicas) {
+        add(std::move(replica), false);
+    }
+
+    // без реплик выбирать не из чего - проба не нужна
+    if (nodes.size() > 1) {
+        probeThread = std::thread(&FirebirdRouter::probe, this);
+    }
+}
+
+FirebirdRouter::~FirebirdRouter() {
+    {
+        std::lock_guard<std::mutex> lock(probeMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    if (probeThread.joinable()) {
+        probeThread.join();
+    }
+}
+
+std::chrono::milliseconds FirebirdRouter::allowedLag() const {
+    const RequestDeadline* request = RequestDeadline::active();
+    return request ? request->maxReplicaLag() : config.background_max_lag;
+}
+
+FirebirdRouter::Node* FirebirdRouter::choose(std::chrono::milliseconds max_lag) const {
+    Node* best = nodes[0].get();
+    if (nodes.size() == 1 || max_lag.count() <= 0) return best;
+
+    // ожидаемое время ответа: очередь узла на его среднюю скорость;
+    // у узла без замеров скорость считается 1 мс, чтобы он получил первые запросы
+    auto score = [](const Node& node) {
+        FBPoolStats stats = node.pool->stats();
+        return static_cast<double>(stats.leased + 1) * std::max(stats.lease_ewma_ms, 1.0);
+    };
+
+    double best_score = nodes[0]->pool->accepting() ? score(*nodes[0]) : HUGE_VAL;
+    for (size_t i = 1; i < nodes.size(); i++) {
+        Node& node = *nodes[i];
+        int64_t lag = node.lagMs;
+        if (lag < 0 || lag > max_lag.count() || !node.pool->accepting()) continue;
+
+        double node_score = score(node);
+        if (node_score < best_score) {
+            best = &node;
+            best_score = node_score;
+        }
+    }
+    return best;
+}
+
+PooledConnection FirebirdRouter::acquire() {
+    Node* node = choose(allowedLag());
+    if (node->primary) {
+        return node->pool->acquire();
+    }
+
+    try {
+        return node->pool->acquire();
+    } catch (const QueryCancelled&) {
+        throw;
+    } catch (const std::exception& e) {
+        // реплика только что отказала (breaker посчитал) - этот запрос обслужит primary
+        UDA_LOG_WARN("Firebird replica failed, using primary", {{"node", node->name}, {"error", e.what()}});
+        return nodes[0]->pool->acquire();
+    }
+}
+
+PooledConnection FirebirdRouter::acquirePrimary() {
+    return nodes[0]->pool->acquire();
+}
+
+int64_t FirebirdRouter::readCounter(FirebirdPool& pool, const std::string& query) {
+    PooledConnection fbc = pool.acquire();
+
+    int64_t value = 0;
+    fbc->fetch(query, {}, [&](const RowPlan& plan, const unsigned char* message) {
+        value = RowPlan::integer(plan.getColumns()[0], message).value_or(0);
+    });
+    return value;
+}
+
+void FirebirdRouter::probe() {
+    std::unique_lock<std::mutex> lock(probeMutex);
+    while (!stopping) {
+        lock.unlock();
+        probeOnce();
+        lock.lock();
+
+        wakeUp.wait_for(lock, config.probe_interval, [this] { return stopping; });
+    }
+}
+
+void FirebirdRouter::probeOnce() {
+    if (config.lag_query.empty()) {
+        for (size_t i = 1; i < nodes.size(); i++) {
+            nodes[i]->lagMs = nodes[i]->pool->accepting() ? 0 : -1;
+        }
+        return;
+    }
+
+    // сначала primary: значение реплики сравнивается с уже записанным образцом
+    try {
+        int64_t value = readCounter(*nodes[0]->pool, config.lag_query);
+        auto now = Clock::now();
+
+        // одинаковые значения схлопываются: важен последний момент, когда primary их еще показывал
+        if (!primarySamples.empty() && primarySamples.back().value == value) {
+            primarySamples.back().at = now;
+        } else {
+            primarySamples.push_back({now, value});
+            if (primarySamples.size() > MAX_SAMPLES) primarySamples.pop_front();
+        }
+    } catch (const std::exception& e) {
+        UDA_LOG_WARN("Firebird router: lag probe failed", {{"node", nodes[0]->name}, {"error", e.what()}});
+    }
+
+    for (size_t i = 1; i < nodes.size(); i++) {
+        Node& node = *nodes[i];
+        if (!node.pool->accepting() || primarySamples.empty()) {
+            node.lagMs = -1;
+            continue;
+        }
+
+        try {
+            int64_t value = readCounter(*node.pool, config.lag_query);
+            auto now = Clock::now();
+
+            // последний образец primary, который реплика уже содержит
+            auto it = primarySamples.rbegin();
+            while (it != primarySamples.rend() && it->value > value) ++it;
+
+            if (it == primarySamples.rbegin()) {
+                node.lagMs = 0;
+            } else {
+                // не догнала даже самый старый образец - отставание не меньше его возраста
+                auto since = it == primarySamples.rend() ? primarySamples.front().at : it->at;
+                node.lagMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - since).count();
+            }
+        } catch (const std::exception& e) {
+            UDA_LOG_WARN("Firebird router: lag probe failed", {{"node", node.name}, {"error", e.what()}});
+            node.lagMs = -1;
+        }
+    }
+}
+
+std::vector<FBNodeStats> FirebirdRouter::stats() const {
+    std::vector<FBNodeStats> result;
+    for (const auto& node : nodes) {
+        result.push_back({node->name, node->primary, node->lagMs.load(), node->pool->stats()});
+    }
+    return result;
+}
+
+FBPoolStats FirebirdRouter::totals() const {
+    FBPoolStats total;
+    double wait_sum = 0;
+    for (const auto& node : nodes) {
+        FBPoolStats stats = node->pool->stats();
+        total.total += stats.total;
+        total.idle += stats.idle;
+        total.leased += stats.leased;
+        total.acquired += stats.acquired;
+        total.waited += stats.waited;
+        total.timeouts += stats.timeouts;
+        total.reconnects += stats.reconnects;
+        total.evicted += stats.evicted;
+        total.breaker_trips += stats.breaker_trips;
+        total.wait_max_ms = std::max(total.wait_max_ms, stats.wait_max_ms);
+        wait_sum += stats.wait_avg_ms * static_cast<double>(stats.acquired);
+    }
+    total.wait_avg_ms = total.acquired ? wait_sum / static_cast<double>(total.acquired) : 0;
+    return total;
+}
+
+void FirebirdRouter::appendMetrics(std::string& out) const {
+    struct Gauge {
+        const char* name;
+        const char* type;
+        const char* help;
+        double (*value)(const FBNodeStats& node);
+    };
+    static const Gauge GAUGES[] = {
+        {"uda_db_node_outstanding", "gauge", "Attachments leased on the node",
+         [](const FBNodeStats& node) { return static_cast<double>(node.pool.leased); }},
+        {"uda_db_node_lag_seconds", "gauge", "Replication lag behind the primary (NaN - unknown)",
+         [](const FBNodeStats& node) { return node.lag_ms < 0 ? NAN : static_cast<double>(node.lag_ms) / 1000; }},
+        {"uda_db_node_lease_seconds", "gauge", "Smoothed attachment lease time",
+         [](const FBNodeStats& node) { return node.pool.lease_ewma_ms / 1000; }},
+        {"uda_db_node_breaker_open", "gauge", "Circuit breaker is open",
+         [](const FBNodeStats& node) { return node.pool.breaker_open ? 1.0 : 0.0; }},
+        {"uda_db_node_breaker_trips_total", "counter", "Circuit breaker trips",
+         [](const FBNodeStats& node) { return static_cast<double>(node.pool.breaker_trips); }},
+    };
+
+    std::vector<FBNodeStats> all = stats();
+    for (const Gauge& gauge : GAUGES) {
+        out += std::string("# HELP ") + gauge.name + " " + gauge.help + "\n";
+        out += std::string("# TYPE ") + gauge.name + " " + gauge.type + "\n";
+
+        for (const FBNodeStats& node : all) {
+            // значение метки в экспозиции Prometheus: \ и " экранируются
+            std::string label;
+            for (char c : node.name) {
+                if (c == '\\' || c == '"') label += '\\';
+                label += c;
+            }
+
+            double value = gauge.value(node);
+            char number[32];
+            if (std::isnan(value)) {
+                std::snprintf(number, sizeof(number), "NaN");
+            } else {
+                std::snprintf(number, sizeof(number), "%.17g", value);
+            }
+
+            out += std::string(gauge.name) + "{node=\"" + label + "\",role=\""
+                 + (node.primary ? "primary" : "replica") + "\"} " + number + "\n";
+        }
+    }
+}
@@ -0,0 +1,196 @@
+#include "fb_row.h"
+#include "fb_format.h"
+#include <cstdlib>
+
+RowPlan::RowPlan(Firebird::ThrowStatusWrapper& status, Firebird::IMessageMetadata* meta) {
+    unsigned int count = meta->getCount(&status);
+    columns.reserve(count);
+
+    for (unsigned int i = 0; i < count; i++) {
+        FbColumn col;
+        const char* field_name = meta->getField(&status, i);
+        col.name = field_name ? field_name : "";
+        col.type = meta->getType(&status, i) & ~1u;
+        col.offset = meta->getOffset(&status, i);
+        col.null_offset = meta->getNullOffset(&status, i);
+        col.length = meta->getLength(&status, i);
+        col.scale = meta->getScale(&status, i);
+        col.sub_type = meta->getSubType(&status, i);
+        columns.push_back(std::move(col));
+    }
+
+    messageLength = meta->getMessageLength(&status);
+}
+
+int RowPlan::find(std::string_view name) const {
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].name == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+std::optional<int64_t> RowPlan::integer(const FbColumn& col, const unsigned char* msg) {
+    if (isNull(col, msg)) return std::nullopt;
+
+    const unsigned char* data = msg + col.offset;
+    switch (col.type) {
+        case SQL_SHORT: return *reinterpret_cast<const int16_t*>(data);
+        case SQL_LONG: return *reinterpret_cast<const int32_t*>(data);
+        case SQL_INT64: return *reinterpret_cast<const int64_t*>(data);
+        default: return std::nullopt;
+    }
+}
+
+std::optional<double> RowPlan::number(const FbColumn& col, const unsigned char* msg) {
+    if (isNull(col, msg)) return std::nullopt;
+
+    const unsigned char* data = msg + col.offset;
+    switch (col.type) {
+        case SQL_SHORT:
+        case SQL_LONG:
+        case SQL_INT64: {
+            double value = static_cast<double>(*integer(col, msg));
+            for (int i = col.scale; i < 0; i++) value /= 10;
+            return value;
+        }
+        case SQL_INT128: {
+            double value = int128ToDouble(*reinterpret_cast<const FB_I128*>(data));
+            for (int i = col.scale; i < 0; i++) value /= 10;
+            return value;
+        }
+        case SQL_FLOAT: return *reinterpret_cast<const float*>(data);
+        case SQL_DOUBLE: return *reinterpret_cast<const double*>(data);
+        case SQL_TYPE_DATE:
+            return static_cast<double>(*reinterpret_cast<const ISC_DATE*>(data) - ISC_UNIX_EPOCH_DAYS) * 86400;
+        case SQL_TYPE_TIME:
+            return static_cast<double>(*reinterpret_cast<const ISC_TIME*>(data)) / ISC_TIME_SECONDS_PRECISION;
+        case SQL_TIMESTAMP: {
+            // ISC_TIMESTAMP: дни от 17.11.1858 и десятитысячные доли секунды
+            const ISC_TIMESTAMP* ts = reinterpret_cast<const ISC_TIMESTAMP*>(data);
+            return static_cast<double>(ts->timestamp_date - ISC_UNIX_EPOCH_DAYS) * 86400
+                + static_cast<double>(ts->timestamp_time) / ISC_TIME_SECONDS_PRECISION;
+        }
+        default: return std::nullopt;
+    }
+}
+
+std::string_view RowPlan::text(const FbColumn& col, const unsigned char* msg) {
+    if (isNull(col, msg)) return {};
+
+    const unsigned char* data = msg + col.offset;
+    const char* str;
+    size_t len;
+    if (col.type == SQL_VARYING) {
+        len = *reinterpret_cast<const unsigned short*>(data);
+        str = reinterpret_cast<const char*>(data + sizeof(unsigned short));
+    } else if (col.type == SQL_TEXT) {
+        len = col.length;
+        str = reinterpret_cast<const char*>(data);
+    } else {
+        return {};
+    }
+
+    while (len > 0 && str[len - 1] == ' ') {
+        len--;
+    }
+    return {str, len};
+}
+
+crow::json::wvalue RowPlan::toJson(const unsigned char* msg) const {
+    crow::json::wvalue row_json;
+
+    for (const FbColumn& col : columns) {
+        if (isNull(col, msg)) {
+            row_json[col.name] = nullptr;
+            continue;
+        }
+
+        const unsigned char* data = msg + col.offset;
+
+        switch (col.type) {
+            case SQL_VARYING: {
+                unsigned short str_len = *reinterpret_cast<const unsigned short*>(data);
+                const char* str_data = reinterpret_cast<const char*>(data + sizeof(unsigned short));
+                row_json[col.name] = std::string(str_data, str_len);
+                break;
+            }
+            case SQL_TEXT: {
+                const char* text_data = reinterpret_cast<const char*>(data);
+                unsigned int real_len = col.length;
+                while (real_len > 0 && text_data[real_len - 1] == ' ') {
+                    real_len--;
+                }
+                row_json[col.name] = std::string(text_data, real_len);
+                break;
+            }
+            case SQL_SHORT:
+            case SQL_LONG:
+            case SQL_INT64: {
+                int64_t value = *integer(col, msg);
+                if (col.scale == 0) {
+                    row_json[col.name] = value;
+                } else {
+                    // wvalue хранит только двоичные числа; точный текст пишет JsonWriter
+                    std::string text;
+                    appendDecimal(text, value, col.scale);
+                    row_json[col.name] = std::strtod(text.c_str(), nullptr);
+                }
+                break;
+            }
+            case SQL_INT128:
+            case SQL_DEC16:
+            case SQL_DEC34: {
+                std::string text;
+                bool number = true;
+                if (col.type == SQL_INT128) appendInt128(text, *reinterpret_cast<const FB_I128*>(data), col.scale);
+                else if (col.type == SQL_DEC16) number = appendDecFloat16(text, *reinterpret_cast<const FB_DEC16*>(data));
+                else number = appendDecFloat34(text, *reinterpret_cast<const FB_DEC34*>(data));
+
+                if (number) row_json[col.name] = std::strtod(text.c_str(), nullptr);
+                else row_json[col.name] = nullptr;
+                break;
+            }
+            case SQL_FLOAT: {
+                float value = *reinterpret_cast<const float*>(data);
+                row_json[col.name] = static_cast<double>(value);
+                break;
+            }
+            case SQL_DOUBLE: {
+                double value = *reinterpret_cast<const double*>(data);
+                row_json[col.name] = value;
+                break;
+            }
+            case SQL_BOOLEAN: {
+                bool value = *reinterpret_cast<const bool*>(data);
+                row_json[col.name] = value;
+                break;
+            }
+            case SQL_TYPE_DATE: {
+                std::string text;
+                appendDate(text, *reinterpret_cast<const ISC_DATE*>(data) - ISC_UNIX_EPOCH_DAYS);
+                row_json[col.name] = std::move(text);
+                break;
+            }
+            case SQL_TYPE_TIME: {
+                std::string text;
+                appendTimeOfDay(text, *reinterpret_cast<const ISC_TIME*>(data) / ISC_TIME_SECONDS_PRECISION);
+                row_json[col.name] = std::move(text);
+                break;
+            }
+            case SQL_TIMESTAMP: {
+                const ISC_TIMESTAMP* ts = reinterpret_cast<const ISC_TIMESTAMP*>(data);
+                std::string text;
+                appendTimestamp(text, (ts->timestamp_date - ISC_UNIX_EPOCH_DAYS) * 86400
+                                      + ts->timestamp_time / ISC_TIME_SECONDS_PRECISION);
+                row_json[col.name] = std::move(text);
+                break;
+            }
+            default: {
+                row_json[col.name] = nullptr;
+                break;
+            }
+        }
+    }
+
+    return row_json;
+}
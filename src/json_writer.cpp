@@ -0,0 +1,209 @@
+#include "json_writer.h"
+#include "fb_format.h"
+#include <charconv>
+#include <cmath>
+
+namespace {
+
+template <typename T>
+void appendNumber(std::string& out, T value) {
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, end);
+}
+
+template <typename T>
+void appendFloating(std::string& out, T value) {
+    // NaN/Inf в JSON не бывает
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    appendNumber(out, value);
+}
+
+} // namespace
+
+JsonWriter::JsonWriter(bool array, size_t reserve, std::pmr::memory_resource* resource)
+    : prefixes(resource), array(array) {
+    out.reserve(reserve);
+    if (array) {
+        out.push_back('[');
+    }
+}
+
+void JsonWriter::setSink(std::function<void(const std::string& chunk)> chunk_sink, size_t threshold) {
+    sink = std::move(chunk_sink);
+    flushThreshold = threshold;
+}
+
+void JsonWriter::flush() {
+    if (out.empty()) return;
+    sink(out);
+    flushedBytes += out.size();
+    out.clear();  // емкость сохраняется - буфер переиспользуется
+}
+
+void JsonWriter::preparePrefixes(const RowPlan& row_plan) {
+    plan = &row_plan;
+    prefixes.clear();
+
+    bool first = true;
+    for (const FbColumn& col : row_plan.getColumns()) {
+        std::string prefix = first ? "{" : ",";
+        appendString(prefix, col.name.data(), col.name.size());
+        prefix.push_back(':');
+        prefixes.emplace_back(prefix);
+        first = false;
+    }
+}
+
+void JsonWriter::writeRow(const RowPlan& row_plan, const unsigned char* message) {
+    if (!array && rows > 0) return;
+
+    if (plan != &row_plan) {
+        preparePrefixes(row_plan);
+    }
+
+    if (rows > 0) {
+        out.push_back(',');
+    }
+
+    const std::vector<FbColumn>& columns = row_plan.getColumns();
+    if (columns.empty()) {
+        out += "{}";
+    }
+    for (size_t i = 0; i < columns.size(); i++) {
+        out += prefixes[i];
+        appendValue(out, columns[i], message);
+    }
+    if (!columns.empty()) {
+        out.push_back('}');
+    }
+
+    rows++;
+
+    if (sink && out.size() >= flushThreshold) {
+        flush();
+    }
+}
+
+std::string& JsonWriter::finish() {
+    if (finished) return out;
+    finished = true;
+
+    if (array) {
+        out.push_back(']');
+    }
+    if (sink && flushedBytes > 0) {
+        flush();
+    }
+    return out;
+}
+
+void JsonWriter::appendString(std::string& out, const char* str, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+
+    out.push_back('"');
+
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(str + start, i - start);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default: {
+                char esc[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                out.append(esc, sizeof(esc));
+                break;
+            }
+        }
+        start = i + 1;
+    }
+    out.append(str + start, len - start);
+
+    out.push_back('"');
+}
+
+void JsonWriter::appendValue(std::string& out, const FbColumn& col, const unsigned char* message) {
+    if (RowPlan::isNull(col, message)) {
+        out += "null";
+        return;
+    }
+
+    const unsigned char* data = message + col.offset;
+
+    switch (col.type) {
+        case SQL_VARYING: {
+            unsigned short str_len = *reinterpret_cast<const unsigned short*>(data);
+            appendString(out, reinterpret_cast<const char*>(data + sizeof(unsigned short)), str_len);
+            break;
+        }
+        case SQL_TEXT: {
+            const char* text_data = reinterpret_cast<const char*>(data);
+            unsigned int real_len = col.length;
+            while (real_len > 0 && text_data[real_len - 1] == ' ') {
+                real_len--;
+            }
+            appendString(out, text_data, real_len);
+            break;
+        }
+        // NUMERIC/DECIMAL хранятся целыми со scale - печатаются точно, без double
+        case SQL_SHORT:
+            appendDecimal(out, *reinterpret_cast<const int16_t*>(data), col.scale);
+            break;
+        case SQL_LONG:
+            appendDecimal(out, *reinterpret_cast<const int32_t*>(data), col.scale);
+            break;
+        case SQL_INT64:
+            appendDecimal(out, *reinterpret_cast<const int64_t*>(data), col.scale);
+            break;
+        case SQL_INT128:
+            appendInt128(out, *reinterpret_cast<const FB_I128*>(data), col.scale);
+            break;
+        case SQL_FLOAT:
+            appendFloating(out, *reinterpret_cast<const float*>(data));
+            break;
+        case SQL_DOUBLE:
+            appendFloating(out, *reinterpret_cast<const double*>(data));
+            break;
+        case SQL_DEC16:
+            if (!appendDecFloat16(out, *reinterpret_cast<const FB_DEC16*>(data))) out += "null";
+            break;
+        case SQL_DEC34:
+            if (!appendDecFloat34(out, *reinterpret_cast<const FB_DEC34*>(data))) out += "null";
+            break;
+        case SQL_BOOLEAN:
+            out += *data ? "true" : "false";
+            break;
+        case SQL_TYPE_DATE:
+            out.push_back('"');
+            appendDate(out, *reinterpret_cast<const ISC_DATE*>(data) - ISC_UNIX_EPOCH_DAYS);
+            out.push_back('"');
+            break;
+        case SQL_TYPE_TIME:
+            out.push_back('"');
+            appendTimeOfDay(out, *reinterpret_cast<const ISC_TIME*>(data) / ISC_TIME_SECONDS_PRECISION);
+            out.push_back('"');
+            break;
+        case SQL_TIMESTAMP: {
+            const ISC_TIMESTAMP* ts = reinterpret_cast<const ISC_TIMESTAMP*>(data);
+            out.push_back('"');
+            appendTimestamp(out, (ts->timestamp_date - ISC_UNIX_EPOCH_DAYS) * 86400
+                                 + ts->timestamp_time / ISC_TIME_SECONDS_PRECISION);
+            out.push_back('"');
+            break;
+        }
+        default:
+            out += "null";
+            break;
+    }
+}
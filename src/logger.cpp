@@ -0,0 +1,369 @@
+#include "logger.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+std::atomic<uint8_t> Logger::threshold{static_cast<uint8_t>(LogLevel::Info)};
+
+bool LogRateLimiter::allow(uint64_t& suppressed) {
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // новое окно открывает один поток; гонка на границе окна дает лишнюю запись, не больше
+    int64_t start = windowStart.load(std::memory_order_relaxed);
+    if (now - start >= 1'000'000'000 && windowStart.compare_exchange_strong(start, now)) {
+        inWindow.store(0, std::memory_order_relaxed);
+    }
+
+    if (inWindow.fetch_add(1, std::memory_order_relaxed) < BURST) {
+        suppressed = skipped.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    skipped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+namespace {
+
+// на поток: 256 КиБ - несколько тысяч строк запросов между проходами сборщика
+constexpr size_t RING_BYTES = 256 * 1024;
+// длиннее обрезается: запись не должна занимать заметную часть кольца
+constexpr size_t MAX_RECORD = 8 * 1024;
+constexpr uint32_t WRAP = 0xFFFFFFFF;  // до конца буфера пусто, запись - с начала
+
+struct RecordHeader {
+    uint32_t length;
+    LogLevel level;
+    int64_t time;  // system_clock, нс
+};
+
+constexpr size_t align8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+// Кольцо одного потока: пишет только владелец (head), читает только сборщик (tail).
+// Записи выровнены на 8 и не разрываются на конце буфера - там ставится WRAP
+struct Ring {
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    std::unique_ptr<char[]> buffer{new char[RING_BYTES]};
+    std::string scratch;  // строка записи, только поток-владелец
+
+    // занятые байты после записи; 0 - кольцо переполнено, запись потеряна
+    size_t push(LogLevel level, int64_t time, std::string_view text) {
+        const size_t need = align8(sizeof(RecordHeader) + text.size());
+        uint64_t position = head.load(std::memory_order_relaxed);
+        const uint64_t read = tail.load(std::memory_order_acquire);
+
+        size_t offset = position % RING_BYTES;
+        const size_t room = RING_BYTES - offset;
+        if (position + need + (room < need ? room : 0) - read > RING_BYTES) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        if (room < need) {
+            std::memcpy(buffer.get() + offset, &WRAP, sizeof(WRAP));
+            position += room;
+            offset = 0;
+        }
+
+        RecordHeader header{static_cast<uint32_t>(text.size()), level, time};
+        std::memcpy(buffer.get() + offset, &header, sizeof(header));
+        std::memcpy(buffer.get() + offset + sizeof(header), text.data(), text.size());
+        head.store(position + need, std::memory_order_release);
+        return static_cast<size_t>(position + need - read);
+    }
+
+    template <typename F>
+    void drain(F&& consume) {
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        const uint64_t written = head.load(std::memory_order_acquire);
+
+        while (position < written) {
+            const size_t offset = position % RING_BYTES;
+            RecordHeader header;
+            std::memcpy(&header.length, buffer.get() + offset, sizeof(header.length));
+            if (header.length == WRAP) {
+                position += RING_BYTES - offset;
+                continue;
+            }
+
+            std::memcpy(&header, buffer.get() + offset, sizeof(header));
+            consume(header, std::string_view(buffer.get() + offset + sizeof(header), header.length));
+            position += align8(sizeof(header) + header.length);
+        }
+        tail.store(position, std::memory_order_release);
+    }
+};
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Trace: return "trace";
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warn: return "warn";
+        case LogLevel::Error: return "error";
+        default: return "off";
+    }
+}
+
+// значение logfmt: в кавычках, если есть пробелы, '=', '"' или оно пустое
+void appendValue(std::string& out, std::string_view value) {
+    bool quote = value.empty();
+    for (char c : value) {
+        if (c <= ' ' || c == '=' || c == '"' || c == '\\') {
+            quote = true;
+            break;
+        }
+    }
+    if (!quote) {
+        out += value;
+        return;
+    }
+
+    out.push_back('"');
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+void appendField(std::string& out, const LogField& field) {
+    out.push_back(' ');
+    out += field.key;
+    out.push_back('=');
+
+    char number[32];
+    switch (field.kind) {
+        case LogField::Kind::Signed:
+            std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(field.signedValue));
+            out += number;
+            break;
+        case LogField::Kind::Unsigned:
+            std::snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(field.unsignedValue));
+            out += number;
+            break;
+        case LogField::Kind::Double:
+            std::snprintf(number, sizeof(number), "%.3f", field.doubleValue);
+            out += number;
+            break;
+        case LogField::Kind::Text:
+            appendValue(out, field.text);
+            break;
+    }
+}
+
+void appendTime(std::string& out, int64_t time) {
+    const std::time_t seconds = static_cast<std::time_t>(time / 1'000'000'000);
+    std::tm tm{};
+#ifdef _WIN32
+    gmtime_s(&tm, &seconds);
+#else
+    gmtime_r(&seconds, &tm);
+#endif
+    char text[40];
+    size_t length = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &tm);
+    std::snprintf(text + length, sizeof(text) - length, ".%03dZ",
+                  static_cast<int>(time / 1'000'000 % 1000));
+    out += text;
+}
+
+// Кольца всех потоков и сборщик. Кольцо живет и после выхода потока (как шарды Metrics):
+// потоки uda долгоживущие, а недочитанные записи ушедшего потока не теряются
+class Journal {
+private:
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    std::mutex drainMutex;  // сборщик один: фоновый поток или flush()
+    uint64_t reportedDropped = 0;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeUp;
+    std::atomic<bool> wakePending{false};
+    bool stopping = false;
+    std::thread thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (!stopping) {
+            wakeUp.wait_for(lock, Logger::DRAIN_INTERVAL, [this] { return stopping || wakePending; });
+            wakePending = false;
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+    }
+
+public:
+    Journal() : thread(&Journal::run, this) {}
+
+    ~Journal() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        thread.join();
+        drain();
+    }
+
+    // кольцо заполнено наполовину - сборщик не ждет конца интервала; одно уведомление на проход
+    void wake() {
+        if (!wakePending.exchange(true)) {
+            wakeUp.notify_one();
+        }
+    }
+
+    Ring& localRing() {
+        thread_local Ring* ring = nullptr;
+        if (!ring) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            rings.push_back(std::make_unique<Ring>());
+            ring = rings.back().get();
+        }
+        return *ring;
+    }
+
+    uint64_t dropped() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        uint64_t total = 0;
+        for (const auto& ring : rings) total += ring->dropped.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    void drain() {
+        std::lock_guard<std::mutex> drain_lock(drainMutex);
+
+        std::vector<Ring*> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (const auto& ring : rings) snapshot.push_back(ring.get());
+        }
+
+        // строки разных потоков - в порядке времени, а не колец
+        struct Line {
+            int64_t time;
+            std::string text;
+        };
+        std::vector<Line> lines;
+        uint64_t dropped_total = 0;
+
+        for (Ring* ring : snapshot) {
+            ring->drain([&](const RecordHeader& header, std::string_view text) {
+                std::string line = "ts=";
+                appendTime(line, header.time);
+                line += " level=";
+                line += levelName(header.level);
+                line.push_back(' ');
+                line += text;
+                line.push_back('\n');
+                lines.push_back({header.time, std::move(line)});
+            });
+            dropped_total += ring->dropped.load(std::memory_order_relaxed);
+        }
+
+        if (dropped_total > reportedDropped) {
+            const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            std::string line = "ts=";
+            appendTime(line, now);
+            line += " level=warn msg=\"log records dropped\" count=" + std::to_string(dropped_total - reportedDropped) + "\n";
+            lines.push_back({now, std::move(line)});
+            reportedDropped = dropped_total;
+        }
+
+        if (lines.empty()) return;
+
+        std::stable_sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) { return a.time < b.time; });
+
+        std::string out;
+        for (const Line& line : lines) out += line.text;
+        std::fwrite(out.data(), 1, out.size(), stderr);
+        std::fflush(stderr);
+    }
+};
+
+// Journal уже разрушен: записи из деструкторов статических объектов идут в stderr напрямую
+std::atomic<bool> journalClosed{false};
+
+Journal& journal() {
+    static struct Holder {
+        Journal instance;
+        ~Holder() { journalClosed = true; }
+    } holder;
+    return holder.instance;
+}
+
+} // namespace
+
+void Logger::setLevel(LogLevel level) {
+    threshold = static_cast<uint8_t>(std::max(static_cast<int>(level), UDA_LOG_LEVEL));
+}
+
+LogLevel Logger::parseLevel(std::string_view name) {
+    static const std::pair<std::string_view, LogLevel> LEVELS[] = {
+        {"trace", LogLevel::Trace}, {"debug", LogLevel::Debug}, {"info", LogLevel::Info},
+        {"warn", LogLevel::Warn}, {"error", LogLevel::Error}, {"off", LogLevel::Off},
+    };
+    for (const auto& [level_name, level] : LEVELS) {
+        if (name == level_name) return level;
+    }
+    throw std::invalid_argument("Unknown log level '" + std::string(name) + "'");
+}
+
+void Logger::write(LogLevel level, uint64_t suppressed, std::string_view message,
+                   std::initializer_list<LogField> fields) {
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (journalClosed) {
+        std::string line = std::string("level=") + levelName(level) + " msg=";
+        appendValue(line, message);
+        for (const LogField& field : fields) appendField(line, field);
+        line.push_back('\n');
+        std::fwrite(line.data(), 1, line.size(), stderr);
+        return;
+    }
+
+    // буфер строки переиспользуется - после первых записей выделений нет
+    Ring& ring = journal().localRing();
+    std::string& text = ring.scratch;
+    text.clear();
+    text += "msg=";
+    appendValue(text, message);
+    for (const LogField& field : fields) appendField(text, field);
+    if (suppressed > 0) appendField(text, LogField("suppressed", suppressed));
+
+    if (text.size() > MAX_RECORD) {
+        text.resize(MAX_RECORD - 3);
+        text += "...";
+    }
+    if (ring.push(level, now, text) > RING_BYTES / 2) {
+        journal().wake();
+    }
+}
+
+void Logger::flush() {
+    journal().drain();
+}
+
+uint64_t Logger::dropped() {
+    return journal().dropped();
+}
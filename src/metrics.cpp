@@ -0,0 +1,312 @@
+#include "metrics.h"
+#include "logger.h"
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+// Корзина значения в микросекундах: до 4 - точные значения, дальше по 4 на степень двойки
+constexpr unsigned SUB_BITS = 2;
+constexpr uint64_t SUB_BUCKETS = 1u << SUB_BITS;
+constexpr size_t BUCKETS = 160;  // хватает до 2^40 мкс (~12 суток)
+
+// в /metrics - корзины от 32 мкс до 2^25 мкс (~33 с), остальное попадает в соседние
+constexpr uint64_t EXPOSED_MIN_MICROS = 32;
+constexpr uint64_t EXPOSED_MAX_MICROS = uint64_t(1) << 25;
+
+const char* STAGE_NAMES[STAGE_COUNT] = {"queue", "acquire", "prepare", "fetch", "serialize", "send", "total"};
+
+size_t bucketIndex(uint64_t micros) {
+    if (micros < SUB_BUCKETS) return micros;
+
+    unsigned shift = static_cast<unsigned>(std::bit_width(micros)) - 1 - SUB_BITS;
+    size_t index = shift * SUB_BUCKETS + (micros >> shift);
+    return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+// первое значение, которое уже не попадает в корзину
+uint64_t bucketEnd(size_t index) {
+    if (index < SUB_BUCKETS) return index + 1;
+
+    size_t shift = index / SUB_BUCKETS - 1;
+    uint64_t mantissa = index % SUB_BUCKETS + SUB_BUCKETS;
+    return (mantissa + 1) << shift;
+}
+
+// счетчики шарда пишет только его поток: load + store вместо fetch_add,
+// /metrics читает их без блокировки
+void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+std::mutex fbErrorsMutex;
+std::map<intptr_t, uint64_t> fbErrors;
+std::map<std::string, uint64_t> cancelledQueries;
+
+} // namespace
+
+struct Metrics::Shard {
+  struct Histogram {
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets;
+    std::atomic<uint64_t> sumNanos;
+  };
+
+  struct RouteCells {
+    std::array<Histogram, STAGE_COUNT> stages;
+    std::array<std::atomic<uint64_t>, 6> statuses;  // по классу кода: 1xx..5xx, 0 - прочие
+    std::atomic<uint64_t> rows;
+    std::atomic<uint64_t> bytes;
+  };
+
+  // ячейки маршрута создаются при первом его запросе в этом потоке
+  std::array<std::atomic<RouteCells*>, MAX_ROUTES> routes = {};
+
+  ~Shard() {
+      for (auto& cells : routes) {
+          delete cells.load();
+      }
+  }
+};
+
+Metrics::Metrics() = default;
+
+Metrics::~Metrics() = default;
+
+MetricsRoute Metrics::route(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    for (size_t i = 0; i < routeNames.size(); i++) {
+        if (routeNames[i] == name) return {this, i, &routeNames[i]};
+    }
+    if (routeNames.size() >= MAX_ROUTES) {
+        throw std::runtime_error("Too many metrics routes");
+    }
+    routeNames.push_back(name);
+    return {this, routeNames.size() - 1, &routeNames.back()};
+}
+
+Metrics::Shard& Metrics::localShard() {
+    thread_local const Metrics* owner = nullptr;
+    thread_local Shard* shard = nullptr;
+
+    if (owner != this) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        shards.push_back(std::make_unique<Shard>());
+        shard = shards.back().get();
+        owner = this;
+    }
+    return *shard;
+}
+
+void Metrics::record(size_t route, const std::array<uint64_t, STAGE_COUNT>& nanos, uint32_t observed,
+                     int status, uint64_t rows, uint64_t bytes) {
+    Shard& shard = localShard();
+
+    Shard::RouteCells* cells = shard.routes[route].load(std::memory_order_acquire);
+    if (!cells) {
+        cells = new Shard::RouteCells();
+        shard.routes[route].store(cells, std::memory_order_release);
+    }
+
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        if (!(observed & (1u << i))) continue;
+
+        Shard::Histogram& histogram = cells->stages[i];
+        bump(histogram.buckets[bucketIndex(nanos[i] / 1000)], 1);
+        bump(histogram.sumNanos, nanos[i]);
+    }
+
+    int status_class = status / 100;
+    bump(cells->statuses[status_class >= 1 && status_class <= 5 ? status_class : 0], 1);
+    bump(cells->rows, rows);
+    bump(cells->bytes, bytes);
+}
+
+void Metrics::firebirdError(intptr_t code) {
+    std::lock_guard<std::mutex> lock(fbErrorsMutex);
+    fbErrors[code]++;
+}
+
+void Metrics::queryCancelled(const char* reason) {
+    std::lock_guard<std::mutex> lock(fbErrorsMutex);
+    cancelledQueries[reason]++;
+}
+
+void Metrics::appendScalar(std::string& out, const char* name, const char* type,
+                           const char* help, double value) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n",
+                  name, help, name, type, name, value);
+    out += line;
+}
+
+std::string Metrics::render() const {
+    struct Totals {
+        std::array<std::array<uint64_t, BUCKETS>, STAGE_COUNT> buckets = {};
+        std::array<uint64_t, STAGE_COUNT> sumNanos = {};
+        std::array<uint64_t, 6> statuses = {};
+        uint64_t rows = 0;
+        uint64_t bytes = 0;
+        bool seen = false;
+    };
+
+    std::vector<std::string> names;
+    std::vector<Totals> totals;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        names.assign(routeNames.begin(), routeNames.end());
+        totals.resize(names.size());
+
+        for (const auto& shard : shards) {
+            for (size_t r = 0; r < names.size(); r++) {
+                const Shard::RouteCells* cells = shard->routes[r].load(std::memory_order_acquire);
+                if (!cells) continue;
+
+                Totals& t = totals[r];
+                t.seen = true;
+                for (size_t s = 0; s < STAGE_COUNT; s++) {
+                    for (size_t b = 0; b < BUCKETS; b++) {
+                        t.buckets[s][b] += cells->stages[s].buckets[b].load(std::memory_order_relaxed);
+                    }
+                    t.sumNanos[s] += cells->stages[s].sumNanos.load(std::memory_order_relaxed);
+                }
+                for (size_t c = 0; c < t.statuses.size(); c++) {
+                    t.statuses[c] += cells->statuses[c].load(std::memory_order_relaxed);
+                }
+                t.rows += cells->rows.load(std::memory_order_relaxed);
+                t.bytes += cells->bytes.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::string out;
+    out.reserve(64 * 1024);
+    char line[256];
+
+    out += "# HELP uda_request_stage_seconds Time spent in each stage of a request\n"
+           "# TYPE uda_request_stage_seconds histogram\n";
+    for (size_t r = 0; r < names.size(); r++) {
+        const Totals& t = totals[r];
+        if (!t.seen) continue;
+
+        for (size_t s = 0; s < STAGE_COUNT; s++) {
+            uint64_t count = 0;
+            for (size_t b = 0; b < BUCKETS; b++) {
+                count += t.buckets[s][b];
+                uint64_t end = bucketEnd(b);
+                if (end < EXPOSED_MIN_MICROS || end > EXPOSED_MAX_MICROS) continue;
+
+                std::snprintf(line, sizeof(line),
+                              "uda_request_stage_seconds_bucket{route=\"%s\",stage=\"%s\",le=\"%g\"} %llu\n",
+                              names[r].c_str(), STAGE_NAMES[s], end / 1e6,
+                              static_cast<unsigned long long>(count));
+                out += line;
+            }
+            std::snprintf(line, sizeof(line),
+                          "uda_request_stage_seconds_bucket{route=\"%s\",stage=\"%s\",le=\"+Inf\"} %llu\n"
+                          "uda_request_stage_seconds_sum{route=\"%s\",stage=\"%s\"} %.9f\n"
+                          "uda_request_stage_seconds_count{route=\"%s\",stage=\"%s\"} %llu\n",
+                          names[r].c_str(), STAGE_NAMES[s], static_cast<unsigned long long>(count),
+                          names[r].c_str(), STAGE_NAMES[s], t.sumNanos[s] / 1e9,
+                          names[r].c_str(), STAGE_NAMES[s], static_cast<unsigned long long>(count));
+            out += line;
+        }
+    }
+
+    static const char* STATUS_CLASSES[6] = {"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+
+    out += "# HELP uda_requests_total Requests by route and status class\n"
+           "# TYPE uda_requests_total counter\n";
+    for (size_t r = 0; r < names.size(); r++) {
+        for (size_t c = 0; c < totals[r].statuses.size(); c++) {
+            if (totals[r].statuses[c] == 0) continue;
+            std::snprintf(line, sizeof(line), "uda_requests_total{route=\"%s\",code=\"%s\"} %llu\n",
+                          names[r].c_str(), STATUS_CLASSES[c],
+                          static_cast<unsigned long long>(totals[r].statuses[c]));
+            out += line;
+        }
+    }
+
+    out += "# HELP uda_response_rows_total Rows read from Firebird or a snapshot for responses\n"
+           "# TYPE uda_response_rows_total counter\n";
+    for (size_t r = 0; r < names.size(); r++) {
+        if (!totals[r].seen) continue;
+        std::snprintf(line, sizeof(line), "uda_response_rows_total{route=\"%s\"} %llu\n",
+                      names[r].c_str(), static_cast<unsigned long long>(totals[r].rows));
+        out += line;
+    }
+
+    out += "# HELP uda_response_bytes_total Response body bytes\n"
+           "# TYPE uda_response_bytes_total counter\n";
+    for (size_t r = 0; r < names.size(); r++) {
+        if (!totals[r].seen) continue;
+        std::snprintf(line, sizeof(line), "uda_response_bytes_total{route=\"%s\"} %llu\n",
+                      names[r].c_str(), static_cast<unsigned long long>(totals[r].bytes));
+        out += line;
+    }
+
+    out += "# HELP uda_firebird_errors_total Firebird errors by gds code\n"
+           "# TYPE uda_firebird_errors_total counter\n";
+    {
+        std::lock_guard<std::mutex> lock(fbErrorsMutex);
+        for (const auto& [code, count] : fbErrors) {
+            std::snprintf(line, sizeof(line), "uda_firebird_errors_total{code=\"%lld\"} %llu\n",
+                          static_cast<long long>(code), static_cast<unsigned long long>(count));
+            out += line;
+        }
+
+        out += "# HELP uda_query_cancelled_total Queries cancelled by timeout, deadline or client disconnect\n"
+               "# TYPE uda_query_cancelled_total counter\n";
+        for (const auto& [reason, count] : cancelledQueries) {
+            std::snprintf(line, sizeof(line), "uda_query_cancelled_total{reason=\"%s\"} %llu\n",
+                          reason.c_str(), static_cast<unsigned long long>(count));
+            out += line;
+        }
+    }
+
+    return out;
+}
+
+thread_local RequestTrace* RequestTrace::current = nullptr;
+
+RequestTrace::RequestTrace(MetricsRoute route, std::chrono::steady_clock::time_point start)
+    : route(route), start(start), previous(current) {
+    current = this;
+}
+
+RequestTrace::~RequestTrace() {
+    current = previous;
+}
+
+void RequestTrace::finish(int status, uint64_t bytes) {
+    if (finished || !route.metrics) return;
+    finished = true;
+
+    nanos[static_cast<size_t>(Stage::Total)] = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    observed |= 1u << static_cast<unsigned>(Stage::Total);
+
+    route.metrics->record(route.index, nanos, observed, status, rowCount, bytes);
+
+    UDA_LOG_INFO("request", {{"route", *route.name}, {"status", status}, {"rows", rowCount}, {"bytes", bytes},
+                             {"duration_ms", std::chrono::nanoseconds(nanos[static_cast<size_t>(Stage::Total)])},
+                             {"db_ms", std::chrono::nanoseconds(nanos[static_cast<size_t>(Stage::Fetch)])}});
+}
+
+void RequestTrace::stage(Stage stage, std::chrono::steady_clock::duration elapsed) {
+    if (!current) return;
+
+    auto index = static_cast<unsigned>(stage);
+    current->nanos[index] += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    current->observed |= 1u << index;
+}
+
+void RequestTrace::rows(uint64_t count) {
+    if (current) {
+        current->rowCount += count;
+    }
+}
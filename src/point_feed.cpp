@@ -0,0 +1,255 @@
+#include "point_feed.h"
+#include "json_writer.h"
+#include "logger.h"
+#include <string>
+#include <vector>
+
+PointFeed::PointFeed(FirebirdRouter& pool, KeysetSpec spec, std::string sessions_table,
+                     std::chrono::milliseconds interval)
+    : pool(pool), spec(spec), sessionsTable(std::move(sessions_table)), interval(interval) {
+    ticker = std::thread(&PointFeed::run, this);
+}
+
+PointFeed::~PointFeed() {
+    {
+        std::lock_guard<std::mutex> lock(feedMutex);
+        stopping = true;
+    }
+    stopSignal.notify_all();
+
+    if (ticker.joinable()) {
+        ticker.join();
+    }
+}
+
+static std::string errorMessage(const std::string& text) {
+    std::string message = "{\"error\":";
+    JsonWriter::appendString(message, text.data(), text.size());
+    message.push_back('}');
+    return message;
+}
+
+static std::string sessionError(int64_t session_id, const std::string& text) {
+    std::string message = "{\"session\":" + std::to_string(session_id) + ",\"error\":";
+    JsonWriter::appendString(message, text.data(), text.size());
+    message.push_back('}');
+    return message;
+}
+
+static std::string subscribedMessage(int64_t session_id, int64_t after) {
+    return "{\"session\":" + std::to_string(session_id)
+        + ",\"subscribed\":true,\"after\":" + std::to_string(after) + "}";
+}
+
+void PointFeed::handleMessage(crow::websocket::connection& conn, const std::string& data) {
+    try {
+        crow::json::rvalue msg = crow::json::load(data);
+        if (!msg) {
+            conn.send_text(errorMessage("Malformed JSON"));
+            return;
+        }
+
+        if (msg.has("subscribe")) {
+            subscribe(conn, msg["subscribe"].i());
+        } else if (msg.has("unsubscribe")) {
+            unsubscribe(conn, msg["unsubscribe"].i());
+        } else {
+            conn.send_text(errorMessage("Expected subscribe or unsubscribe"));
+        }
+    } catch (const std::exception& e) {
+        // не объект / не число
+        conn.send_text(errorMessage(e.what()));
+    }
+}
+
+void PointFeed::subscribe(crow::websocket::connection& conn, int64_t session_id) {
+    std::lock_guard<std::mutex> lock(feedMutex);
+
+    auto existing = sessions.find(session_id);
+    const bool known = existing != sessions.end();
+    if (known && (existing->second.subscribers.count(&conn) || existing->second.pending.count(&conn))) {
+        // повторная подписка - как первая, но без второго места в лимите
+        if (existing->second.lastKey) conn.send_text(subscribedMessage(session_id, *existing->second.lastKey));
+        return;
+    }
+
+    auto count = subscriptions.find(&conn);
+    if (count != subscriptions.end() && count->second >= MAX_SUBSCRIPTIONS) {
+        conn.send_text(sessionError(session_id, "Too many subscriptions on this connection (max "
+                                                + std::to_string(MAX_SUBSCRIPTIONS) + ")"));
+        return;
+    }
+    if (!known && sessions.size() >= MAX_SESSIONS) {
+        conn.send_text(sessionError(session_id, "Too many live sessions, try again later"));
+        return;
+    }
+    subscriptions[&conn]++;
+
+    Session& session = sessions[session_id];
+    if (session.lastKey) {
+        // сессию уже отслеживаем - граница известна, БД не нужна
+        session.subscribers.insert(&conn);
+        conn.send_text(subscribedMessage(session_id, *session.lastKey));
+    } else {
+        // сессию и MAX(POINT_ID) проверит ticker, подписчик получит ответ вместе с остальными
+        session.pending.insert(&conn);
+    }
+}
+
+void PointFeed::unsubscribe(crow::websocket::connection& conn, int64_t session_id) {
+    std::lock_guard<std::mutex> lock(feedMutex);
+
+    auto it = sessions.find(session_id);
+    if (it == sessions.end()) return;
+
+    if (it->second.subscribers.erase(&conn) + it->second.pending.erase(&conn) > 0) {
+        release(&conn);
+    }
+    if (it->second.subscribers.empty() && it->second.pending.empty()) {
+        sessions.erase(it);
+    }
+}
+
+void PointFeed::disconnect(crow::websocket::connection& conn) {
+    std::lock_guard<std::mutex> lock(feedMutex);
+
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        it->second.subscribers.erase(&conn);
+        it->second.pending.erase(&conn);
+        if (it->second.subscribers.empty() && it->second.pending.empty()) {
+            it = sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    subscriptions.erase(&conn);
+}
+
+void PointFeed::release(crow::websocket::connection* conn) {
+    auto it = subscriptions.find(conn);
+    if (it != subscriptions.end() && --it->second == 0) {
+        subscriptions.erase(it);
+    }
+}
+
+size_t PointFeed::sessionCount() {
+    std::lock_guard<std::mutex> lock(feedMutex);
+    return sessions.size();
+}
+
+void PointFeed::run() {
+    std::unique_lock<std::mutex> lock(feedMutex);
+
+    while (!stopping) {
+        stopSignal.wait_for(lock, interval, [this] { return stopping; });
+        if (stopping) break;
+
+        std::vector<std::pair<int64_t, std::optional<int64_t>>> work;
+        work.reserve(sessions.size());
+        for (const auto& [session_id, session] : sessions) {
+            work.emplace_back(session_id, session.lastKey);
+        }
+        if (work.empty()) continue;
+
+        // запросы - без блокировки, подписки в это время продолжают приниматься
+        lock.unlock();
+
+        try {
+            // одно подключение на весь такт
+            PooledConnection fbc = pool.acquire();
+            for (const auto& [session_id, last_key] : work) {
+                try {
+                    poll(fbc, session_id, last_key);
+                } catch (const std::exception& e) {
+                    UDA_LOG_ERROR("Point feed poll failed", {{"session", session_id}, {"error", e.what()}});
+                    if (!fbc->connected()) break;
+                }
+            }
+        } catch (const std::exception& e) {
+            UDA_LOG_ERROR("Point feed poll failed", {{"error", e.what()}});
+        }
+
+        lock.lock();
+    }
+}
+
+void PointFeed::poll(PooledConnection& fbc, int64_t session_id, std::optional<int64_t> last_key) {
+    SqlParams params;
+
+    // 1. Новая сессия: точки, которые уже есть, клиент берет через /api/points?after=.
+    //    Строки нет - нет и сессии: подписчики получают ошибку, сессия больше не опрашивается
+    if (!last_key) {
+        std::string query = std::string("SELECT (SELECT MAX(") + spec.key_column + ") FROM " + spec.table
+            + " WHERE " + spec.filter_column + " = ?) FROM " + sessionsTable
+            + " WHERE " + spec.filter_column + " = ?";
+        params.push_back(session_id);
+        params.push_back(session_id);
+
+        int64_t max_key = 0;
+        size_t found = fbc->fetch(query, params, [&](const RowPlan& plan, const unsigned char* message) {
+            max_key = RowPlan::integer(plan.getColumns()[0], message).value_or(0);
+        });
+
+        std::lock_guard<std::mutex> lock(feedMutex);
+        auto it = sessions.find(session_id);
+        if (it == sessions.end() || it->second.lastKey) return;
+
+        Session& session = it->second;
+        if (found == 0) {
+            std::string message = sessionError(session_id, "Unknown session");
+            for (crow::websocket::connection* conn : session.pending) {
+                conn->send_text(message);
+                release(conn);
+            }
+            sessions.erase(it);
+            return;
+        }
+        session.lastKey = max_key;
+
+        std::string message = subscribedMessage(session_id, max_key);
+        for (crow::websocket::connection* conn : session.pending) {
+            conn->send_text(message);
+            session.subscribers.insert(conn);
+        }
+        session.pending.clear();
+        return;
+    }
+
+    // 2. Только новые строки; если их больше страницы - остаток заберет следующий такт
+    PageRequest page;
+    page.after = *last_key;
+    page.limit = MAX_PAGE_LIMIT;
+    std::string query = buildKeysetQuery(spec, page, {}, session_id, params);
+
+    JsonWriter writer(true);
+    std::optional<int64_t> new_key;
+    const RowPlan* key_plan = nullptr;
+    int key_index = -1;
+
+    size_t rows = fbc->fetch(query, params, [&](const RowPlan& plan, const unsigned char* message) {
+        writer.writeRow(plan, message);
+
+        if (key_plan != &plan) {
+            key_plan = &plan;
+            key_index = plan.find(spec.key_column);
+        }
+        if (key_index >= 0) {
+            new_key = RowPlan::integer(plan.getColumns()[key_index], message);
+        }
+    });
+    if (rows == 0 || !new_key) return;
+
+    std::string message = "{\"session\":" + std::to_string(session_id) + ",\"points\":";
+    message += writer.finish();
+    message.push_back('}');
+
+    std::lock_guard<std::mutex> lock(feedMutex);
+    auto it = sessions.find(session_id);
+    if (it == sessions.end() || it->second.lastKey != last_key) return;
+
+    // send_text только ставит кадр в очередь io-потока соединения
+    it->second.lastKey = new_key;
+    for (crow::websocket::connection* conn : it->second.subscribers) {
+        conn->send_text(message);
+    }
+}
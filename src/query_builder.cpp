@@ -0,0 +1,166 @@
+#include "query_builder.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+int64_t parseInteger(std::string_view text, const char* name) {
+    int64_t value = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || ptr != text.data() + text.size()) {
+        throw std::invalid_argument(std::string("Invalid '") + name + "' value");
+    }
+    return value;
+}
+
+std::string quoted(const std::string& column) {
+    return "\"" + column + "\"";
+}
+
+} // namespace
+
+PageRequest parsePageRequest(const char* after, const char* limit, const char* fields) {
+    PageRequest page;
+
+    if (after && *after) {
+        page.after = parseInteger(after, "after");
+    }
+
+    if (limit && *limit) {
+        int64_t value = parseInteger(limit, "limit");
+        if (value <= 0) {
+            throw std::invalid_argument("'limit' must be positive");
+        }
+        page.limit = std::min<size_t>(static_cast<size_t>(value), MAX_PAGE_LIMIT);
+    } else if (page.after) {
+        page.limit = DEFAULT_PAGE_LIMIT;
+    }
+
+    if (fields && *fields) {
+        std::string_view list(fields);
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view item = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+            while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+            while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+            if (item.empty()) continue;
+
+            // в системных таблицах имена без кавычек хранятся в верхнем регистре
+            std::string name(item);
+            std::transform(name.begin(), name.end(), name.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+
+            if (std::find(page.fields.begin(), page.fields.end(), name) == page.fields.end()) {
+                page.fields.push_back(std::move(name));
+            }
+        }
+    }
+
+    return page;
+}
+
+std::vector<std::string> SchemaCache::columns(FirebirdRouter& pool, const std::string& table) {
+    {
+        std::lock_guard<std::mutex> lock(schemaMutex);
+        auto it = tables.find(table);
+        if (it != tables.end()) return it->second;
+    }
+
+    std::vector<std::string> result;
+    PooledConnection fbc = pool.acquire();
+    fbc->fetch("SELECT RDB$FIELD_NAME FROM RDB$RELATION_FIELDS WHERE RDB$RELATION_NAME = ? "
+              "ORDER BY RDB$FIELD_POSITION",
+              {table},
+              [&](const RowPlan& plan, const unsigned char* message) {
+                  result.emplace_back(RowPlan::text(plan.getColumns()[0], message));
+              });
+
+    if (result.empty()) {
+        throw std::runtime_error("Table " + table + " not found");
+    }
+
+    std::lock_guard<std::mutex> lock(schemaMutex);
+    tables[table] = result;
+    return result;
+}
+
+void SchemaCache::invalidate(const std::string& table) {
+    std::lock_guard<std::mutex> lock(schemaMutex);
+    tables.erase(table);
+}
+
+std::string buildKeysetQuery(const KeysetSpec& spec, const PageRequest& page,
+                             const std::vector<std::string>& table_columns,
+                             int64_t filter_value, SqlParams& params,
+                             const std::string& not_null_column) {
+    std::string projection;
+    if (page.fields.empty()) {
+        projection = "*";
+    } else {
+        for (const std::string& field : page.fields) {
+            if (std::find(table_columns.begin(), table_columns.end(), field) == table_columns.end()) {
+                throw std::invalid_argument("Unknown column '" + field + "'");
+            }
+            if (!projection.empty()) projection += ", ";
+            projection += quoted(field);
+        }
+        if (std::find(page.fields.begin(), page.fields.end(), spec.key_column) == page.fields.end()) {
+            projection += ", " + quoted(spec.key_column);
+        }
+    }
+
+    std::string query = "SELECT " + projection + " FROM " + spec.table
+                      + " WHERE " + spec.filter_column + " = ?";
+    params.clear();
+    params.emplace_back(filter_value);
+
+    if (!not_null_column.empty()) {
+        query += " AND " + quoted(not_null_column) + " IS NOT NULL";
+    }
+
+    // без after/limit - прежнее поведение: вся выборка
+    if (!page.paged()) {
+        if (spec.descending) {
+            query += std::string(" ORDER BY ") + spec.key_column + " DESC";
+        }
+        return query;
+    }
+
+    // seek по индексу ключа вместо OFFSET: сервер читает только нужную страницу
+    if (page.after) {
+        query += std::string(" AND ") + spec.key_column + (spec.descending ? " < ?" : " > ?");
+        params.emplace_back(*page.after);
+    }
+
+    query += std::string(" ORDER BY ") + spec.key_column + (spec.descending ? " DESC" : " ASC");
+    query += " ROWS ?";
+    params.emplace_back(static_cast<int64_t>(page.limit));
+
+    return query;
+}
+
+uint64_t countKeysetRows(PooledConnection& fbc, const KeysetSpec& spec, const PageRequest& page,
+                         int64_t filter_value, const std::string& not_null_column) {
+    std::string query = std::string("SELECT COUNT(*) FROM ") + spec.table
+                      + " WHERE " + spec.filter_column + " = ?";
+    SqlParams params = {filter_value};
+
+    if (!not_null_column.empty()) {
+        query += " AND " + quoted(not_null_column) + " IS NOT NULL";
+    }
+    if (page.after) {
+        query += std::string(" AND ") + spec.key_column + (spec.descending ? " < ?" : " > ?");
+        params.emplace_back(*page.after);
+    }
+
+    uint64_t count = 0;
+    fbc->fetch(query, params, [&](const RowPlan& plan, const unsigned char* message) {
+        count = static_cast<uint64_t>(RowPlan::integer(plan.getColumns()[0], message).value_or(0));
+    });
+    return count;
+}
@@ -0,0 +1,150 @@
+#include "query_deadline.h"
+#include "fb_connect.h"
+#include "metrics.h"
+#include <algorithm>
+
+using Clock = std::chrono::steady_clock;
+
+static const char* cancelMessage(CancelReason reason) {
+    switch (reason) {
+        case CancelReason::StatementTimeout: return "Query timed out";
+        case CancelReason::Deadline: return "Request deadline exceeded";
+        case CancelReason::ClientGone: return "Client closed the connection";
+    }
+    return "Query cancelled";
+}
+
+static const char* cancelLabel(CancelReason reason) {
+    switch (reason) {
+        case CancelReason::StatementTimeout: return "statement_timeout";
+        case CancelReason::Deadline: return "deadline";
+        case CancelReason::ClientGone: return "client_gone";
+    }
+    return "other";
+}
+
+QueryCancelled::QueryCancelled(CancelReason reason)
+    : std::runtime_error(cancelMessage(reason)), why(reason) {}
+
+void QueryCancelled::raise(CancelReason reason) {
+    Metrics::queryCancelled(cancelLabel(reason));
+    throw QueryCancelled(reason);
+}
+
+thread_local RequestDeadline* RequestDeadline::current = nullptr;
+
+RequestDeadline::RequestDeadline(RouteTimeouts timeouts, Clock::time_point start,
+                                 std::function<bool()> client_alive)
+    : timeouts(timeouts),
+      expires(timeouts.deadline.count() > 0 ? start + timeouts.deadline : Clock::time_point::max()),
+      clientAlive(std::move(client_alive)),
+      previous(current) {
+    current = this;
+}
+
+RequestDeadline::~RequestDeadline() {
+    current = previous;
+}
+
+void RequestDeadline::check() const {
+    if (Clock::now() >= expires) {
+        QueryCancelled::raise(CancelReason::Deadline);
+    }
+    if (clientGone()) {
+        QueryCancelled::raise(CancelReason::ClientGone);
+    }
+}
+
+unsigned int RequestDeadline::statementTimeoutMs() const {
+    auto timeout = timeouts.statement;
+
+    if (expires != Clock::time_point::max()) {
+        // округление вверх: 0 означало бы "без ограничения"
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(expires - Clock::now());
+        remaining = std::max(remaining, std::chrono::milliseconds(1));
+        timeout = timeout.count() > 0 ? std::min(timeout, remaining) : remaining;
+    }
+    return static_cast<unsigned int>(timeout.count());
+}
+
+QueryWatchdog::QueryWatchdog() {
+    thread = std::thread(&QueryWatchdog::run, this);
+}
+
+QueryWatchdog::~QueryWatchdog() {
+    {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+QueryWatchdog& QueryWatchdog::instance() {
+    static QueryWatchdog watchdog;
+    return watchdog;
+}
+
+void QueryWatchdog::run() {
+    std::unique_lock<std::mutex> lock(watchMutex);
+    while (!stopping) {
+        auto now = Clock::now();
+        auto wake = now + POLL_INTERVAL;
+        bool rescan = false;
+
+        for (Entry& entry : entries) {
+            if (entry.fired) continue;
+
+            if (now >= entry.expires) {
+                entry.fired = CancelReason::Deadline;
+            } else if (entry.clientAlive && !entry.clientAlive()) {
+                entry.fired = CancelReason::ClientGone;
+            } else {
+                wake = std::min(wake, entry.expires);
+                continue;
+            }
+
+            // cancelOperation - сетевой вызов: без блокировки, Guard подождет его окончания
+            entry.cancelling = true;
+            lock.unlock();
+            entry.conn->cancel();
+            lock.lock();
+            entry.cancelling = false;
+            cancelled.notify_all();
+
+            // пока блокировки не было, список мог измениться - обход заново
+            rescan = true;
+            break;
+        }
+
+        if (!rescan && !stopping && wake > Clock::now()) {
+            wakeUp.wait_until(lock, wake);
+        }
+    }
+}
+
+QueryWatchdog::Guard::Guard(FirebirdConnection& conn, const RequestDeadline& deadline)
+    : watchdog(QueryWatchdog::instance()) {
+    std::lock_guard<std::mutex> lock(watchdog.watchMutex);
+    entry = watchdog.entries.insert(watchdog.entries.end(),
+                                    {&conn, deadline.expires, deadline.clientAlive, std::nullopt});
+    watchdog.wakeUp.notify_one();
+}
+
+QueryWatchdog::Guard::~Guard() {
+    release();
+}
+
+std::optional<CancelReason> QueryWatchdog::Guard::release() {
+    if (released) return result;
+    released = true;
+
+    std::unique_lock<std::mutex> lock(watchdog.watchMutex);
+    watchdog.cancelled.wait(lock, [this] { return !entry->cancelling; });
+    result = entry->fired;
+    watchdog.entries.erase(entry);
+    return result;
+}
@@ -0,0 +1,53 @@
+#include "request_arena.h"
+#include <memory>
+
+namespace {
+
+struct ThreadBlock {
+  std::unique_ptr<std::byte[]> data = std::make_unique<std::byte[]>(RequestArena::THREAD_BLOCK);
+  bool busy = false;
+};
+
+ThreadBlock& threadBlock() {
+    thread_local ThreadBlock block;
+    return block;
+}
+
+std::byte* claimThreadBlock() {
+    ThreadBlock& block = threadBlock();
+    if (block.busy) return nullptr;  // вложенная арена - начнет с upstream
+    block.busy = true;
+    return block.data.get();
+}
+
+} // namespace
+
+RequestArena::RequestArena()
+    : block(claimThreadBlock()),
+      upstream(std::pmr::new_delete_resource()),
+      small(block, block ? THREAD_BLOCK : 0, upstream) {}
+
+RequestArena::~RequestArena() {
+    small.release();
+    if (block) {
+        threadBlock().busy = false;
+    }
+}
+
+void* RequestArena::do_allocate(size_t bytes, size_t alignment) {
+    if (bytes >= LARGE_ALLOCATION) {
+        return upstream->allocate(bytes, alignment);
+    }
+    return small.allocate(bytes, alignment);
+}
+
+void RequestArena::do_deallocate(void* ptr, size_t bytes, size_t alignment) {
+    // мелкое освобождается вместе с ареной
+    if (bytes >= LARGE_ALLOCATION) {
+        upstream->deallocate(ptr, bytes, alignment);
+    }
+}
+
+bool RequestArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,177 @@
+#include "response_cache.h"
+
+ResponseCache::ResponseCache(size_t max_bytes, CompressionConfig compression)
+    : maxShardBytes(max_bytes / SHARDS), compression(compression) {}
+
+ResponseCache::Shard& ResponseCache::shardFor(const std::string& key) {
+    return shards[std::hash<std::string>{}(key) % SHARDS];
+}
+
+size_t ResponseCache::entrySize(const std::string& key, const CachedResponse& value) {
+    return key.size() + value.body.size() + value.content_type.size() + value.etag.size()
+           + value.next_cursor.size();
+}
+
+void ResponseCache::erase(Shard& shard, std::unordered_map<std::string, Entry>::iterator it) {
+    shard.bytes -= it->second.bytes;
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::get(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        misses++;
+        return nullptr;
+    }
+
+    if (std::chrono::steady_clock::now() >= it->second.value->expires) {
+        erase(shard, it);
+        expired++;
+        misses++;
+        return nullptr;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    hits++;
+    return it->second.value;
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::put(const std::string& key, std::string body,
+                                                         std::string content_type,
+                                                         std::chrono::milliseconds ttl,
+                                                         std::string next_cursor) {
+    auto value = std::make_shared<CachedResponse>();
+    value->etag = etagFor(body);
+    value->body = std::move(body);
+    value->content_type = std::move(content_type);
+    value->next_cursor = std::move(next_cursor);
+    value->expires = std::chrono::steady_clock::now() + ttl;
+
+    const size_t size = entrySize(key, *value);
+
+    // слишком большие ответы не кэшируем - они вытеснили бы весь шард
+    if (size > maxShardBytes) {
+        return value;
+    }
+
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        erase(shard, it);
+    }
+
+    while (!shard.lru.empty() && shard.bytes + size > maxShardBytes) {
+        erase(shard, shard.entries.find(shard.lru.back()));
+        evictions++;
+    }
+
+    shard.lru.push_front(key);
+    shard.entries.emplace(key, Entry{value, shard.lru.begin(), size});
+    shard.bytes += size;
+
+    return value;
+}
+
+std::shared_ptr<const std::string> ResponseCache::encoded(const std::string& key, const CachedResponse& value,
+                                                          ContentEncoding encoding) {
+    if (!compresses(value, encoding)) {
+        return nullptr;
+    }
+
+    const size_t index = static_cast<size_t>(encoding);
+    {
+        std::lock_guard<std::mutex> lock(value.encodedMutex);
+        if (value.encoded[index]) return value.encoded[index];
+    }
+
+    // сжатие - без блокировок; два первых одновременных запроса сожмут дважды, сохранится один вариант
+    auto body = std::make_shared<const std::string>(compressBody(encoding, value.body, compression));
+    {
+        std::lock_guard<std::mutex> lock(value.encodedMutex);
+        if (value.encoded[index]) return value.encoded[index];
+        value.encoded[index] = body;
+    }
+
+    // запись могли уже вытеснить или заменить - тогда вариант живет, пока жив value
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end() && it->second.value.get() == &value) {
+        it->second.bytes += body->size();
+        shard.bytes += body->size();
+
+        while (shard.bytes > maxShardBytes && shard.lru.back() != key) {
+            erase(shard, shard.entries.find(shard.lru.back()));
+            evictions++;
+        }
+    }
+    return body;
+}
+
+void ResponseCache::invalidate(const std::string& key) {
+    invalidations++;
+
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        erase(shard, it);
+    }
+}
+
+void ResponseCache::invalidatePrefix(const std::string& prefix) {
+    invalidations++;
+
+    // ключи с общим префиксом разбросаны по шардам хэшем - обходим все
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            auto next = std::next(it);
+            if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                erase(shard, it);
+            }
+            it = next;
+        }
+    }
+}
+
+ResponseCacheStats ResponseCache::stats() {
+    ResponseCacheStats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.evictions = evictions;
+    result.expired = expired;
+
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result.entries += shard.entries.size();
+        result.bytes += shard.bytes;
+    }
+
+    return result;
+}
+
+std::string ResponseCache::etagFor(const std::string& body) {
+    static const char hex[] = "0123456789abcdef";
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : body) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    std::string etag(18, '"');
+    for (int i = 0; i < 16; i++) {
+        etag[16 - i] = hex[hash & 0xF];
+        hash >>= 4;
+    }
+    return etag;
+}
@@ -0,0 +1,97 @@
+#include "result_spool.h"
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+ResultSpool::ResultSpool(std::filesystem::path dir, std::chrono::seconds ttl)
+    : dir(std::move(dir)), ttl(ttl) {
+    std::random_device rd;
+    instance = std::to_string(rd());
+
+    std::filesystem::create_directories(this->dir);
+
+    // остатки прошлых запусков
+    sweep();
+    lastSweep = std::chrono::steady_clock::now();
+}
+
+std::filesystem::path ResultSpool::create(const std::string& extension) {
+    {
+        std::lock_guard<std::mutex> lock(sweepMutex);
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastSweep > std::chrono::minutes(1)) {
+            lastSweep = now;
+            sweep();
+        }
+    }
+
+    return dir / (instance + "-" + std::to_string(counter++) + extension);
+}
+
+std::filesystem::path ResultSpool::link(const std::filesystem::path& source, const std::string& extension) {
+    std::filesystem::path path = create(extension);
+
+    std::error_code ec;
+    std::filesystem::create_hard_link(source, path, ec);
+    if (ec) {
+        // другой том или ФС без жестких ссылок
+        ec.clear();
+        std::filesystem::copy_file(source, path, ec);
+        if (ec) {
+            throw std::runtime_error("Cannot link " + source.string() + " into spool: " + ec.message());
+        }
+    } else {
+        // у ссылки время изменения исходного файла - без этого sweep счел бы ее устаревшей сразу
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    }
+    return path;
+}
+
+void ResultSpool::sweep() {
+    std::error_code ec;
+    const auto now = std::filesystem::file_time_type::clock::now();
+
+    std::vector<std::filesystem::path> expired;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file(ec)) continue;
+
+        auto modified = entry.last_write_time(ec);
+        if (!ec && now - modified > ttl) {
+            expired.push_back(entry.path());
+        }
+    }
+
+    for (const auto& path : expired) {
+        std::filesystem::remove(path, ec);
+    }
+}
+
+SpoolFile::~SpoolFile() {
+    // не дошли до commit - файл никому не нужен
+    if (file.is_open()) {
+        file.close();
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+}
+
+void SpoolFile::write(const std::string& chunk) {
+    if (!file.is_open()) {
+        path = spool.create(extension);
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Cannot create spool file " + path.string());
+        }
+    }
+
+    // запись блокирует - fetch не обгоняет диск
+    file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write spool file " + path.string());
+    }
+}
+
+std::string SpoolFile::commit() {
+    file.close();
+    return path.string();
+}
@@ -0,0 +1,355 @@
+#include "snapshot_store.h"
+#include "logger.h"
+#include <columnar_writer.h>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace fs = std::filesystem;
+
+static constexpr const char* SNAPSHOT_PREFIX = "session-";
+static constexpr const char* SNAPSHOT_EXTENSION = ".udac";
+// порция записи файла снимка и порог сброса колонок при сборке
+static constexpr size_t SNAPSHOT_CHUNK = 256 * 1024;
+
+Snapshot::Snapshot(const fs::path& snapshot_path) : path(snapshot_path), file(snapshot_path) {
+    std::string error;
+    if (!reader.open(file.data(), file.size(), error)) {
+        throw std::runtime_error("Corrupt snapshot " + path.string() + ": " + error);
+    }
+}
+
+SnapshotStore::SnapshotStore(SnapshotConfig conf, KeysetSpec spec)
+    : config(std::move(conf)), spec(spec) {
+    if (!enabled()) return;
+
+    fs::create_directories(config.dir);
+
+    // снимки переживают перезапуск: индексируем то, что уже лежит в каталоге
+    auto now = Clock::now();
+    for (const fs::directory_entry& item : fs::directory_iterator(config.dir)) {
+        if (!item.is_regular_file()) continue;
+
+        const fs::path& path = item.path();
+        std::string name = path.filename().string();
+
+        // недописанный файл после падения
+        if (path.extension() == ".tmp") {
+            std::error_code ec;
+            fs::remove(path, ec);
+            continue;
+        }
+
+        if (path.extension() != SNAPSHOT_EXTENSION || name.rfind(SNAPSHOT_PREFIX, 0) != 0) continue;
+
+        try {
+            int64_t session_id = std::stoll(path.stem().string().substr(std::strlen(SNAPSHOT_PREFIX)));
+            uint64_t bytes = item.file_size();
+            entries[session_id] = {bytes, nullptr, now};
+            totalBytes += bytes;
+        } catch (const std::exception&) {
+            // чужой файл - не трогаем
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(storeMutex);
+    evict();
+}
+
+fs::path SnapshotStore::pathFor(int64_t session_id) const {
+    return config.dir / (SNAPSHOT_PREFIX + std::to_string(session_id) + SNAPSHOT_EXTENSION);
+}
+
+SharedSnapshot SnapshotStore::get(FirebirdRouter& pool, int64_t session_id) {
+    // 1. Уже отображен
+    bool on_disk = false;
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        auto it = entries.find(session_id);
+        if (it != entries.end()) {
+            it->second.used = Clock::now();
+            if (it->second.snapshot) {
+                counters.hits++;
+                return it->second.snapshot;
+            }
+            on_disk = true;
+
+            // отображение - та же сборка: изменение во время него не должно вернуть файл в хранилище
+            Build& state = building[session_id];
+            state.builders++;
+            generation = state.generation;
+        }
+    }
+
+    // 2. Файл с прошлого запуска - отображаем; битый удаляется и строится заново
+    if (on_disk) {
+        SharedSnapshot snapshot;
+        try {
+            snapshot = std::make_shared<const Snapshot>(pathFor(session_id));
+        } catch (const std::exception& e) {
+            UDA_LOG_WARN("Snapshot is unreadable", {{"session", session_id}, {"error", e.what()}});
+            finishBuild(session_id, generation, nullptr);
+            remove(session_id);
+        }
+
+        if (snapshot) {
+            snapshot = finishBuild(session_id, generation, std::move(snapshot));
+
+            std::lock_guard<std::mutex> lock(storeMutex);
+            if (snapshot) counters.hits++;
+            return snapshot;
+        }
+    }
+
+    // 3. Первое чтение: снимок только для закрытой сессии, одновременные запросы ждут одну сборку
+    return builds.run(std::to_string(session_id), [&]() -> SharedSnapshot {
+        // снимок живет, пока сессию не изменят, - отстающая реплика записала бы в него неполные данные
+        const uint64_t generation = beginBuild(session_id);
+        SharedSnapshot snapshot;
+        try {
+            PooledConnection fbc = pool.acquirePrimary();
+            if (closed(fbc, session_id)) {
+                snapshot = build(fbc, session_id);
+            }
+        } catch (...) {
+            finishBuild(session_id, generation, nullptr);
+            throw;
+        }
+
+        // сессию изменили во время сборки - этот запрос идет в БД, снимок соберет следующий
+        return finishBuild(session_id, generation, std::move(snapshot));
+    });
+}
+
+bool SnapshotStore::closed(PooledConnection& fbc, int64_t session_id) {
+    std::string query = "SELECT 1 FROM " + config.sessions_table
+                      + " WHERE SESSION_ID = ? AND (" + config.closed_condition + ")";
+
+    size_t rows = fbc->fetch(query, {session_id}, [](const RowPlan&, const unsigned char*) {});
+    return rows > 0;
+}
+
+SharedSnapshot SnapshotStore::build(PooledConnection& fbc, int64_t session_id) {
+    std::string query = std::string("SELECT * FROM ") + spec.table + " WHERE " + spec.filter_column
+                      + " = ? ORDER BY " + spec.key_column + (spec.descending ? " DESC" : " ASC");
+
+    // 1. Во временный файл, 2. rename - читатели видят либо старый файл, либо целый новый
+    fs::path path = pathFor(session_id);
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+
+        // длинная сессия не собирается в памяти: колонки сверх SNAPSHOT_CHUNK уходят во временный
+        // файл писателя, а тело пишется в снимок порциями
+        ColumnarWriter writer;
+        writer.setSpill(SNAPSHOT_CHUNK);
+        try {
+            fbc->fetch(query, {session_id}, [&](const RowPlan& plan, const unsigned char* message) {
+                writer.writeRow(plan, message);
+            });
+            writer.finish([&](const std::string& chunk) {
+                file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            }, SNAPSHOT_CHUNK);
+        } catch (...) {
+            file.close();
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            throw;
+        }
+
+        file.close();
+        if (!file) {
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            throw std::runtime_error("Failed to write snapshot " + tmp.string());
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        throw std::runtime_error("Failed to store snapshot " + path.string());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        counters.builds++;
+    }
+
+    return std::make_shared<const Snapshot>(path);
+}
+
+uint64_t SnapshotStore::beginBuild(int64_t session_id) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    Build& state = building[session_id];
+    state.builders++;
+    return state.generation;
+}
+
+SharedSnapshot SnapshotStore::finishBuild(int64_t session_id, uint64_t generation, SharedSnapshot snapshot) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    auto it = building.find(session_id);
+    const bool current = it->second.generation == generation;
+    if (--it->second.builders == 0) {
+        building.erase(it);
+    }
+
+    if (!snapshot) return nullptr;
+    if (current) {
+        add(session_id, snapshot);
+        return snapshot;
+    }
+
+    // файл уже переименован на место: удаляем, пока его никто не отобразил
+    fs::path path = snapshot->path;
+    snapshot.reset();  // на Windows отображенный файл не удалить
+    if (entries.find(session_id) == entries.end()) {
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+    return nullptr;
+}
+
+void SnapshotStore::add(int64_t session_id, SharedSnapshot snapshot) {
+    // вызывается под storeMutex
+    Entry& entry = entries[session_id];
+    totalBytes -= entry.bytes;
+    entry.bytes = snapshot->file.size();
+    totalBytes += entry.bytes;
+    entry.snapshot = std::move(snapshot);
+    entry.used = Clock::now();
+
+    evict();
+}
+
+void SnapshotStore::evict() {
+    // вызывается под storeMutex; последний добавленный не вытесняется
+    while (totalBytes > config.max_bytes && entries.size() > 1) {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.used < oldest->second.used) oldest = it;
+        }
+
+        // ответы держат свое отображение или ссылку на файл в spool - удалять файл безопасно
+        std::error_code ec;
+        fs::remove(pathFor(oldest->first), ec);
+
+        totalBytes -= oldest->second.bytes;
+        entries.erase(oldest);
+        counters.evictions++;
+    }
+}
+
+void SnapshotStore::remove(int64_t session_id) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    auto build = building.find(session_id);
+    if (build != building.end()) {
+        build->second.generation++;
+    }
+
+    auto it = entries.find(session_id);
+    if (it != entries.end()) {
+        totalBytes -= it->second.bytes;
+        entries.erase(it);
+    }
+
+    std::error_code ec;
+    fs::remove(pathFor(session_id), ec);
+}
+
+void SnapshotStore::clear() {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    for (auto& [session_id, state] : building) state.generation++;
+
+    for (const auto& [session_id, entry] : entries) {
+        std::error_code ec;
+        fs::remove(pathFor(session_id), ec);
+    }
+    entries.clear();
+    totalBytes = 0;
+}
+
+size_t SnapshotStore::verify(FirebirdRouter& pool) {
+    std::vector<int64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        for (const auto& [session_id, entry] : entries) ids.push_back(session_id);
+    }
+
+    size_t broken = 0;
+    for (int64_t session_id : ids) {
+        std::string problem;
+        try {
+            uint64_t rows = Snapshot(pathFor(session_id)).reader.rowCount();
+            // снимки собираются с primary - и сверяются с ним
+            PooledConnection fbc = pool.acquirePrimary();
+            uint64_t expected = countKeysetRows(fbc, spec, PageRequest{}, session_id);
+            if (rows != expected) {
+                problem = std::to_string(rows) + " rows, database has " + std::to_string(expected);
+            }
+        } catch (const std::exception& e) {
+            problem = e.what();
+        }
+
+        if (!problem.empty()) {
+            // обслуживание из CLI: каждая сломанная сессия в выводе, без лимита повторов
+            UDA_LOG_AT(LogLevel::Warn, "Snapshot is broken", {{"session", session_id}, {"problem", problem}});
+            remove(session_id);
+            broken++;
+        }
+    }
+
+    UDA_LOG_INFO("Snapshot store verified", {{"checked", ids.size()}, {"broken", broken}});
+    return broken;
+}
+
+size_t SnapshotStore::rebuild(FirebirdRouter& pool) {
+    std::vector<int64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        for (auto& [session_id, entry] : entries) {
+            entry.snapshot.reset();  // на Windows отображенный файл нельзя заменить
+            ids.push_back(session_id);
+        }
+    }
+
+    size_t rebuilt = 0;
+    for (int64_t session_id : ids) {
+        const uint64_t generation = beginBuild(session_id);
+        try {
+            PooledConnection fbc = pool.acquirePrimary();
+            if (!closed(fbc, session_id)) {
+                // сессию снова открыли - снимок больше не действителен
+                finishBuild(session_id, generation, nullptr);
+                remove(session_id);
+                continue;
+            }
+            if (finishBuild(session_id, generation, build(fbc, session_id))) rebuilt++;
+        } catch (const std::exception& e) {
+            UDA_LOG_AT(LogLevel::Warn, "Snapshot rebuild failed", {{"session", session_id}, {"error", e.what()}});
+            finishBuild(session_id, generation, nullptr);
+            remove(session_id);
+        }
+    }
+
+    UDA_LOG_INFO("Snapshot store rebuilt", {{"rebuilt", rebuilt}, {"total", ids.size()}});
+    return rebuilt;
+}
+
+SnapshotStats SnapshotStore::stats() {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    SnapshotStats result = counters;
+    result.entries = entries.size();
+    result.bytes = totalBytes;
+    return result;
+}
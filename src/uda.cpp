@@ -1,193 +1,576 @@
 #include <uda.h>
 
-int main()
+// таблицы с keyset пагинацией (?after=&limit=&fields=)
+static const KeysetSpec SESSIONS_KEYSET = {"RD2_SESSIONS", "DEVICE_ID", "SESSION_ID", true};
+static const KeysetSpec POINTS_KEYSET = {"RD2_POINTS", "SESSION_ID", "POINT_ID", false};
+
+// TTL кэша ответов для почти статичных маршрутов
+static constexpr std::chrono::seconds BOARDS_TTL{30};
+static constexpr std::chrono::seconds PARAM_TTL{60};
+// пока слушатель событий подключен, кэш сбрасывается по изменениям, а TTL - только страховка
+static constexpr std::chrono::hours EVENT_TTL{24};
+
+// statement - таймаут каждого запроса к БД, deadline - весь ответ с очередью executor'а,
+// max_lag - допустимое отставание реплики. Маршруты с кэшем ответов читают primary: кэш
+// сбрасывается по событиям primary, и ответ отстающей реплики остался бы в нем надолго
+static constexpr RouteTimeouts LOOKUP_TIMEOUTS = {std::chrono::seconds(5), std::chrono::seconds(10)};
+static constexpr RouteTimeouts SESSIONS_TIMEOUTS = {std::chrono::seconds(15), std::chrono::seconds(30)};
+static constexpr RouteTimeouts POINTS_TIMEOUTS = {std::chrono::seconds(60), std::chrono::seconds(120),
+                                                  std::chrono::seconds(10)};
+
+// переменная окружения, если задана (пустое значение тоже считается) - для стенда uda_bench
+static std::string envOr(const char* name, const char* fallback) {
+    const char* value = std::getenv(name);
+    return value ? value : fallback;
+}
+
+// целая переменная окружения в пределах [min, max]; не задана - fallback
+static long long envInt(const char* name, long long fallback, long long min, long long max) {
+    const char* value = std::getenv(name);
+    if (!value) return fallback;
+
+    char* end = nullptr;
+    long long result = std::strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || result < min || result > max) {
+        throw std::invalid_argument(std::string(name) + " must be an integer from "
+                                    + std::to_string(min) + " to " + std::to_string(max));
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
 {
     using namespace Firebird;
 
+    // журнал асинхронный; UDA_LOG_LEVEL=debug добавляет SQL каждого запроса
+    // (если debug не отрезан при сборке: cmake -DUDA_LOG_LEVEL=...)
+    try {
+        Logger::setLevel(Logger::parseLevel(envOr("UDA_LOG_LEVEL", "info")));
+    } catch (const std::invalid_argument &e) {
+        UDA_LOG_ERROR("Invalid UDA_LOG_LEVEL", {{"error", e.what()}});
+        return 2;
+    }
+
     crow::SimpleApp app;
+    // собственные строки Crow пишутся синхронно в поток вывода - запросы журналирует RequestTrace
+    app.loglevel(crow::LogLevel::Warning);
 
     // firebird connect
+    // UDA_DB_HOST="" - embedded-подключение к локальному файлу UDA_DB_PATH
     FBConnectionStruct fb_conf = {
-        "C:\\base\\TSDSQL.FDB",
-        "UDR",
-        "tsdsql",
-        "10.105.160.98",
-        "3050"
+        envOr("UDA_DB_PATH", "C:\\base\\TSDSQL.FDB"),
+        envOr("UDA_DB_USER", "UDR"),
+        envOr("UDA_DB_PASSWORD", "tsdsql"),
+        envOr("UDA_DB_HOST", "10.105.160.98"),
+        envOr("UDA_DB_PORT", "3050")
     };
 
-    // FirebirdConnection fbc(fb_conf);
-    //
-    // std::cout << "Connecting to Firebird database..." << std::endl;
-    // if (!fbc.connect()) {
-    //     std::cerr << "FATAL: Failed to connect to database on startup!" << std::endl;
-    //     return 1; // Завершаем приложение, если не удалось подключиться
-    // }
-    // std::cout << "Successfully connected to database!" << std::endl;
+    // пул заранее держит открытые attachment'ы - запросы не платят за attach/detach;
+    // по attachment'у на каждый рабочий поток Crow, чтобы запросы не ждали друг друга
+    FBPoolConfig pool_conf;
+    pool_conf.min_size = 2;
+    pool_conf.max_size = std::max(4u, std::thread::hardware_concurrency());
+    // фоновые запросы (живые точки, снимки) идут без срока запроса - ограничиваем attachment
+    pool_conf.statement_timeout = std::chrono::minutes(5);
+
+    // чтение распределяется между primary и репликами UDA_DB_REPLICAS ("host/port:path;...")
+    std::vector<FBConnectionStruct> replicas;
+    try {
+        replicas = parseReplicaList(envOr("UDA_DB_REPLICAS", ""), fb_conf);
+    } catch (const std::invalid_argument &e) {
+        UDA_LOG_ERROR("Invalid UDA_DB_REPLICAS", {{"error", e.what()}});
+        return 2;
+    }
+
+    // UDA_DB_LAG_QUERY - счетчик для пробы отставания реплик (см. sql/uda_replica_lag.sql)
+    FBRouterConfig router_conf;
+    router_conf.lag_query = envOr("UDA_DB_LAG_QUERY", router_conf.lag_query.c_str());
+
+    FirebirdRouter pool(fb_conf, replicas, pool_conf, router_conf);
+
+    // JSON точек и сессий однообразен и сжимается в разы; на медленных каналах между площадками
+    // передача дороже сжатия. Кэш хранит сжатые варианты и не сжимает тело на каждое попадание
+    // UDA_COMPRESS_MIN_SIZE, UDA_GZIP_LEVEL, UDA_ZSTD_LEVEL, UDA_BROTLI_LEVEL - поверх умолчаний CompressionConfig
+    CompressionConfig compression;
+    try {
+        compression.min_size = static_cast<size_t>(envInt("UDA_COMPRESS_MIN_SIZE", compression.min_size, 0, 1ll << 30));
+        compression.gzip_level = static_cast<int>(envInt("UDA_GZIP_LEVEL", compression.gzip_level, 1, 9));
+        compression.zstd_level = static_cast<int>(envInt("UDA_ZSTD_LEVEL", compression.zstd_level, 1, 19));
+        compression.brotli_level = static_cast<int>(envInt("UDA_BROTLI_LEVEL", compression.brotli_level, 0, 11));
+    } catch (const std::invalid_argument &e) {
+        UDA_LOG_ERROR("Invalid compression settings", {{"error", e.what()}});
+        return 2;
+    }
+
+    ResultSpool spool;
+    SchemaCache schema;
+    ResponseCache cache(64 * 1024 * 1024, compression);
+
+    // одинаковые одновременные запросы (волна обновлений дашбордов) идут в БД один раз
+    QueryFlight flight;
+
+    // по потоку на attachment пулов всех узлов: больше потоков все равно ждали бы подключение
+    DbExecutorConfig executor_conf;
+    executor_conf.threads = pool_conf.max_size * pool.nodeCount();
+    DbExecutor executor(executor_conf);
+
+    // снимки закрытых сессий на диске: повторное чтение истории не идет в БД
+    // UDA_SNAPSHOT_CLOSED - условие закрытой сессии RD2_SESSIONS (например "END_TIME IS NOT NULL"):
+    // ее точки больше не меняются и уходят в снимок. Не задано - снимков нет, все читается из БД
+    SnapshotConfig snapshot_conf;
+    snapshot_conf.dir = envOr("UDA_SNAPSHOT_DIR", "snapshots");
+    snapshot_conf.closed_condition = envOr("UDA_SNAPSHOT_CLOSED", "");
+    SnapshotStore snapshots(snapshot_conf, POINTS_KEYSET);
+
+    // обслуживание снимков: uda --snapshot-verify | --snapshot-rebuild
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--snapshot-verify") {
+            return snapshots.verify(pool) == 0 ? 0 : 1;
+        }
+        if (arg == "--snapshot-rebuild") {
+            snapshots.rebuild(pool);
+            return 0;
+        }
+    }
+
+    // UDA_EVENTS=1: изменения DEVICES, RD2_SESSIONS, PASSP_SCAN и точек закрытых сессий приходят
+    // событиями Firebird - кэш сбрасывается точечно по ключам. Нужны триггеры sql/uda_events.sql,
+    // поэтому по умолчанию выключено: без событий кэш живет короткие TTL
+    std::optional<ChangeListener> changes;
+    if (envOr("UDA_EVENTS", "0") == "1") {
+        // снимки переживают перезапуск - позиция журнала рядом с ними, чтобы дочитать простой
+        ChangeListenerConfig listener_conf;
+        if (snapshots.enabled()) listener_conf.position_file = snapshot_conf.dir / "changes.position";
+
+        changes.emplace(fb_conf, listener_conf,
+            [&](const ChangeEvent& change) {
+                if (change.table == "DEVICES") {
+                    cache.invalidate("/api/boards");
+                    cache.invalidate("/api/boards/" + std::to_string(change.row_id));
+                } else if (change.table == "PASSP_SCAN") {
+                    cache.invalidate("/api/param/" + std::to_string(change.row_id));
+                } else if (change.table == SESSIONS_KEYSET.table) {
+                    cache.invalidate("/api/session/" + std::to_string(change.row_id));
+                    if (change.parent_id) {
+                        cache.invalidatePrefix("/api/sessions/" + std::to_string(*change.parent_id) + "?");
+                    }
+                    snapshots.invalidate(change.row_id);
+                } else if (change.table == POINTS_KEYSET.table && change.parent_id) {
+                    snapshots.invalidate(*change.parent_id);
+                }
+            },
+            [&]() {
+                // DDL или потерянный журнал: колонки, ответы и снимки могли поменяться
+                schema.invalidate(SESSIONS_KEYSET.table);
+                schema.invalidate(POINTS_KEYSET.table);
+                cache.invalidatePrefix("");
+                snapshots.clear();
+            });
+    }
+    auto eventsActive = [&]() { return changes && changes->active(); };
+
+    // без событий - короткие TTL, как раньше
+    auto cacheTtl = [&](std::chrono::milliseconds ttl) -> std::chrono::milliseconds {
+        return eventsActive() ? EVENT_TTL : ttl;
+    };
 
-    CROW_ROUTE(app, "/api/boards")([&]() {
-        try {
-            FirebirdConnection fbc(fb_conf);
-            if (!fbc.connect()) {
-                throw std::runtime_error("Failed to connect to Firebird database");
+    // живые точки активных сессий: один запрос на сессию за такт, сколько бы ни было клиентов
+    PointFeed feed(pool, POINTS_KEYSET, SESSIONS_KEYSET.table);
+
+    // задержки по этапам, строки и байты ответов - в /metrics
+    Metrics metrics;
+    const MetricsRoute boards_metrics = metrics.route("/api/boards");
+    const MetricsRoute board_metrics = metrics.route("/api/boards/:id");
+    const MetricsRoute sessions_metrics = metrics.route("/api/sessions/:id");
+    const MetricsRoute session_metrics = metrics.route("/api/session/:id");
+    const MetricsRoute points_metrics = metrics.route("/api/points/:id");
+    const MetricsRoute param_metrics = metrics.route("/api/param/:id");
+
+    // Блокирующие вызовы Firebird выполняются на executor'е, а не на потоках Crow:
+    // медленная выгрузка точек не мешает принимать соединения и отдавать статистику
+    CROW_ROUTE(app, "/api/boards")([&](const crow::request& req, crow::response& res) {
+        respondAsync(executor, boards_metrics, DbPriority::High, LOOKUP_TIMEOUTS, res, [&](crow::response& res) {
+            try {
+                cachedResponse(res, cache, req, "/api/boards", cacheTtl(BOARDS_TTL), [&]() {
+                    // Получаем данные из БД сразу JSON-текстом
+                    return querySharedRows(flight, pool, "SELECT * FROM DEVICES", {}, {.array = true});
+                });
+
+            } catch (const QueryCancelled &e) {
+                res = crow::response(504, e.what());
+            } catch (const std::exception &e) {
+                UDA_LOG_ERROR("request failed", {{"route", "/api/boards"}, {"error", e.what()}});
+
+                res = crow::response(500, e.what());
             }
+        });
+    });
 
-            // Получаем данные из БД
-            std::vector<crow::json::wvalue> boards = fbc.getSQL("SELECT * FROM DEVICES");
-            fbc.disconnect();
-
-            if (boards.empty())
-                return crow::response(404, "Not found");
-
-            // ПРЕОБРАЗУЕМ вектор в JSON-массив
-            crow::json::wvalue result_json;
-            for (size_t i = 0; i < boards.size(); i++) {
-                result_json[i] = std::move(boards[i]);
+    CROW_ROUTE(app, "/api/boards/<int>")([&](const crow::request& req, crow::response& res, int id) {
+        respondAsync(executor, board_metrics, DbPriority::High, LOOKUP_TIMEOUTS, res, [&, id](crow::response& res) {
+            try {
+                cachedResponse(res, cache, req, "/api/boards/" + std::to_string(id), cacheTtl(BOARDS_TTL), [&]() {
+                    std::string query = "SELECT * FROM DEVICES WHERE DEVICE_ID = ?";
+                    UDA_LOG_DEBUG("query", {{"route", "/api/boards/:id"}, {"id", id}, {"sql", query}});
+
+                    return querySharedRows(flight, pool, query, {id}, {.array = false});
+                });
+            } catch (const QueryCancelled &e) {
+                res = crow::response(504, e.what());
+            } catch (const std::exception &e) {
+                UDA_LOG_ERROR("request failed", {{"route", "/api/boards/:id"}, {"id", id}, {"error", e.what()}});
+                res = crow::response(500, e.what());
             }
-
-            // Возвращаем JSON напрямую - Crow знает как его обработать
-            return crow::response(200, result_json);
-
-        } catch (const std::exception &e) {
-            std::cerr << "Error in /api/boards: " << e.what() << std::endl;
-
-            return crow::response(500, e.what());
-        }
+        });
     });
 
-    CROW_ROUTE(app, "/api/boards/<int>")([&](int id) {
+    CROW_ROUTE(app, "/api/sessions/<int>")([&](const crow::request& req, crow::response& res, int id) {
+        PageRequest page;
         try {
-            FirebirdConnection fbc(fb_conf);
-            if (!fbc.connect()) {
-                throw std::runtime_error("Failed to connect to Firebird database");
-            }
-
-            std::string query = "SELECT * FROM DEVICES WHERE DEVICE_ID=" + std::to_string(id);
-            std::cout << query << std::endl;
-
-            std::vector<crow::json::wvalue> board = fbc.getSQL(query);
-            // crow::json::wvalue result_json;
-            // result_json[0] = std::move(board[0]);
-            fbc.disconnect();
-
-            if (board.empty())
-                return crow::response(404, "Not found");
-
-            return crow::response(200, board[0]);
-        } catch (const std::exception &e) {
-            std::cerr << "Error in /api/boards: " << e.what() << std::endl;
-            return crow::response(500, e.what());
+            // разбор параметров дешевый - ошибку клиента отдаем сразу, без очереди
+            page = parsePageRequest(req.url_params.get("after"),
+                                    req.url_params.get("limit"),
+                                    req.url_params.get("fields"));
+        } catch (const std::invalid_argument &e) {
+            res = crow::response(400, e.what());
+            res.end();
+            return;
         }
-    });
 
-    CROW_ROUTE(app, "/api/sessions/<int>")([&](int id) {
-        try {
-            FirebirdConnection fbc(fb_conf);
-            if (!fbc.connect()) {
-                throw std::runtime_error("Failed to connect to Firebird database");
+        respondAsync(executor, sessions_metrics, DbPriority::Normal, SESSIONS_TIMEOUTS, res, [&, id, page](crow::response& res) {
+            try {
+                // кэшу нужно несжатое тело - он сжимает его сам; spool-файл в кэш не попадает
+                // и сжимается сразу
+                const bool cached = eventsActive();
+
+                auto produce = [&]() {
+                    std::vector<std::string> columns;
+                    if (!page.fields.empty())
+                        columns = schema.columns(pool, SESSIONS_KEYSET.table);
+
+                    SqlParams params;
+                    std::string query = buildKeysetQuery(SESSIONS_KEYSET, page, columns, id, params);
+                    UDA_LOG_DEBUG("query", {{"route", "/api/sessions/:id"}, {"id", id}, {"sql", query}});
+
+                    return querySharedRows(flight, pool, query, params,
+                                           {.array = true, .spool = &spool,
+                                            .cursor_column = SESSIONS_KEYSET.key_column,
+                                            .page_limit = page.limit,
+                                            .columnar = acceptsColumnar(req),
+                                            .encoding = acceptedEncoding(req),
+                                            .compression = compression,
+                                            .cacheable = cached});
+                };
+
+                // список сессий меняется постоянно - кэшируется, только пока о смене сообщают события.
+                // Все страницы устройства под общим префиксом: изменение сессии сбрасывает их разом
+                if (cached) {
+                    std::string key = "/api/sessions/" + std::to_string(id) + "?"
+                                    + (page.after ? std::to_string(*page.after) : "") + "&"
+                                    + std::to_string(page.limit) + "&";
+                    for (const std::string& field : page.fields) key += field + ",";
+                    if (acceptsColumnar(req)) key += "&columnar";
+
+                    cachedResponse(res, cache, req, key, EVENT_TTL, produce);
+                } else {
+                    toResponse(res, *produce());
+                }
+            } catch (const std::invalid_argument &e) {
+                res = crow::response(400, e.what());
+            } catch (const QueryCancelled &e) {
+                res = crow::response(504, e.what());
+            } catch (const std::exception &e) {
+                UDA_LOG_ERROR("request failed", {{"route", "/api/sessions/:id"}, {"id", id}, {"error", e.what()}});
+
+                res = crow::response(500, e.what());
             }
+        });
+    });
 
-            std::string query = "SELECT * FROM RD2_SESSIONS WHERE DEVICE_ID=" + std::to_string(id) + " ORDER BY SESSION_ID DESC";
-            std::cout << query << std::endl;
-
-            std::vector<crow::json::wvalue> sessions = fbc.getSQL(query);
-            fbc.disconnect();
-
-            if (sessions.empty())
-                return crow::response(404, "Not found");
-
-            crow::json::wvalue result_json;
-            for (size_t i = 0; i < sessions.size(); i++) {
-                result_json[i] = std::move(sessions[i]);
+    CROW_ROUTE(app, "/api/session/<int>")([&](const crow::request& req, crow::response& res, int id) {
+        respondAsync(executor, session_metrics, DbPriority::High, LOOKUP_TIMEOUTS, res, [&, id](crow::response& res) {
+            try {
+                auto produce = [&]() {
+                    std::string query = "SELECT * FROM RD2_SESSIONS WHERE SESSION_ID = ?";
+                    UDA_LOG_DEBUG("query", {{"route", "/api/session/:id"}, {"id", id}, {"sql", query}});
+
+                    return querySharedRows(flight, pool, query, {id}, {.array = false});
+                };
+
+                if (eventsActive()) {
+                    cachedResponse(res, cache, req, "/api/session/" + std::to_string(id), EVENT_TTL, produce);
+                } else {
+                    toResponse(res, *produce());
+                }
+            } catch (const QueryCancelled &e) {
+                res = crow::response(504, e.what());
+            } catch (const std::exception &e) {
+                UDA_LOG_ERROR("request failed", {{"route", "/api/session/:id"}, {"id", id}, {"error", e.what()}});
+                res = crow::response(500, e.what());
             }
-
-            return crow::response(200, result_json);
-        } catch (const std::exception &e) {
-            std::cerr << "Error in /api/sessions: " << e.what() << std::endl;
-
-            return crow::response(500, e.what());
-        }
+        });
     });
 
-    CROW_ROUTE(app, "/api/session/<int>")([&](int id) {
+    // выгрузка точек - самая тяжелая, поэтому низкий приоритет и короткая очередь.
+    // ?downsample=N&method=lttb|minmax&y=COL[&x=COL] - серия прореживается на сервере
+    CROW_ROUTE(app, "/api/points/<int>")([&](const crow::request& req, crow::response& res, int id) {
+        PageRequest page;
+        std::optional<DownsampleSpec> downsample;
         try {
-            FirebirdConnection fbc(fb_conf);
-            if (!fbc.connect()) {
-                throw std::runtime_error("Failed to connect to Firebird database");
-            }
-
-            std::string query = "SELECT * FROM RD2_SESSIONS WHERE SESSION_ID=" + std::to_string(id);
-            std::cout << query << std::endl;
-
-            std::vector<crow::json::wvalue> session = fbc.getSQL(query);
-            fbc.disconnect();
-
-            if (session.empty())
-                return crow::response(404, "Not found");
-
-            // crow::json::wvalue result_json;
-            // for (size_t i = 0; i < session.size(); i++) {
-            //     result_json[i] = std::move(session[i]);
-            // }
-
-            return crow::response(200, session[0]);
-        } catch (const std::exception &e) {
-            std::cerr << "Error in /api/session: " << e.what() << std::endl;
-            return crow::response(500, e.what());
+            page = parsePageRequest(req.url_params.get("after"),
+                                    req.url_params.get("limit"),
+                                    req.url_params.get("fields"));
+            downsample = parseDownsample(req.url_params.get("downsample"),
+                                         req.url_params.get("method"),
+                                         req.url_params.get("x"),
+                                         req.url_params.get("y"));
+            if (downsample && downsample->x_column.empty())
+                downsample->x_column = POINTS_KEYSET.key_column;
+        } catch (const std::invalid_argument &e) {
+            res = crow::response(400, e.what());
+            res.end();
+            return;
         }
-    });
 
-    CROW_ROUTE(app, "/api/points/<int>")([&](int id) {
-        try {
-            FirebirdConnection fbc(fb_conf);
-            if (!fbc.connect()) {
-                throw std::runtime_error("Failed to connect to Firebird database");
+        respondAsync(executor, points_metrics, DbPriority::Low, POINTS_TIMEOUTS, res, [&, id, page, downsample](crow::response& res) {
+            try {
+                // вся серия закрытой сессии - из снимка
+                // снимки с прошлого запуска - только после того, как журнал за простой разослан
+                bool snapshots_ready = snapshots.enabled() && (!changes || changes->synced());
+                if (snapshots_ready && !page.paged() && page.fields.empty() && !downsample) {
+                    // снимок - только ускорение: не нашелся или не собрался - ответ из БД
+                    SharedSnapshot snapshot;
+                    try {
+                        snapshot = snapshots.get(pool, id);
+                    } catch (const QueryCancelled &) {
+                        throw;
+                    } catch (const std::exception &e) {
+                        UDA_LOG_WARN("Snapshot unavailable, reading from database", {{"session", id}, {"error", e.what()}});
+                    }
+
+                    if (snapshot) {
+                        toResponse(res, snapshotRows(*snapshot, {.array = true, .spool = &spool,
+                                                                 .columnar = acceptsColumnar(req),
+                                                                 .encoding = acceptedEncoding(req),
+                                                                 .compression = compression}));
+                        return;
+                    }
+                }
+
+                PageRequest query_page = page;
+                std::optional<DownsampleSpec> spec = downsample;
+                std::string not_null;
+
+                std::vector<std::string> columns;
+                if (!query_page.fields.empty() || spec)
+                    columns = schema.columns(pool, POINTS_KEYSET.table);
+
+                if (spec) {
+                    for (const std::string& column : {spec->x_column, spec->y_column}) {
+                        if (std::find(columns.begin(), columns.end(), column) == columns.end())
+                            throw std::invalid_argument("Unknown column '" + column + "'");
+                        if (!query_page.fields.empty()
+                            && std::find(query_page.fields.begin(), query_page.fields.end(), column) == query_page.fields.end())
+                            query_page.fields.push_back(column);
+                    }
+
+                    not_null = spec->y_column;
+                }
+
+                SqlParams params;
+                std::string query = buildKeysetQuery(POINTS_KEYSET, query_page, columns, id, params, not_null);
+                UDA_LOG_DEBUG("query", {{"route", "/api/points/:id"}, {"id", id}, {"sql", query}});
+
+                // прореженная серия - один ответ, курсора нет
+                QueryOptions opts = {.array = true, .spool = &spool,
+                                     .cursor_column = spec ? "" : POINTS_KEYSET.key_column,
+                                     .page_limit = spec ? 0 : query_page.limit,
+                                     .columnar = acceptsColumnar(req),
+                                     .downsample = spec,
+                                     .encoding = acceptedEncoding(req),
+                                     .compression = compression};
+                if (!spec) {
+                    toResponse(res, *querySharedRows(flight, pool, query, params, opts));
+                    return;
+                }
+
+                // границы корзин считаются по COUNT(*); ROWS = COUNT(*) отсекает строки, вставленные
+                // между двумя запросами. Оба запроса на одном подключении: реплики с разным отставанием
+                // дали бы счет и данные разных моментов. Ключ схлопывания - запрос до подсчета
+                SharedResult result = querySharedRows(flight, pool, query, params, opts, [&](PooledConnection& fbc) {
+                    DownsampleSpec counted = *spec;
+                    counted.total_rows = countKeysetRows(fbc, POINTS_KEYSET, query_page, id, spec->y_column);
+
+                    // ?limit= ограничивает прореживаемый участок, а не только выход
+                    PageRequest counted_page = query_page;
+                    if (counted_page.limit > 0)
+                        counted.total_rows = std::min<uint64_t>(counted.total_rows, counted_page.limit);
+                    counted_page.limit = std::max<uint64_t>(counted.total_rows, 1);
+
+                    SqlParams counted_params;
+                    std::string counted_query = buildKeysetQuery(POINTS_KEYSET, counted_page, columns, id,
+                                                                 counted_params, spec->y_column);
+                    QueryOptions counted_opts = opts;
+                    counted_opts.downsample = counted;
+                    return queryRows(fbc, counted_query, counted_params, counted_opts);
+                });
+                toResponse(res, *result);
+            } catch (const std::invalid_argument &e) {
+                res = crow::response(400, e.what());
+            } catch (const QueryCancelled &e) {
+                res = crow::response(504, e.what());
+            } catch (const std::exception &e) {
+                UDA_LOG_ERROR("request failed", {{"route", "/api/points/:id"}, {"id", id}, {"error", e.what()}});
+                res = crow::response(500, e.what());
             }
+        });
+    });
 
-            std::string query = "SELECT * FROM RD2_POINTS WHERE SESSION_ID=" + std::to_string(id);
-            std::cout << query << std::endl;
-
-            std::vector<crow::json::wvalue> points = fbc.getSQL(query);
-            fbc.disconnect();
-
-            if (points.empty())
-                return crow::response(404, "Not found");
-
-            crow::json::wvalue result_json;
-            for (size_t i = 0; i < points.size(); i++) {
-                result_json[i] = std::move(points[i]);
+    CROW_WEBSOCKET_ROUTE(app, "/ws/points")
+        .onclose([&](crow::websocket::connection& conn, const std::string&, uint16_t) {
+            feed.disconnect(conn);
+        })
+        .onmessage([&](crow::websocket::connection& conn, const std::string& data, bool is_binary) {
+            if (is_binary) {
+                conn.send_text("{\"error\":\"Expected a text message\"}");
+                return;
             }
+            feed.handleMessage(conn, data);
+        });
+
+    CROW_ROUTE(app, "/api/param/<int>")([&](const crow::request& req, crow::response& res, int id) {
+        respondAsync(executor, param_metrics, DbPriority::High, LOOKUP_TIMEOUTS, res, [&, id](crow::response& res) {
+            try {
+                cachedResponse(res, cache, req, "/api/param/" + std::to_string(id), cacheTtl(PARAM_TTL), [&]() {
+                    std::string query = "SELECT * FROM PASSP_SCAN WHERE DEVICE_ID = ?";
+                    UDA_LOG_DEBUG("query", {{"route", "/api/param/:id"}, {"id", id}, {"sql", query}});
+
+                    return querySharedRows(flight, pool, query, {id}, {.array = false});
+                });
+            } catch (const QueryCancelled &e) {
+                res = crow::response(504, e.what());
+            } catch (const std::exception &e) {
+                UDA_LOG_ERROR("request failed", {{"route", "/api/param/:id"}, {"id", id}, {"error", e.what()}});
+                res = crow::response(500, e.what());
+            }
+        });
+    });
 
-            return crow::response(200, result_json);
-        } catch (const std::exception &e) {
-            std::cerr << "Error in /api/points: " << e.what() << std::endl;
-            return crow::response(500, e.what());
+    CROW_ROUTE(app, "/api/pool/stats")([&]() {
+        FBPoolStats stats = pool.totals();
+
+        crow::json::wvalue result_json;
+        result_json["total"] = static_cast<uint64_t>(stats.total);
+        result_json["idle"] = static_cast<uint64_t>(stats.idle);
+        result_json["leased"] = static_cast<uint64_t>(stats.leased);
+        result_json["acquired"] = stats.acquired;
+        result_json["waited"] = stats.waited;
+        result_json["timeouts"] = stats.timeouts;
+        result_json["reconnects"] = stats.reconnects;
+        result_json["evicted"] = stats.evicted;
+        result_json["wait_avg_ms"] = stats.wait_avg_ms;
+        result_json["wait_max_ms"] = stats.wait_max_ms;
+        result_json["breaker_trips"] = stats.breaker_trips;
+
+        std::vector<crow::json::wvalue> nodes;
+        for (const FBNodeStats& node : pool.stats()) {
+            crow::json::wvalue node_json;
+            node_json["name"] = node.name;
+            node_json["role"] = node.primary ? "primary" : "replica";
+            node_json["lag_ms"] = node.lag_ms;
+            node_json["total"] = static_cast<uint64_t>(node.pool.total);
+            node_json["leased"] = static_cast<uint64_t>(node.pool.leased);
+            node_json["lease_ewma_ms"] = node.pool.lease_ewma_ms;
+            node_json["breaker_open"] = node.pool.breaker_open;
+            node_json["breaker_trips"] = node.pool.breaker_trips;
+            nodes.push_back(std::move(node_json));
         }
+        result_json["nodes"] = std::move(nodes);
+
+        return crow::response(200, result_json);
     });
 
-    CROW_ROUTE(app, "/api/param/<int>")([&](int id) {
-        try {
-            FirebirdConnection fbc(fb_conf);
-            if (!fbc.connect()) {
-                throw std::runtime_error("Failed to connect to Firebird database");
-            }
+    CROW_ROUTE(app, "/api/executor/stats")([&]() {
+        DbExecutorStats stats = executor.stats();
 
-            std::string query = "SELECT * FROM PASSP_SCAN WHERE DEVICE_ID=" + std::to_string(id);
-            std::cout << query << std::endl;
+        crow::json::wvalue result_json;
+        result_json["queued_high"] = static_cast<uint64_t>(stats.queued[static_cast<size_t>(DbPriority::High)]);
+        result_json["queued_normal"] = static_cast<uint64_t>(stats.queued[static_cast<size_t>(DbPriority::Normal)]);
+        result_json["queued_low"] = static_cast<uint64_t>(stats.queued[static_cast<size_t>(DbPriority::Low)]);
+        result_json["active"] = static_cast<uint64_t>(stats.active);
+        result_json["completed"] = stats.completed;
+        result_json["rejected"] = stats.rejected;
 
-            std::vector<crow::json::wvalue> params = fbc.getSQL(query);
-            fbc.disconnect();
+        return crow::response(200, result_json);
+    });
 
-            if (params.empty())
-                return crow::response(404, "Not found");
+    CROW_ROUTE(app, "/api/cache/stats")([&]() {
+        ResponseCacheStats stats = cache.stats();
+
+        crow::json::wvalue result_json;
+        result_json["hits"] = stats.hits;
+        result_json["misses"] = stats.misses;
+        result_json["evictions"] = stats.evictions;
+        result_json["expired"] = stats.expired;
+        result_json["entries"] = static_cast<uint64_t>(stats.entries);
+        result_json["bytes"] = static_cast<uint64_t>(stats.bytes);
+        result_json["coalesced"] = flight.coalescedCount();
+        result_json["executed"] = flight.executedCount();
+
+        SnapshotStats snapshot_stats = snapshots.stats();
+        result_json["snapshot_entries"] = static_cast<uint64_t>(snapshot_stats.entries);
+        result_json["snapshot_bytes"] = snapshot_stats.bytes;
+        result_json["snapshot_hits"] = snapshot_stats.hits;
+        result_json["snapshot_builds"] = snapshot_stats.builds;
+        result_json["snapshot_evictions"] = snapshot_stats.evictions;
+
+        return crow::response(200, result_json);
+    });
 
-            return crow::response(200, params[0]);
-        } catch (const std::exception &e) {
-            std::cerr << "Error in /api/params: " << e.what() << std::endl;
-            return crow::response(500, e.what());
+    // для Prometheus: гистограммы этапов по маршрутам и состояние пула, очередей и кэшей
+    CROW_ROUTE(app, "/metrics")([&]() {
+        std::string body = metrics.render();
+
+        FBPoolStats pool_stats = pool.totals();
+        Metrics::appendScalar(body, "uda_pool_connections", "gauge", "Open Firebird attachments", pool_stats.total);
+        Metrics::appendScalar(body, "uda_pool_leased", "gauge", "Attachments leased to requests", pool_stats.leased);
+        Metrics::appendScalar(body, "uda_pool_acquired_total", "counter", "Pool acquisitions", pool_stats.acquired);
+        Metrics::appendScalar(body, "uda_pool_waited_total", "counter", "Acquisitions that waited for a free attachment", pool_stats.waited);
+        Metrics::appendScalar(body, "uda_pool_timeouts_total", "counter", "Acquisitions that timed out", pool_stats.timeouts);
+        Metrics::appendScalar(body, "uda_pool_reconnects_total", "counter", "Broken attachments reconnected", pool_stats.reconnects);
+        pool.appendMetrics(body);
+
+        DbExecutorStats executor_stats = executor.stats();
+        size_t queued = 0;
+        for (size_t q : executor_stats.queued) queued += q;
+        Metrics::appendScalar(body, "uda_executor_queued", "gauge", "Tasks waiting for a DB executor thread", queued);
+        Metrics::appendScalar(body, "uda_executor_active", "gauge", "Tasks running on DB executor threads", executor_stats.active);
+        Metrics::appendScalar(body, "uda_executor_rejected_total", "counter", "Requests rejected with 503", executor_stats.rejected);
+
+        ResponseCacheStats cache_stats = cache.stats();
+        Metrics::appendScalar(body, "uda_cache_hits_total", "counter", "Response cache hits", cache_stats.hits);
+        Metrics::appendScalar(body, "uda_cache_misses_total", "counter", "Response cache misses", cache_stats.misses);
+        Metrics::appendScalar(body, "uda_cache_bytes", "gauge", "Response cache size", cache_stats.bytes);
+        Metrics::appendScalar(body, "uda_flight_coalesced_total", "counter", "Queries served by an identical running query", flight.coalescedCount());
+
+        SnapshotStats snapshot_stats = snapshots.stats();
+        Metrics::appendScalar(body, "uda_snapshot_hits_total", "counter", "Responses served from session snapshots", snapshot_stats.hits);
+        Metrics::appendScalar(body, "uda_snapshot_bytes", "gauge", "Session snapshot store size", snapshot_stats.bytes);
+
+        // для uda_bench: выделения на запрос и пиковая память между прогонами
+        Metrics::appendScalar(body, "uda_process_peak_rss_bytes", "gauge", "Peak resident set size", AllocStats::peakRssBytes());
+        Metrics::appendScalar(body, "uda_log_dropped_total", "counter", "Log records dropped on a full ring", Logger::dropped());
+        if (AllocStats::counting()) {
+            Metrics::appendScalar(body, "uda_allocations_total", "counter", "Heap allocations", AllocStats::allocations());
         }
+
+        crow::response res(200, body);
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
     });
 
     app.port(CROW_PORT).multithreaded().run();
 
     return 0;
-}
\ No newline at end of file
+}